@@ -0,0 +1,71 @@
+#ifndef _GLEXTENSIONS_H
+#define _GLEXTENSIONS_H
+
+// Funções e constantes de versões de OpenGL posteriores à 3.3, que não fazem
+// parte do carregador gerado pela biblioteca GLAD (veja "glad.h"). Estas são
+// carregadas em tempo de execução pela função GLExtensions_Load(), definida
+// em "glextensions.cpp", e só podem ser utilizadas se a variável
+// GLEXT_VERSION_* correspondente for diferente de zero.
+//
+// Seguimos a mesma convenção de nomes de GLAD: o ponteiro glad_glFoo é
+// acessado pelo nome usual glFoo.
+
+#include <glad/glad.h>
+
+// OpenGL 4.1 (ou extensão ARB_get_program_binary): leitura e carregamento de
+// programas de GPU já linkados, em formato binário dependente do driver.
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH           0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS      0x87FE
+#define GL_PROGRAM_BINARY_FORMATS          0x87FF
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+extern PFNGLGETPROGRAMBINARYPROC glad_glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC glad_glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC glad_glProgramParameteri;
+#define glGetProgramBinary glad_glGetProgramBinary
+#define glProgramBinary glad_glProgramBinary
+#define glProgramParameteri glad_glProgramParameteri
+
+// Extensão KHR_parallel_shader_compile (ou ARB_parallel_shader_compile): o
+// driver compila e linka os shaders em outras threads, e GL_COMPLETION_STATUS
+// indica, sem bloquear, se a compilação ou linkagem já terminou.
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR           0x91B1
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR;
+#define glMaxShaderCompilerThreadsKHR glad_glMaxShaderCompilerThreadsKHR
+
+// OpenGL 4.3: compute shaders, shader storage buffers e multi-draw indirect
+#define GL_SHADER_STORAGE_BUFFER      0x90D2
+#define GL_DRAW_INDIRECT_BUFFER       0x8F3F
+#define GL_COMPUTE_SHADER             0x91B9
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#define GL_COMMAND_BARRIER_BIT        0x00000040
+
+typedef void (APIENTRYP PFNGLDISPATCHCOMPUTEPROC)(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+typedef void (APIENTRYP PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+
+extern PFNGLDISPATCHCOMPUTEPROC glad_glDispatchCompute;
+extern PFNGLMEMORYBARRIERPROC glad_glMemoryBarrier;
+extern PFNGLMULTIDRAWELEMENTSINDIRECTPROC glad_glMultiDrawElementsIndirect;
+#define glDispatchCompute glad_glDispatchCompute
+#define glMemoryBarrier glad_glMemoryBarrier
+#define glMultiDrawElementsIndirect glad_glMultiDrawElementsIndirect
+
+// Versões de OpenGL e extensões suportadas pelo contexto atual (além de 3.3)
+extern int GLEXT_ARB_get_program_binary;
+extern int GLEXT_KHR_parallel_shader_compile;
+extern int GLEXT_VERSION_4_3;
+
+// Carrega as funções acima. Deve ser chamada após gladLoadGLLoader().
+typedef void* (*GLEXTloadproc)(const char *name);
+void GLExtensions_Load(GLEXTloadproc load);
+
+#endif // _GLEXTENSIONS_H
@@ -0,0 +1,21 @@
+#ifndef _LIGHTS_H
+#define _LIGHTS_H
+
+// Fontes de luz pontuais e spots da cena (tochas, fogueiras, feitiços), além
+// da luz direcional do sol definida nos shaders. A lista de luzes do quadro
+// é montada por UpdateSceneLights() em "main.cpp" e consumida pelos caminhos
+// de renderização que suportam muitas luzes. Veja "deferred.cpp".
+
+#include <glm/vec4.hpp>
+
+// O layout desta estrutura é o mesmo dos atributos por instância de
+// "shader_deferred_light_vertex.glsl": três vec4, sem espaços entre eles.
+struct SceneLight
+{
+    glm::vec4 position_radius; // Posição global (xyz) e raio de alcance (w)
+    glm::vec4 color;           // Espectro da fonte de luz (rgb), já multiplicado pela intensidade
+    glm::vec4 spot_direction;  // Direção do spot (xyz) e cosseno do ângulo de abertura (w).
+                               // Luzes pontuais têm w = -1 (abertura de 180 graus).
+};
+
+#endif // _LIGHTS_H
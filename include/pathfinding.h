@@ -0,0 +1,33 @@
+#ifndef _PATHFINDING_H
+#define _PATHFINDING_H
+
+// Busca de caminhos (A*) sobre uma grade de navegação derivada do cenário,
+// com o mesmo custo de Character::move(): a distância andada, mais 4 vezes
+// a diferença de altura ao subir ou descer um planalto; a água (altura
+// negativa) é intransponível. Definida em "pathfinding.cpp", sem OpenGL.
+//
+// Toda a memória da busca (nós, lista aberta em heap binário) é alocada por
+// Pathfinding_Build(); as buscas não alocam memória, exceto para aumentar o
+// vetor "path" recebido.
+
+#include <vector>
+
+#include <glm/vec4.hpp>
+
+class Scenary;
+
+// Tamanho padrão das células da grade de navegação
+#define PATHFINDING_CELL_SIZE 0.05f
+
+// Constrói a grade de navegação do cenário. Deve ser chamada de novo se o
+// cenário mudar.
+void Pathfinding_Build(Scenary& scenary, float cell_size = PATHFINDING_CELL_SIZE);
+
+// Caminho de menor custo de "start" até "goal", gastando no máximo
+// "max_cost" (por exemplo, "remaining_movement"). "path" recebe os pontos a
+// seguir, sem "start". Retorna verdadeiro se o caminho chega até "goal"; se
+// não, "path" leva até o ponto alcançável mais próximo de "goal" (ou fica
+// vazio, se não é possível sair do lugar).
+bool Pathfinding_FindPath(glm::vec4 start, glm::vec4 goal, float max_cost, std::vector<glm::vec4>& path);
+
+#endif // _PATHFINDING_H
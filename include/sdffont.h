@@ -0,0 +1,50 @@
+#ifndef _SDFFONT_H
+#define _SDFFONT_H
+
+// Formato do arquivo de fonte "signed distance field" (SDF) gerado pela
+// ferramenta "tools/sdffont.cpp" e carregado por TextRendering_LoadSdfFont(),
+// em "textrendering.cpp".
+//
+// Cada texel do atlas guarda a distância do seu centro até a borda do glifo,
+// mapeada para [0,255]: 128 é a borda, valores maiores ficam dentro do glifo,
+// e a distância de "spread" pixels (do atlas) corresponde a 0 ou 255. Como a
+// borda é reconstruída pelo fragment shader, o mesmo atlas serve para
+// qualquer tamanho de texto, e também para contornos e sombras.
+//
+// O arquivo contém um SdfFontHeader, "glyphs_count" estruturas SdfFontGlyph,
+// e os "tex_width*tex_height" bytes do atlas (linha 0 = coordenada t = 0).
+// Todos os valores são little-endian.
+
+#include <stdint.h>
+
+#define SDFFONT_MAGIC   0x46464453 // "SDFF"
+#define SDFFONT_VERSION 1
+
+struct SdfFontHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tex_width;
+    uint32_t tex_height;
+    float    size;      // Tamanho (em pixels) em que os glifos foram gerados
+    float    height;    // Distância entre linhas
+    float    ascender;
+    float    descender;
+    float    spread;    // Distância máxima representada, em pixels do atlas
+    uint32_t glyphs_count;
+};
+
+// Métricas de um glifo, em pixels, com a mesma convenção de texture_glyph_t
+// (veja "dejavufont.h"): (offset_x, offset_y) é o canto superior esquerdo do
+// retângulo do glifo relativo à caneta, com y para cima. O retângulo já
+// inclui a margem de "spread" pixels em volta do glifo.
+struct SdfFontGlyph
+{
+    uint32_t codepoint;
+    float    width, height;
+    float    offset_x, offset_y;
+    float    advance_x;
+    float    s0, t0, s1, t1;
+};
+
+#endif // _SDFFONT_H
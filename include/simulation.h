@@ -0,0 +1,190 @@
+#ifndef _SIMULATION_H
+#define _SIMULATION_H
+
+// Estado e regras do jogo: o cenário, os personagens, o movimento, o combate
+// e os turnos. Definidos em "simulation.cpp", que não depende de OpenGL nem
+// de GLFW, e pode ser compilado sozinho ("make simulation") para executar
+// batalhas sem janela (veja "tools/headless.cpp").
+//
+// As partes visuais das classes abaixo (Scenary::draw(), Character::draw(),
+// Free_Camera::rotate(), ...) são somente declaradas aqui, e definidas em
+// "main.cpp"; um programa sem janela simplesmente não as chama. O jogo é
+// avisado das mudanças de estado que precisa mostrar pelas funções em
+// SimulationHooks.
+
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Estrutura que representa uma elevação no mapa
+struct Plateau
+{
+    glm::vec3 position;     // Posição do centro do planalto
+    glm::vec3 scale;        // Escala das medidas do planalto
+    glm::vec2 bottom_limit; // Menores coordenadas de área pertencentes ao planalto
+    glm::vec2 top_limit;    // Maiores coordenadas de área pertencentes ao planalto
+};
+
+class Free_Camera{
+public:
+    // Vetores
+    glm::vec4 position;
+    glm::vec4 view;
+    glm::vec4 up;
+    glm::vec4 right;
+    glm::vec4 v;
+    // Ângulos
+    float phi;
+    // Parâmetros
+    float speed;    // Unidades por segundo
+    // Near e Far
+    float nearplane = -0.1f;
+    float farplane  = -10.0f;
+    // Estado no passo anterior da simulação, para a interpolação
+    glm::vec4 previous_position;
+    glm::vec4 previous_view;
+
+    void init(glm::vec4 pos, glm::vec4 origin);
+    void init_char(glm::vec4 pos, glm::vec4 origin);
+    void move(glm::vec4 direction);
+    void move2D(glm::vec4 direction);
+    void save_state() {
+        previous_position = position;
+        previous_view = view;
+    }
+    void rotate(glm::vec4 axis, float angle);   // Definida em main.cpp
+    void look(float dtheta, float dphi);        // Definida em main.cpp
+};
+
+// Grade de alturas de Scenary: tamanho padrão das células, e o valor das
+// células cortadas pela borda de um planalto, onde a altura é calculada
+// exatamente
+#define SCENARY_HEIGHT_CELL_SIZE    0.05f
+#define SCENARY_HEIGHT_EXACT        -2.0f
+
+class Scenary{
+public:
+    glm::vec3 land_size;            // Escala das medidas da terra
+    std::vector<Plateau> plateaus;  // Lista de planaltos
+
+    // Alturas do terreno pré-calculadas por build_height_grid(), em células
+    // de "height_cell_size" (configurável antes de build()) cobrindo a terra
+    float height_cell_size = SCENARY_HEIGHT_CELL_SIZE;
+    std::vector<float> height_grid;
+    int height_columns = 0;
+    int height_rows = 0;
+    float height_x_min, height_x_max, height_z_min, height_z_max;   // Bordas da terra
+    float height_inverse_cell;
+
+    void build();
+    void build_height_grid();       // Chamada por build(); de novo se "plateaus" mudar
+    void draw();                    // Definida em main.cpp
+    float heigth(glm::vec4 dot);
+    void heigths(const float* x, const float* z, float* result, int count);
+};
+
+#define SPEARMAN    1
+#define GUARDIAN    2
+#define ARCHER      3
+class Character{
+public:
+    float max_hp;
+    float current_hp;
+    float max_movement;
+    float remaining_movement;
+    int max_actions;
+    int remaining_actions;
+    float range;
+    float damage;
+    int team;
+    int initiative;
+    glm::vec4 position;
+    int role;
+    Free_Camera camera;
+    glm::vec4 facing_vector;
+    bool isAttacking = false;
+    // Caixa que envolve todas as partes do personagem, relativa a "position".
+    // Usada para descartar todas as partes de uma vez só no frustum culling.
+    glm::vec3 bbox_min;
+    glm::vec3 bbox_max;
+    bool bbox_valid = false;
+    int num_parts = 0;
+    // Estado no passo anterior da simulação, para a interpolação
+    glm::vec4 previous_position;
+    glm::vec4 previous_facing_vector;
+
+    void attack();
+    void init_attributes(int type);
+    void take_damage(float delta, int alvo);
+    void end_turn() {
+        remaining_movement = max_movement;
+        remaining_actions = max_actions;
+    }
+    void set_team(int team_number) {
+        team = team_number;
+    }
+    void save_state() {
+        previous_position = position;
+        previous_facing_vector = facing_vector;
+        camera.save_state();
+    }
+    void draw();                    // Definida em main.cpp
+    void draw_projectile();         // Definida em main.cpp
+    void move();
+    void moveFP(glm::vec4 direction);
+    bool follow_path(const std::vector<glm::vec4>& path, size_t& next);
+
+};
+
+// Cenário e personagens
+extern Scenary scenary;
+extern std::vector<Character> characters;
+extern int active_character;
+extern int target;  // Alvo de um ataque
+
+// Funções chamadas pela simulação quando algo que o jogo mostra muda. Todas
+// são opcionais (NULL).
+struct SimulationHooks
+{
+    void (*unit_changed)(int index);                        // Vida ou turno de um personagem
+    void (*units_changed)();                                // Lista de personagens (morte)
+    void (*active_unit_moved)(const glm::vec4& position);  // Personagem ativo andou, ou o turno passou
+    void (*attack_hit)(int index, float hp, bool double_damage);
+};
+void Simulation_SetHooks(const SimulationHooks& hooks);
+
+// Relógio da simulação, em segundos, usado pelas animações de ataque. O
+// jogo utiliza glfwGetTime(); sem relógio definido, o tempo só avança com
+// Simulation_AdvanceClock(), o que torna as batalhas sem janela
+// determinísticas.
+typedef double (*SimulationClock)();
+void Simulation_SetClock(SimulationClock clock);
+void Simulation_AdvanceClock(double seconds);
+
+void CreateCharacters(glm::vec3 land_size);
+void PassTurn();
+
+// Passo fixo: o movimento avança sempre Simulation_TickSeconds() por passo,
+// independente da taxa de quadros. A cada quadro, o jogo acumula o tempo
+// passado com Simulation_AccumulateTime(), que retorna quantos passos devem
+// ser executados (no máximo SIMULATION_MAX_TICKS, para não travar o jogo
+// quando um quadro demora demais). Antes de cada passo, o estado é guardado
+// com Simulation_SaveState(); o quadro é desenhado entre o estado guardado e
+// o atual, na proporção Simulation_InterpolationFactor().
+#define SIMULATION_TICK_RATE    60.0    // Passos por segundo padrão
+#define SIMULATION_MAX_TICKS    8
+void Simulation_SetTickRate(double ticks_per_second);
+double Simulation_TickSeconds();
+int Simulation_AccumulateTime(double seconds);
+float Simulation_InterpolationFactor();
+void Simulation_SaveState();
+
+// Animação
+void init_time(void);
+float get_delta_time(void);
+
+glm::vec4 normalize(glm::vec4 aim_vector);
+
+#endif // _SIMULATION_H
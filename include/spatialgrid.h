@@ -0,0 +1,39 @@
+#ifndef _SPATIALGRID_H
+#define _SPATIALGRID_H
+
+// Grade uniforme, no plano XZ, com os índices dos personagens de
+// "characters" (veja "simulation.h") em cada célula. Permite encontrar os
+// personagens próximos de um ponto sem percorrer a lista inteira: as buscas
+// visitam somente as células que a região buscada cobre.
+//
+// A grade é atualizada incrementalmente: SpatialGrid_Move() só muda o
+// personagem de célula quando ele cruza a borda de uma, e SpatialGrid_Remove()
+// acompanha a remoção de um elemento de "characters", que muda os índices dos
+// personagens seguintes. Definida em "spatialgrid.cpp", sem OpenGL.
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Tamanho padrão das células, em unidades do mundo
+#define SPATIALGRID_CELL_SIZE 0.5f
+
+// Cria uma grade vazia cobrindo o terreno de tamanho "land_size", centrado na
+// origem. Posições fora do terreno ficam nas células da borda.
+void SpatialGrid_Init(glm::vec3 land_size, float cell_size = SPATIALGRID_CELL_SIZE);
+
+void SpatialGrid_Insert(int unit, glm::vec4 position);
+void SpatialGrid_Move(int unit, glm::vec4 position);
+void SpatialGrid_Remove(int unit);
+
+// Adiciona a "result" os personagens a distância (em 3D) de no máximo
+// "radius" de "center", em ordem qualquer. Retorna quantos foram adicionados.
+int SpatialGrid_QueryRange(glm::vec4 center, float radius, std::vector<int>& result);
+
+// Idem, somente os personagens dentro do cone de abertura "half_angle" (em
+// radianos) em volta de "direction" (normalizado, no plano XZ), medido pela
+// direção horizontal de "apex" até o personagem.
+int SpatialGrid_QueryCone(glm::vec4 apex, glm::vec4 direction, float radius, float half_angle, std::vector<int>& result);
+
+#endif // _SPATIALGRID_H
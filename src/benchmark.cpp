@@ -0,0 +1,143 @@
+// Modo de benchmark, ativado com "main --benchmark": desenhamos a cena, vista
+// de uma câmera fixa, em um framebuffer fora da tela nas resoluções 1920x1080
+// e 3840x2160, e medimos o tempo de GPU de cada quadro com "timer queries".
+//
+// Cada resolução é medida duas vezes: com LEGACY_MATRIX_INVERSES, onde os
+// shaders computam inverse(transpose(model)) em cada vértice e inverse(view)
+// em cada fragmento (como antes), e com os shaders atuais, que recebem estas
+// matrizes já computadas pelo CPU. Como o terreno cobre quase toda a tela, o
+// tempo medido é dominado pelo fragment shader.
+#include <cstdio>
+#include <string>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/mat4x4.hpp>
+
+// Funções e variáveis definidas em main.cpp
+void DrawScene(glm::mat4 view, glm::mat4 projection);
+void LoadShadersFromFiles();
+extern std::string g_ShaderExtraDefines;
+
+// Quadros descartados antes de cada medida, e quadros medidos
+#define BENCHMARK_WARMUP_FRAMES 30
+#define BENCHMARK_FRAMES        300
+
+// Desenha BENCHMARK_FRAMES quadros em um framebuffer de width x height pixels
+// e retorna o tempo médio de GPU por quadro, em milissegundos. Em "wall_ms"
+// retornamos o tempo médio total do quadro (CPU e GPU).
+static double Benchmark_Measure(int width, int height, const glm::mat4& view, const glm::mat4& projection, double* wall_ms)
+{
+    // Framebuffer fora da tela, com buffers de cor e profundidade
+    GLuint framebuffer_id, color_id, depth_id;
+    glGenFramebuffers(1, &framebuffer_id);
+    glGenRenderbuffers(1, &color_id);
+    glGenRenderbuffers(1, &depth_id);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, color_id);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_id);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_id);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_id);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_id);
+
+    double gpu_ms = -1.0;
+    *wall_ms = -1.0;
+
+    if ( glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE )
+    {
+        fprintf(stderr, "ERROR: Cannot create %dx%d benchmark framebuffer.\n", width, height);
+    }
+    else
+    {
+        glViewport(0, 0, width, height);
+
+        GLuint query_id;
+        glGenQueries(1, &query_id);
+
+        GLuint64 total_ns = 0;
+        double start = 0.0;
+
+        for (int frame = 0; frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES; ++frame)
+        {
+            bool measured = frame >= BENCHMARK_WARMUP_FRAMES;
+            if ( frame == BENCHMARK_WARMUP_FRAMES )
+            {
+                glFinish();
+                start = glfwGetTime();
+            }
+
+            if ( measured )
+                glBeginQuery(GL_TIME_ELAPSED, query_id);
+
+            glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            DrawScene(view, projection);
+
+            if ( measured )
+            {
+                // Esperamos o resultado a cada quadro: a medida da GPU não
+                // depende disso, e assim um quadro não se sobrepõe ao próximo.
+                glEndQuery(GL_TIME_ELAPSED);
+                GLuint64 elapsed_ns = 0;
+                glGetQueryObjectui64v(query_id, GL_QUERY_RESULT, &elapsed_ns);
+                total_ns += elapsed_ns;
+            }
+        }
+
+        glFinish();
+        *wall_ms = (glfwGetTime() - start) * 1000.0 / BENCHMARK_FRAMES;
+        gpu_ms = (double)total_ns / 1.0e6 / BENCHMARK_FRAMES;
+
+        glDeleteQueries(1, &query_id);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer_id);
+    glDeleteRenderbuffers(1, &color_id);
+    glDeleteRenderbuffers(1, &depth_id);
+
+    return gpu_ms;
+}
+
+// Executa o benchmark e imprime os resultados no terminal. As matrizes "view"
+// e "projection" definem a câmera fixa (com razão de aspecto 16:9).
+void Benchmark_Run(const glm::mat4& view, const glm::mat4& projection)
+{
+    static const int resolutions[2][2] = { {1920, 1080}, {3840, 2160} };
+
+    // Nome e #define de cada variante dos shaders
+    static const char* variants[2][2] = {
+        { "antes (inversas na GPU)",  "LEGACY_MATRIX_INVERSES" },
+        { "depois (inversas no CPU)", "" }
+    };
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    printf("Benchmark: media de %d quadros por medida\n", BENCHMARK_FRAMES);
+
+    for (int v = 0; v < 2; ++v)
+    {
+        g_ShaderExtraDefines = variants[v][1];
+        LoadShadersFromFiles();
+
+        for (int r = 0; r < 2; ++r)
+        {
+            double wall_ms;
+            double gpu_ms = Benchmark_Measure(resolutions[r][0], resolutions[r][1], view, projection, &wall_ms);
+            printf("  %-26s %4dx%-4d  GPU %8.3f ms  quadro %8.3f ms\n",
+                   variants[v][0], resolutions[r][0], resolutions[r][1], gpu_ms, wall_ms);
+        }
+    }
+    fflush(stdout);
+
+    // Restauramos os shaders e o viewport originais
+    g_ShaderExtraDefines = "";
+    LoadShadersFromFiles();
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
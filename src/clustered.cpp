@@ -0,0 +1,356 @@
+// Caminho de renderização "clustered forward": uma alternativa mais leve ao
+// caminho "deferred" (veja "deferred.cpp"), que mantém o anti-aliasing por
+// multisampling (GLFW_SAMPLES) do framebuffer da janela.
+//
+// O frustum da câmera é dividido em uma grade 3D de "clusters": blocos da
+// tela em X e Y, e fatias de profundidade em Z (com espessura crescendo
+// exponencialmente, como a perspectiva). A cada quadro, o CPU descobre quais
+// luzes alcançam cada cluster e envia a lista para a GPU em "buffer
+// textures". O fragment shader (com CLUSTERED_LIGHTING) encontra o cluster
+// do fragmento e itera somente sobre as luzes dele.
+//
+// O teste de cada luz (esfera de alcance) contra a caixa de cada cluster é
+// feito com instruções SSE, quatro luzes de cada vez, quando disponíveis.
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CLUSTERED_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+#include <glad/glad.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/common.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include "lights.h"
+
+// Tamanho da grade de clusters
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT  (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+
+// Unidades de textura das "buffer textures", depois das utilizadas pelo
+// caminho "deferred", e ponto de ligação do uniform block ClusterParams.
+#define CLUSTERED_RANGES_UNIT  15
+#define CLUSTERED_INDICES_UNIT 16
+#define CLUSTERED_LIGHTS_UNIT  17
+#define CLUSTERED_PARAMS_BINDING 0
+
+// Mesmo layout (std140) do uniform block ClusterParams de "shader_fragment.glsl".
+struct ClusterParams
+{
+    GLint   grid[4];   // (X, Y, Z, -)
+    GLfloat depth[4];  // (profundidade do near plane, Z / log(far / near), -, -)
+    GLfloat screen[4]; // (largura, altura, intensidade do sol, -)
+};
+
+// Caixa de um cluster, em coordenadas da câmera
+struct ClusterBox
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+GLuint clustered_ranges_buffer = 0;  // (primeiro índice, número de luzes) de cada cluster
+GLuint clustered_indices_buffer = 0; // Índices das luzes, concatenados
+GLuint clustered_lights_buffer = 0;  // SceneLight de cada luz (três texels RGBA32F)
+GLuint clustered_params_buffer = 0;  // Uniform buffer com ClusterParams
+GLuint clustered_ranges_texture = 0;
+GLuint clustered_indices_texture = 0;
+GLuint clustered_lights_texture = 0;
+
+// Caixas dos clusters. Só dependem da matriz de projeção, e são recomputadas
+// somente quando ela muda.
+std::vector<ClusterBox> g_ClusterBoxes;
+glm::mat4 clustered_boxes_projection;
+float clustered_near = 0.0f;
+float clustered_far = 0.0f;
+
+// Dados de um quadro, mantidos entre quadros para evitar alocações
+std::vector<GLuint> g_ClusterRanges;
+std::vector<GLuint> g_ClusterIndices;
+
+// Estatísticas do último quadro (mostradas no HUD)
+int g_ClusteredLightCount = 0;
+int g_ClusteredMaxLightsPerCluster = 0;
+
+// Cria os buffers e as "buffer textures", associadas para sempre às suas
+// unidades de textura.
+void Clustered_Init()
+{
+    glGenBuffers(1, &clustered_ranges_buffer);
+    glGenBuffers(1, &clustered_indices_buffer);
+    glGenBuffers(1, &clustered_lights_buffer);
+    glGenBuffers(1, &clustered_params_buffer);
+
+    // Os buffers precisam de algum conteúdo antes de serem associados às
+    // texturas; o tamanho definitivo é dado a cada quadro.
+    GLfloat zeros[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glBindBuffer(GL_TEXTURE_BUFFER, clustered_ranges_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, CLUSTER_COUNT * 2 * sizeof(GLuint), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, clustered_indices_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(zeros), zeros, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, clustered_lights_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(zeros), zeros, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, clustered_params_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ClusterParams), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CLUSTERED_PARAMS_BINDING, clustered_params_buffer);
+
+    GLint active_texture;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+
+    glGenTextures(1, &clustered_ranges_texture);
+    glActiveTexture(GL_TEXTURE0 + CLUSTERED_RANGES_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, clustered_ranges_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, clustered_ranges_buffer);
+
+    glGenTextures(1, &clustered_indices_texture);
+    glActiveTexture(GL_TEXTURE0 + CLUSTERED_INDICES_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, clustered_indices_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, clustered_indices_buffer);
+
+    glGenTextures(1, &clustered_lights_texture);
+    glActiveTexture(GL_TEXTURE0 + CLUSTERED_LIGHTS_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, clustered_lights_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, clustered_lights_buffer);
+
+    glActiveTexture(active_texture);
+
+    g_ClusterRanges.resize(CLUSTER_COUNT * 2);
+}
+
+// Associa as variáveis do caminho "clustered" de um programa (se existirem)
+// às unidades de textura e ao uniform buffer. Chamada por SetupTextureUnits().
+void Clustered_SetupProgram(GLuint program_id)
+{
+    GLuint block_index = glGetUniformBlockIndex(program_id, "ClusterParams");
+    if (block_index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program_id, block_index, CLUSTERED_PARAMS_BINDING);
+
+    glUniform1i(glGetUniformLocation(program_id, "cluster_ranges"),  CLUSTERED_RANGES_UNIT);
+    glUniform1i(glGetUniformLocation(program_id, "cluster_indices"), CLUSTERED_INDICES_UNIT);
+    glUniform1i(glGetUniformLocation(program_id, "cluster_lights"),  CLUSTERED_LIGHTS_UNIT);
+}
+
+// Ponto em coordenadas da câmera que é projetado nas coordenadas NDC (x,y,z)
+static glm::vec3 Clustered_Unproject(const glm::mat4& inverse_projection, float x, float y, float z)
+{
+    glm::vec4 p = inverse_projection * glm::vec4(x, y, z, 1.0f);
+    return glm::vec3(p) / p.w;
+}
+
+// Recomputa as caixas dos clusters para a matriz "projection". Cada bloco da
+// tela é um raio (perspectiva) ou prisma (ortográfica) que cortamos nas
+// profundidades de cada fatia. Funciona para os dois tipos de projeção.
+static void Clustered_BuildBoxes(const glm::mat4& projection)
+{
+    glm::mat4 inverse_projection = glm::inverse(projection);
+
+    // Profundidades do near e far plane (positivas, em frente à câmera)
+    float depth_a = -Clustered_Unproject(inverse_projection, 0.0f, 0.0f, -1.0f).z;
+    float depth_b = -Clustered_Unproject(inverse_projection, 0.0f, 0.0f,  1.0f).z;
+    clustered_near = std::max(std::min(depth_a, depth_b), 1e-3f);
+    clustered_far  = std::max(std::max(depth_a, depth_b), 2e-3f);
+
+    g_ClusterBoxes.resize(CLUSTER_COUNT);
+
+    for (int y = 0; y < CLUSTER_GRID_Y; ++y)
+    for (int x = 0; x < CLUSTER_GRID_X; ++x)
+    {
+        // Pontos dos quatro cantos do bloco no near e no far plane
+        glm::vec3 near_points[4], far_points[4];
+        for (int c = 0; c < 4; ++c)
+        {
+            float ndc_x = -1.0f + 2.0f * (x + (c & 1)) / CLUSTER_GRID_X;
+            float ndc_y = -1.0f + 2.0f * (y + (c >> 1)) / CLUSTER_GRID_Y;
+            near_points[c] = Clustered_Unproject(inverse_projection, ndc_x, ndc_y, -1.0f);
+            far_points[c]  = Clustered_Unproject(inverse_projection, ndc_x, ndc_y,  1.0f);
+        }
+
+        for (int z = 0; z < CLUSTER_GRID_Z; ++z)
+        {
+            // Profundidades da fatia: near * (far/near)^(z/Z)
+            float depth0 = clustered_near * powf(clustered_far / clustered_near, (float)z / CLUSTER_GRID_Z);
+            float depth1 = clustered_near * powf(clustered_far / clustered_near, (float)(z + 1) / CLUSTER_GRID_Z);
+
+            ClusterBox& box = g_ClusterBoxes[(z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x];
+            box.min = glm::vec3( 1e30f);
+            box.max = glm::vec3(-1e30f);
+            for (int c = 0; c < 4; ++c)
+            {
+                glm::vec3 ray = far_points[c] - near_points[c];
+                float t0 = (-depth0 - near_points[c].z) / ray.z;
+                float t1 = (-depth1 - near_points[c].z) / ray.z;
+                glm::vec3 p0 = near_points[c] + t0 * ray;
+                glm::vec3 p1 = near_points[c] + t1 * ray;
+                box.min = glm::min(box.min, glm::min(p0, p1));
+                box.max = glm::max(box.max, glm::max(p0, p1));
+            }
+        }
+    }
+
+    clustered_boxes_projection = projection;
+}
+
+// Luzes de uma fatia de profundidade, em coordenadas da câmera, em arrays
+// separados por coordenada ("structure of arrays") para os testes com SSE.
+// O tamanho é sempre múltiplo de 4, completado com luzes de raio negativo
+// que nunca alcançam nenhum cluster.
+struct SliceLights
+{
+    std::vector<float> x, y, z, radius2;
+    std::vector<GLuint> index;
+
+    void clear() { x.clear(); y.clear(); z.clear(); radius2.clear(); index.clear(); }
+    void push(float px, float py, float pz, float r2, GLuint i)
+    {
+        x.push_back(px); y.push_back(py); z.push_back(pz); radius2.push_back(r2); index.push_back(i);
+    }
+};
+
+// Adiciona a g_ClusterIndices as luzes de "lights" que alcançam a caixa "box".
+static void Clustered_AssignLights(const ClusterBox& box, const SliceLights& lights)
+{
+    size_t count = lights.index.size();
+
+#ifdef CLUSTERED_USE_SSE
+    // Distância ao quadrado entre o centro de cada esfera e a caixa:
+    // d = max(min - c, 0, c - max) em cada eixo.
+    const __m128 zero  = _mm_setzero_ps();
+    const __m128 min_x = _mm_set1_ps(box.min.x), max_x = _mm_set1_ps(box.max.x);
+    const __m128 min_y = _mm_set1_ps(box.min.y), max_y = _mm_set1_ps(box.max.y);
+    const __m128 min_z = _mm_set1_ps(box.min.z), max_z = _mm_set1_ps(box.max.z);
+
+    for (size_t i = 0; i < count; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&lights.x[i]);
+        __m128 cy = _mm_loadu_ps(&lights.y[i]);
+        __m128 cz = _mm_loadu_ps(&lights.z[i]);
+        __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_x, cx), _mm_sub_ps(cx, max_x)), zero);
+        __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_y, cy), _mm_sub_ps(cy, max_y)), zero);
+        __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_z, cz), _mm_sub_ps(cz, max_z)), zero);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_loadu_ps(&lights.radius2[i])));
+        for (int j = 0; mask != 0; ++j, mask >>= 1)
+            if (mask & 1)
+                g_ClusterIndices.push_back(lights.index[i + j]);
+    }
+#else
+    for (size_t i = 0; i < count; ++i)
+    {
+        float dx = std::max(std::max(box.min.x - lights.x[i], lights.x[i] - box.max.x), 0.0f);
+        float dy = std::max(std::max(box.min.y - lights.y[i], lights.y[i] - box.max.y), 0.0f);
+        float dz = std::max(std::max(box.min.z - lights.z[i], lights.z[i] - box.max.z), 0.0f);
+        if (dx*dx + dy*dy + dz*dz <= lights.radius2[i])
+            g_ClusterIndices.push_back(lights.index[i]);
+    }
+#endif
+}
+
+// Distribui as luzes "lights" entre os clusters da câmera definida por "view"
+// e "projection", envia os dados para a GPU, e atualiza ClusterParams.
+// Deve ser chamada antes de desenhar os objetos com CLUSTERED_LIGHTING.
+void Clustered_BeginFrame(const glm::mat4& view, const glm::mat4& projection, const std::vector<SceneLight>& lights, float sun_intensity)
+{
+    if (g_ClusterBoxes.empty() || projection != clustered_boxes_projection)
+        Clustered_BuildBoxes(projection);
+
+    // Posição de cada luz em coordenadas da câmera
+    static std::vector<glm::vec4> view_lights;
+    view_lights.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); ++i)
+    {
+        glm::vec4 p = view * glm::vec4(glm::vec3(lights[i].position_radius), 1.0f);
+        view_lights[i] = glm::vec4(glm::vec3(p), lights[i].position_radius.w);
+    }
+
+    float log_ratio = logf(clustered_far / clustered_near);
+
+    g_ClusterIndices.clear();
+    g_ClusteredMaxLightsPerCluster = 0;
+
+    static SliceLights slice_lights;
+    for (int z = 0; z < CLUSTER_GRID_Z; ++z)
+    {
+        // Primeiro selecionamos as luzes que alcançam a fatia inteira, para
+        // que cada cluster só teste estas.
+        float depth0 = clustered_near * expf(log_ratio * z / CLUSTER_GRID_Z);
+        float depth1 = clustered_near * expf(log_ratio * (z + 1) / CLUSTER_GRID_Z);
+
+        slice_lights.clear();
+        for (size_t i = 0; i < view_lights.size(); ++i)
+        {
+            const glm::vec4& l = view_lights[i];
+            float depth = -l.z;
+            if (depth + l.w >= depth0 && depth - l.w <= depth1)
+                slice_lights.push(l.x, l.y, l.z, l.w * l.w, (GLuint)i);
+        }
+        while (slice_lights.index.size() % 4 != 0)
+            slice_lights.push(0.0f, 0.0f, 0.0f, -1.0f, 0);
+
+        for (int y = 0; y < CLUSTER_GRID_Y; ++y)
+        for (int x = 0; x < CLUSTER_GRID_X; ++x)
+        {
+            int cluster = (z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x;
+            size_t first = g_ClusterIndices.size();
+            Clustered_AssignLights(g_ClusterBoxes[cluster], slice_lights);
+
+            int count = (int)(g_ClusterIndices.size() - first);
+            g_ClusterRanges[2*cluster + 0] = (GLuint)first;
+            g_ClusterRanges[2*cluster + 1] = (GLuint)count;
+            g_ClusteredMaxLightsPerCluster = std::max(g_ClusteredMaxLightsPerCluster, count);
+        }
+    }
+    g_ClusteredLightCount = (int)lights.size();
+
+    // Envio dos dados, com "orphaning" dos buffers do quadro anterior (veja
+    // GpuCulling_Cull()). Os buffers nunca ficam vazios.
+    glBindBuffer(GL_TEXTURE_BUFFER, clustered_ranges_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, g_ClusterRanges.size() * sizeof(GLuint), g_ClusterRanges.data(), GL_STREAM_DRAW);
+
+    if (!g_ClusterIndices.empty())
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, clustered_indices_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, g_ClusterIndices.size() * sizeof(GLuint), g_ClusterIndices.data(), GL_STREAM_DRAW);
+    }
+
+    if (!lights.empty())
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, clustered_lights_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, lights.size() * sizeof(SceneLight), lights.data(), GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    ClusterParams params;
+    params.grid[0]   = CLUSTER_GRID_X;
+    params.grid[1]   = CLUSTER_GRID_Y;
+    params.grid[2]   = CLUSTER_GRID_Z;
+    params.grid[3]   = 0;
+    params.depth[0]  = clustered_near;
+    params.depth[1]  = CLUSTER_GRID_Z / log_ratio;
+    params.depth[2]  = 0.0f;
+    params.depth[3]  = 0.0f;
+    params.screen[0] = (float)viewport[2];
+    params.screen[1] = (float)viewport[3];
+    params.screen[2] = sun_intensity;
+    params.screen[3] = 0.0f;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, clustered_params_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ClusterParams), &params, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
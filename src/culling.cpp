@@ -0,0 +1,175 @@
+// Funções de "view-frustum culling": descartamos no CPU os objetos cuja
+// axis-aligned bounding box (AABB) em coordenadas globais está completamente
+// fora do volume de visualização da câmera, antes de enviá-los para a GPU.
+// Veja slides 22-34 do documento "Aula_13_Clipping_and_Culling.pdf".
+#include <cmath>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Testamos as caixas em lotes de 4 utilizando instruções SSE, caso o
+// compilador as suporte. Caso contrário, utilizamos a versão escalar.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CULLING_USE_SSE
+#endif
+
+// Os seis planos do frustum (left, right, bottom, top, near, far), no formato
+// (a,b,c,d) tal que a*x + b*y + c*z + d >= 0 para pontos dentro do frustum.
+glm::vec4 g_FrustumPlanes[6];
+
+// Caixas enfileiradas no quadro atual, armazenadas como "structure of
+// arrays" (centro e meia-extensão em coordenadas globais) para que quatro
+// caixas consecutivas possam ser carregadas em um único registrador SSE.
+std::vector<float> g_CullCenterX, g_CullCenterY, g_CullCenterZ;
+std::vector<float> g_CullExtentX, g_CullExtentY, g_CullExtentZ;
+std::vector<unsigned char> g_CullVisible;
+
+// Extrai os planos do frustum a partir da matriz projection*view, pelo método
+// de Gribb e Hartmann: um ponto p está dentro do frustum se, e somente se,
+// -w <= x,y,z <= w em coordenadas de recorte (clip space), onde
+// (x,y,z,w) = M*p. Cada desigualdade corresponde a um plano formado pela
+// soma/subtração da quarta linha de M com uma das três primeiras.
+void Culling_BeginFrame(const glm::mat4& projection_view)
+{
+    const glm::mat4& M = projection_view;
+
+    // Lembre que M[coluna][linha] (matrizes "column-major" em GLM).
+    glm::vec4 row0(M[0][0], M[1][0], M[2][0], M[3][0]);
+    glm::vec4 row1(M[0][1], M[1][1], M[2][1], M[3][1]);
+    glm::vec4 row2(M[0][2], M[1][2], M[2][2], M[3][2]);
+    glm::vec4 row3(M[0][3], M[1][3], M[2][3], M[3][3]);
+
+    g_FrustumPlanes[0] = row3 + row0; // Left
+    g_FrustumPlanes[1] = row3 - row0; // Right
+    g_FrustumPlanes[2] = row3 + row1; // Bottom
+    g_FrustumPlanes[3] = row3 - row1; // Top
+    g_FrustumPlanes[4] = row3 + row2; // Near
+    g_FrustumPlanes[5] = row3 - row2; // Far
+
+    g_CullCenterX.clear(); g_CullCenterY.clear(); g_CullCenterZ.clear();
+    g_CullExtentX.clear(); g_CullExtentY.clear(); g_CullExtentZ.clear();
+    g_CullVisible.clear();
+}
+
+// Transforma uma AABB definida em coordenadas locais do modelo para uma AABB
+// em coordenadas globais, que envolve a caixa original transformada pela
+// matriz "model" (método de Arvo: a meia-extensão é transformada pelo valor
+// absoluto da parte linear da matriz).
+void Culling_TransformAABB(const glm::mat4& model, glm::vec3 bbox_min, glm::vec3 bbox_max, glm::vec3& world_min, glm::vec3& world_max)
+{
+    glm::vec3 c = (bbox_min + bbox_max) * 0.5f;
+    glm::vec3 e = (bbox_max - bbox_min) * 0.5f;
+
+    glm::vec3 center = glm::vec3(model * glm::vec4(c, 1.0f));
+    glm::vec3 extent;
+    for (int i = 0; i < 3; ++i)
+        extent[i] = std::fabs(model[0][i])*e.x + std::fabs(model[1][i])*e.y + std::fabs(model[2][i])*e.z;
+
+    world_min = center - extent;
+    world_max = center + extent;
+}
+
+// Testa uma única caixa em coordenadas globais contra o frustum atual.
+// Utilizada para o teste hierárquico, onde uma caixa que envolve um
+// personagem inteiro é testada antes de suas partes.
+bool Culling_TestBox(glm::vec3 world_min, glm::vec3 world_max)
+{
+    glm::vec3 c = (world_min + world_max) * 0.5f;
+    glm::vec3 e = (world_max - world_min) * 0.5f;
+
+    for (int i = 0; i < 6; ++i)
+    {
+        const glm::vec4& p = g_FrustumPlanes[i];
+        float distance = p.x*c.x + p.y*c.y + p.z*c.z + p.w;
+        float radius = std::fabs(p.x)*e.x + std::fabs(p.y)*e.y + std::fabs(p.z)*e.z;
+        if (distance + radius < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+// Enfileira uma caixa em coordenadas globais para ser testada em lote por
+// Culling_Run(). Retorna o índice a ser consultado em Culling_IsVisible().
+int Culling_AddBox(glm::vec3 world_min, glm::vec3 world_max)
+{
+    glm::vec3 c = (world_min + world_max) * 0.5f;
+    glm::vec3 e = (world_max - world_min) * 0.5f;
+
+    g_CullCenterX.push_back(c.x); g_CullCenterY.push_back(c.y); g_CullCenterZ.push_back(c.z);
+    g_CullExtentX.push_back(e.x); g_CullExtentY.push_back(e.y); g_CullExtentZ.push_back(e.z);
+
+    return (int)g_CullCenterX.size() - 1;
+}
+
+// Testa todas as caixas enfileiradas contra os seis planos do frustum.
+void Culling_Run()
+{
+    size_t count = g_CullCenterX.size();
+
+    // Completamos os vetores até um múltiplo de 4 com caixas vazias, para
+    // que o laço SSE abaixo não precise de tratamento especial para o final.
+    size_t padded = (count + 3) & ~(size_t)3;
+    g_CullCenterX.resize(padded, 0.0f); g_CullCenterY.resize(padded, 0.0f); g_CullCenterZ.resize(padded, 0.0f);
+    g_CullExtentX.resize(padded, 0.0f); g_CullExtentY.resize(padded, 0.0f); g_CullExtentZ.resize(padded, 0.0f);
+    g_CullVisible.resize(padded);
+
+#ifdef CULLING_USE_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+
+    for (size_t i = 0; i < padded; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&g_CullCenterX[i]);
+        __m128 cy = _mm_loadu_ps(&g_CullCenterY[i]);
+        __m128 cz = _mm_loadu_ps(&g_CullCenterZ[i]);
+        __m128 ex = _mm_loadu_ps(&g_CullExtentX[i]);
+        __m128 ey = _mm_loadu_ps(&g_CullExtentY[i]);
+        __m128 ez = _mm_loadu_ps(&g_CullExtentZ[i]);
+
+        // Máscara com todos os bits em 1 nas caixas que estão fora de
+        // algum dos planos.
+        __m128 outside = _mm_setzero_ps();
+
+        for (int p = 0; p < 6; ++p)
+        {
+            const glm::vec4& plane = g_FrustumPlanes[p];
+            __m128 a = _mm_set1_ps(plane.x);
+            __m128 b = _mm_set1_ps(plane.y);
+            __m128 c = _mm_set1_ps(plane.z);
+            __m128 d = _mm_set1_ps(plane.w);
+
+            // distance = a*cx + b*cy + c*cz + d
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)),
+                                         _mm_add_ps(_mm_mul_ps(c, cz), d));
+            // radius = |a|*ex + |b|*ey + |c|*ez
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign_mask, a), ex),
+                                                  _mm_mul_ps(_mm_andnot_ps(sign_mask, b), ey)),
+                                       _mm_mul_ps(_mm_andnot_ps(sign_mask, c), ez));
+
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        }
+
+        int mask = _mm_movemask_ps(outside);
+        g_CullVisible[i + 0] = !(mask & 1);
+        g_CullVisible[i + 1] = !(mask & 2);
+        g_CullVisible[i + 2] = !(mask & 4);
+        g_CullVisible[i + 3] = !(mask & 8);
+    }
+#else
+    for (size_t i = 0; i < padded; ++i)
+    {
+        glm::vec3 c(g_CullCenterX[i], g_CullCenterY[i], g_CullCenterZ[i]);
+        glm::vec3 e(g_CullExtentX[i], g_CullExtentY[i], g_CullExtentZ[i]);
+        g_CullVisible[i] = Culling_TestBox(c - e, c + e);
+    }
+#endif
+}
+
+// Resultado do teste de Culling_Run() para a caixa de índice "index".
+bool Culling_IsVisible(int index)
+{
+    return g_CullVisible[index] != 0;
+}
@@ -0,0 +1,405 @@
+// Caminho de renderização "deferred", para cenas com muitas luzes pontuais e
+// spots (tochas, fogueiras, feitiços). O quadro é desenhado em três passos:
+//
+//   1. Geometria: os objetos são desenhados com a variante GBUFFER de
+//      "shader_fragment.glsl", que escreve no G-buffer as propriedades da
+//      superfície visível em cada pixel (refletâncias, normal, expoente
+//      especular, object_id e profundidade), sem calcular iluminação.
+//   2. Luzes: cada luz é desenhada como um cubo que envolve o seu raio de
+//      alcance ("light volume"), e ilumina somente os pixels cobertos pelo
+//      cubo. As contribuições são somadas em um buffer de iluminação. Todas
+//      as luzes são desenhadas com uma única chamada (instancing).
+//   3. Composição: um triângulo de tela cheia ilumina cada pixel com o sol,
+//      soma o buffer de iluminação, e escreve a cor final no framebuffer.
+//
+// O custo do passo 2 depende da área da tela coberta pelas luzes, e não do
+// número de objetos; o dos passos 1 e 3 não depende do número de luzes.
+#include <cstdio>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "lights.h"
+
+// Funções definidas em main.cpp e shadows.cpp
+GLuint StartGpuProgram(const char* vertex_filename, const char* fragment_filename, const char* header);
+bool SwapGpuProgram(GLuint& pending_program_id, GLuint& program_id, bool wait);
+void DiscardGpuProgram(GLuint& pending_program_id);
+void Shadows_SetupProgram(GLuint program_id);
+
+// Unidades de textura do G-buffer. Começamos depois das unidades utilizadas
+// pelas imagens de LoadTextureImage(), que ficam associadas para sempre.
+#define DEFERRED_FIRST_TEXTURE_UNIT 10
+#define DEFERRED_ALBEDO_UNIT   (DEFERRED_FIRST_TEXTURE_UNIT + 0)
+#define DEFERRED_NORMAL_UNIT   (DEFERRED_FIRST_TEXTURE_UNIT + 1)
+#define DEFERRED_MATERIAL_UNIT (DEFERRED_FIRST_TEXTURE_UNIT + 2)
+#define DEFERRED_DEPTH_UNIT    (DEFERRED_FIRST_TEXTURE_UNIT + 3)
+#define DEFERRED_LIGHT_UNIT    (DEFERRED_FIRST_TEXTURE_UNIT + 4)
+
+// G-buffer e buffer de iluminação, com o tamanho do viewport atual
+GLuint deferred_gbuffer_framebuffer = 0;
+GLuint deferred_light_framebuffer = 0;
+GLuint deferred_albedo_texture = 0;   // RGBA8: Kd, (object_id + 1) / 255
+GLuint deferred_normal_texture = 0;   // RGBA16F: normal, expoente q
+GLuint deferred_material_texture = 0; // RGBA8: Ka, Ks
+GLuint deferred_depth_texture = 0;    // Z-buffer do passo de geometria
+GLuint deferred_light_texture = 0;    // RGBA16F: soma das luzes pontuais e spots
+GLuint deferred_light_depth_renderbuffer = 0; // Cópia do Z-buffer, para o teste de profundidade dos volumes
+int    deferred_width = 0;
+int    deferred_height = 0;
+bool   deferred_framebuffer_ok = false;
+
+// Estado salvo por Deferred_BeginGeometryPass() e restaurado no final do quadro
+GLint     deferred_previous_framebuffer = 0;
+GLint     deferred_previous_viewport[4];
+GLboolean deferred_previous_blend = GL_FALSE;
+
+GLuint deferred_light_program_id = 0;
+GLint  deferred_light_view_uniform;
+GLint  deferred_light_projection_uniform;
+GLint  deferred_light_inverse_uniform;
+GLint  deferred_light_camera_uniform;
+GLint  deferred_light_screen_uniform;
+
+GLuint deferred_composite_program_id = 0;
+GLint  deferred_composite_inverse_uniform;
+GLint  deferred_composite_camera_uniform;
+GLint  deferred_composite_sun_uniform;
+
+// Programas pedidos por Deferred_RequestShaders() ainda sendo linkados (0:
+// nenhum). Os programas acima continuam em uso até que estes fiquem prontos.
+GLuint deferred_pending_light_program_id = 0;
+GLuint deferred_pending_composite_program_id = 0;
+
+// Cubo [-1,1]^3 dos volumes de luz, e buffer com uma SceneLight por instância
+GLuint deferred_cube_vertex_array_object_id = 0;
+GLuint deferred_light_instances_buffer = 0;
+size_t deferred_light_capacity = 0;
+
+// VAO vazio para o triângulo de tela cheia (o perfil "core" exige um VAO)
+GLuint deferred_fullscreen_vertex_array_object_id = 0;
+
+// Número de luzes desenhadas no último quadro
+int g_DeferredLightCount = 0;
+
+// Verdadeiro se os programas de GPU deste caminho foram carregados com sucesso.
+bool Deferred_IsSupported()
+{
+    return deferred_light_program_id != 0 && deferred_composite_program_id != 0;
+}
+
+// Associa as variáveis do G-buffer de um programa às unidades de textura.
+static void Deferred_SetupTextureUnits(GLuint program_id)
+{
+    glUseProgram(program_id);
+    glUniform1i(glGetUniformLocation(program_id, "gbuffer_albedo"),   DEFERRED_ALBEDO_UNIT);
+    glUniform1i(glGetUniformLocation(program_id, "gbuffer_normal"),   DEFERRED_NORMAL_UNIT);
+    glUniform1i(glGetUniformLocation(program_id, "gbuffer_material"), DEFERRED_MATERIAL_UNIT);
+    glUniform1i(glGetUniformLocation(program_id, "gbuffer_depth"),    DEFERRED_DEPTH_UNIT);
+    glUniform1i(glGetUniformLocation(program_id, "light_buffer"),     DEFERRED_LIGHT_UNIT);
+    Shadows_SetupProgram(program_id);
+    glUseProgram(0);
+}
+
+// Pede a compilação dos shaders dos passos de luzes e de composição, que
+// são instalados por Deferred_PollShaders(). O passo de geometria utiliza as
+// permutações GBUFFER de "shader_fragment.glsl", carregadas por
+// LoadShadersFromFiles().
+void Deferred_RequestShaders()
+{
+    DiscardGpuProgram(deferred_pending_light_program_id);
+    deferred_pending_light_program_id = StartGpuProgram("../../src/shader_deferred_light_vertex.glsl", "../../src/shader_deferred_light_fragment.glsl", NULL);
+    DiscardGpuProgram(deferred_pending_composite_program_id);
+    deferred_pending_composite_program_id = StartGpuProgram("../../src/shader_fullscreen_vertex.glsl", "../../src/shader_deferred_composite_fragment.glsl", NULL);
+}
+
+// Instala os programas pedidos por Deferred_RequestShaders() que já foram
+// linkados com sucesso; se a linkagem falhou, o programa anterior continua
+// em uso. Retorna verdadeiro quando não há mais nenhum pendente.
+bool Deferred_PollShaders(bool wait)
+{
+    if (SwapGpuProgram(deferred_pending_light_program_id, deferred_light_program_id, wait))
+    {
+        deferred_light_view_uniform       = glGetUniformLocation(deferred_light_program_id, "view");
+        deferred_light_projection_uniform = glGetUniformLocation(deferred_light_program_id, "projection");
+        deferred_light_inverse_uniform    = glGetUniformLocation(deferred_light_program_id, "inverse_projection_view");
+        deferred_light_camera_uniform     = glGetUniformLocation(deferred_light_program_id, "camera_position");
+        deferred_light_screen_uniform     = glGetUniformLocation(deferred_light_program_id, "screen_size");
+        Deferred_SetupTextureUnits(deferred_light_program_id);
+    }
+
+    if (SwapGpuProgram(deferred_pending_composite_program_id, deferred_composite_program_id, wait))
+    {
+        deferred_composite_inverse_uniform = glGetUniformLocation(deferred_composite_program_id, "inverse_projection_view");
+        deferred_composite_camera_uniform  = glGetUniformLocation(deferred_composite_program_id, "camera_position");
+        deferred_composite_sun_uniform     = glGetUniformLocation(deferred_composite_program_id, "sun_intensity");
+        Deferred_SetupTextureUnits(deferred_composite_program_id);
+    }
+
+    return deferred_pending_light_program_id == 0 && deferred_pending_composite_program_id == 0;
+}
+
+// Cria os VAOs do cubo dos volumes de luz e do triângulo de tela cheia.
+void Deferred_Init()
+{
+    // Vértice i tem coordenadas (x,y,z) = bits (0,1,2) de i, com 0 -> -1.
+    GLfloat vertices[8*4];
+    for (int i = 0; i < 8; ++i)
+    {
+        vertices[4*i + 0] = (i & 1) ? 1.0f : -1.0f;
+        vertices[4*i + 1] = (i & 2) ? 1.0f : -1.0f;
+        vertices[4*i + 2] = (i & 4) ? 1.0f : -1.0f;
+        vertices[4*i + 3] = 1.0f;
+    }
+
+    // Triângulos em sentido anti-horário, vistos de fora do cubo
+    GLuint indices[36] = {
+        4, 5, 7,  4, 7, 6,   // +Z
+        0, 2, 3,  0, 3, 1,   // -Z
+        1, 3, 7,  1, 7, 5,   // +X
+        0, 4, 6,  0, 6, 2,   // -X
+        6, 7, 3,  6, 3, 2,   // +Y
+        0, 1, 5,  0, 5, 4    // -Y
+    };
+
+    glGenVertexArrays(1, &deferred_cube_vertex_array_object_id);
+    glBindVertexArray(deferred_cube_vertex_array_object_id);
+
+    GLuint vertex_buffer, index_buffer;
+    glGenBuffers(1, &vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+
+    glGenBuffers(1, &index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    // Atributos por instância: os três vec4 de SceneLight
+    glGenBuffers(1, &deferred_light_instances_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, deferred_light_instances_buffer);
+    for (int i = 0; i < 3; ++i)
+    {
+        GLuint location = 1 + i;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(SceneLight), (void*)(i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenVertexArrays(1, &deferred_fullscreen_vertex_array_object_id);
+}
+
+// Cria uma textura de width x height pixels para ser anexada a um framebuffer.
+static GLuint Deferred_CreateTexture(GLint internal_format, GLenum format, GLenum type, int width, int height)
+{
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture_id;
+}
+
+// (Re)cria o G-buffer e o buffer de iluminação com width x height pixels.
+static void Deferred_Resize(int width, int height)
+{
+    if (deferred_gbuffer_framebuffer != 0)
+    {
+        GLuint textures[5] = { deferred_albedo_texture, deferred_normal_texture, deferred_material_texture,
+                               deferred_depth_texture, deferred_light_texture };
+        glDeleteTextures(5, textures);
+        glDeleteRenderbuffers(1, &deferred_light_depth_renderbuffer);
+        glDeleteFramebuffers(1, &deferred_gbuffer_framebuffer);
+        glDeleteFramebuffers(1, &deferred_light_framebuffer);
+    }
+
+    deferred_width  = width;
+    deferred_height = height;
+
+    deferred_albedo_texture   = Deferred_CreateTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    deferred_normal_texture   = Deferred_CreateTexture(GL_RGBA16F, GL_RGBA, GL_FLOAT, width, height);
+    deferred_material_texture = Deferred_CreateTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    deferred_depth_texture    = Deferred_CreateTexture(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, width, height);
+    deferred_light_texture    = Deferred_CreateTexture(GL_RGBA16F, GL_RGBA, GL_FLOAT, width, height);
+
+    glGenRenderbuffers(1, &deferred_light_depth_renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, deferred_light_depth_renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &deferred_gbuffer_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, deferred_gbuffer_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, deferred_albedo_texture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, deferred_normal_texture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, deferred_material_texture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, deferred_depth_texture, 0);
+    GLenum draw_buffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, draw_buffers);
+    deferred_framebuffer_ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    glGenFramebuffers(1, &deferred_light_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, deferred_light_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, deferred_light_texture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, deferred_light_depth_renderbuffer);
+    deferred_framebuffer_ok = deferred_framebuffer_ok && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    if (!deferred_framebuffer_ok)
+        fprintf(stderr, "ERROR: Cannot create %dx%d G-buffer.\n", width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Início do passo de geometria: os objetos desenhados até
+// Deferred_DrawLighting() vão para o G-buffer, que tem o tamanho do viewport
+// atual. Retorna falso se o G-buffer não pôde ser criado; neste caso, o
+// quadro deve ser desenhado pelo caminho "forward".
+bool Deferred_BeginGeometryPass()
+{
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &deferred_previous_framebuffer);
+    glGetIntegerv(GL_VIEWPORT, deferred_previous_viewport);
+    deferred_previous_blend = glIsEnabled(GL_BLEND);
+
+    int width  = deferred_previous_viewport[2];
+    int height = deferred_previous_viewport[3];
+    if (width != deferred_width || height != deferred_height)
+        Deferred_Resize(width, height);
+
+    if (!deferred_framebuffer_ok)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, deferred_previous_framebuffer);
+        return false;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, deferred_gbuffer_framebuffer);
+    glViewport(0, 0, width, height);
+
+    // O G-buffer é limpo com zero, que indica "fundo" no object_id.
+    GLfloat clear_color[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+
+    // O G-buffer guarda somente a superfície mais próxima de cada pixel.
+    glDisable(GL_BLEND);
+
+    return true;
+}
+
+// Associa as texturas do G-buffer às suas unidades de textura.
+static void Deferred_BindTextures()
+{
+    GLint active_texture;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+
+    glActiveTexture(GL_TEXTURE0 + DEFERRED_ALBEDO_UNIT);
+    glBindTexture(GL_TEXTURE_2D, deferred_albedo_texture);
+    glActiveTexture(GL_TEXTURE0 + DEFERRED_NORMAL_UNIT);
+    glBindTexture(GL_TEXTURE_2D, deferred_normal_texture);
+    glActiveTexture(GL_TEXTURE0 + DEFERRED_MATERIAL_UNIT);
+    glBindTexture(GL_TEXTURE_2D, deferred_material_texture);
+    glActiveTexture(GL_TEXTURE0 + DEFERRED_DEPTH_UNIT);
+    glBindTexture(GL_TEXTURE_2D, deferred_depth_texture);
+    glActiveTexture(GL_TEXTURE0 + DEFERRED_LIGHT_UNIT);
+    glBindTexture(GL_TEXTURE_2D, deferred_light_texture);
+
+    glActiveTexture(active_texture);
+}
+
+// Passos de luzes e de composição: ilumina o G-buffer com o sol (de
+// intensidade "sun_intensity") e com as luzes "lights", e escreve o
+// resultado no framebuffer que estava ativo em Deferred_BeginGeometryPass().
+void Deferred_DrawLighting(const glm::mat4& view, const glm::mat4& projection, const std::vector<SceneLight>& lights, float sun_intensity)
+{
+    glm::mat4 inverse_projection_view = glm::inverse(projection * view);
+    glm::vec4 camera_position = glm::inverse(view)[3];
+
+    Deferred_BindTextures();
+
+    // O Z-buffer do G-buffer é copiado para o framebuffer de iluminação, onde
+    // é utilizado no teste de profundidade dos volumes de luz (não podemos
+    // anexar a mesma textura que os shaders estão lendo).
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, deferred_gbuffer_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, deferred_light_framebuffer);
+    glBlitFramebuffer(0, 0, deferred_width, deferred_height, 0, 0, deferred_width, deferred_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, deferred_light_framebuffer);
+
+    GLfloat clear_color[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+
+    g_DeferredLightCount = (int)lights.size();
+    if (!lights.empty())
+    {
+        // Enviamos as luzes do quadro, com "orphaning" do buffer anterior
+        // (veja GpuCulling_Cull()).
+        if (lights.size() > deferred_light_capacity)
+            deferred_light_capacity = lights.size() * 2;
+        glBindBuffer(GL_ARRAY_BUFFER, deferred_light_instances_buffer);
+        glBufferData(GL_ARRAY_BUFFER, deferred_light_capacity * sizeof(SceneLight), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, lights.size() * sizeof(SceneLight), lights.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glUseProgram(deferred_light_program_id);
+        glUniformMatrix4fv(deferred_light_view_uniform       , 1 , GL_FALSE , glm::value_ptr(view));
+        glUniformMatrix4fv(deferred_light_projection_uniform , 1 , GL_FALSE , glm::value_ptr(projection));
+        glUniformMatrix4fv(deferred_light_inverse_uniform    , 1 , GL_FALSE , glm::value_ptr(inverse_projection_view));
+        glUniform4f(deferred_light_camera_uniform, camera_position.x, camera_position.y, camera_position.z, 1.0f);
+        glUniform2f(deferred_light_screen_uniform, (float)deferred_width, (float)deferred_height);
+
+        // Desenhamos as faces de trás de cada cubo, e somente onde a
+        // superfície do G-buffer está na frente delas: pixels onde a
+        // superfície está atrás do cubo inteiro não são processados. Como
+        // não dependemos das faces da frente, a câmera pode estar dentro do
+        // volume.
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glDepthFunc(GL_GEQUAL);
+        glDepthMask(GL_FALSE);
+        glCullFace(GL_FRONT);
+
+        glBindVertexArray(deferred_cube_vertex_array_object_id);
+        glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, (GLsizei)lights.size());
+        glBindVertexArray(0);
+
+        glCullFace(GL_BACK);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        glDisable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    // Composição no framebuffer original. O shader escreve a profundidade
+    // do G-buffer em cada pixel, e por isso o teste de profundidade deve
+    // sempre passar.
+    glBindFramebuffer(GL_FRAMEBUFFER, deferred_previous_framebuffer);
+    glViewport(deferred_previous_viewport[0], deferred_previous_viewport[1], deferred_previous_viewport[2], deferred_previous_viewport[3]);
+
+    glUseProgram(deferred_composite_program_id);
+    glUniformMatrix4fv(deferred_composite_inverse_uniform, 1 , GL_FALSE , glm::value_ptr(inverse_projection_view));
+    glUniform4f(deferred_composite_camera_uniform, camera_position.x, camera_position.y, camera_position.z, 1.0f);
+    glUniform1f(deferred_composite_sun_uniform, sun_intensity);
+
+    glDepthFunc(GL_ALWAYS);
+    glBindVertexArray(deferred_fullscreen_vertex_array_object_id);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glDepthFunc(GL_LESS);
+
+    if (deferred_previous_blend)
+        glEnable(GL_BLEND);
+}
@@ -0,0 +1,210 @@
+// "Depth pre-pass" opcional dos objetos opacos: antes de desenhá-los com as
+// suas permutações de "shader_fragment.glsl", escrevemos somente a
+// profundidade de todos eles, com um programa que só transforma as posições
+// (a variante DEPTH_PREPASS de "shader_vertex.glsl"). Depois, a cor é
+// desenhada com glDepthFunc(GL_EQUAL), e cada pixel executa o fragment
+// shader de iluminação uma única vez, pela superfície visível.
+//
+// O pre-pass custa uma segunda transformação de todos os vértices, então só
+// compensa quando há muito "overdraw" (fragmentos iluminados e depois
+// escondidos por outros mais próximos). Medimos o overdraw com uma query
+// GL_SAMPLES_PASSED em torno do passo que faz o teste de profundidade com
+// GL_LESS (o próprio pre-pass, se ativo, ou o passo de cor), e, no modo
+// automático, ligamos o pre-pass quando o overdraw medido passa de
+// PREPASS_ENABLE_OVERDRAW. Veja DrawRenderQueue() em "main.cpp".
+#include <cstdio>
+
+#include <glad/glad.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Funções definidas em main.cpp
+GLuint StartGpuProgram(const char* vertex_filename, const char* fragment_filename, const char* header);
+bool SwapGpuProgram(GLuint& pending_program_id, GLuint& program_id, bool wait);
+void DiscardGpuProgram(GLuint& pending_program_id);
+
+// Modos do pre-pass, alternados com a tecla Z
+#define PREPASS_OFF  0
+#define PREPASS_ON   1
+#define PREPASS_AUTO 2
+#define NUM_PREPASS_MODES 3
+const char* depthprepass_mode_names[NUM_PREPASS_MODES] = { "off", "on", "auto" };
+
+// No modo automático, o pre-pass é ligado quando o overdraw medido passa do
+// primeiro limiar, e desligado quando fica abaixo do segundo. A diferença
+// evita que o pre-pass seja ligado e desligado a cada medida.
+#define PREPASS_ENABLE_OVERDRAW  1.6f
+#define PREPASS_DISABLE_OVERDRAW 1.3f
+
+// Peso de cada nova medida na média do overdraw
+#define OVERDRAW_SMOOTHING 0.25f
+
+int depthprepass_mode = PREPASS_AUTO;
+
+// Programas com a variante DEPTH_PREPASS de "shader_vertex.glsl": o do
+// pre-pass não escreve cor, e o da visualização do overdraw soma uma cor
+// constante por fragmento (veja "shader_overdraw_fragment.glsl").
+struct DepthPrepassProgram
+{
+    GLuint program_id;
+    GLint  model_uniform;
+    GLint  view_uniform;
+    GLint  projection_uniform;
+};
+DepthPrepassProgram depthprepass_programs[2];
+
+// Programas pedidos por DepthPrepass_RequestShaders() ainda sendo linkados
+// (0: nenhum). Os programas acima continuam em uso até que estes fiquem
+// prontos.
+GLuint depthprepass_pending_program_ids[2];
+
+// Query do overdraw. Uma nova medida só é iniciada depois que o resultado da
+// anterior foi lido, e o resultado só é lido quando já está disponível, para
+// que o CPU nunca espere a GPU.
+GLuint depthprepass_query = 0;
+bool   depthprepass_query_pending = false;
+bool   depthprepass_measuring = false;
+float  depthprepass_query_pixels = 0.0f; // Número de amostras da tela na medida pendente
+
+// Overdraw medido (fragmentos que passaram no teste de profundidade por
+// amostra da tela), e se o pre-pass foi utilizado no último quadro.
+float g_MeasuredOverdraw = 0.0f;
+bool  g_DepthPrepassActive = false;
+
+// Cria a query do overdraw. Chamada uma vez, após a criação do contexto.
+void DepthPrepass_Init()
+{
+    glGenQueries(1, &depthprepass_query);
+}
+
+// Pede a compilação dos programas do pre-pass e da visualização do
+// overdraw, que são instalados por DepthPrepass_PollShaders(). Chamada junto
+// com os demais shaders, para que o pre-pass utilize sempre a mesma versão de
+// "shader_vertex.glsl" que o passo de cor.
+void DepthPrepass_RequestShaders()
+{
+    const char* fragment_filenames[2] = { "../../src/shader_shadow_fragment.glsl", "../../src/shader_overdraw_fragment.glsl" };
+
+    for (int i = 0; i < 2; ++i)
+    {
+        DiscardGpuProgram(depthprepass_pending_program_ids[i]);
+        depthprepass_pending_program_ids[i] = StartGpuProgram("../../src/shader_vertex.glsl", fragment_filenames[i], "#version 330 core\n#define DEPTH_PREPASS\n");
+    }
+}
+
+// Instala os programas pedidos por DepthPrepass_RequestShaders() que já
+// foram linkados com sucesso; se a linkagem falhou, o programa anterior
+// continua em uso (ou o pre-pass fica desativado, se não havia um). Retorna
+// verdadeiro quando não há mais nenhum pendente.
+bool DepthPrepass_PollShaders(bool wait)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        DepthPrepassProgram& program = depthprepass_programs[i];
+        if (depthprepass_pending_program_ids[i] == 0)
+            continue;
+
+        if (SwapGpuProgram(depthprepass_pending_program_ids[i], program.program_id, wait))
+        {
+            program.model_uniform      = glGetUniformLocation(program.program_id, "model");
+            program.view_uniform       = glGetUniformLocation(program.program_id, "view");
+            program.projection_uniform = glGetUniformLocation(program.program_id, "projection");
+        }
+        else if (depthprepass_pending_program_ids[i] == 0 && program.program_id == 0)
+        {
+            fprintf(stderr, "ERROR: depth pre-pass desativado, erro nos shaders.\n");
+        }
+    }
+
+    return depthprepass_pending_program_ids[0] == 0 && depthprepass_pending_program_ids[1] == 0;
+}
+
+// Alterna entre os modos desligado, ligado e automático
+void DepthPrepass_CycleMode()
+{
+    depthprepass_mode = (depthprepass_mode + 1) % NUM_PREPASS_MODES;
+}
+
+const char* DepthPrepass_ModeName()
+{
+    return depthprepass_mode_names[depthprepass_mode];
+}
+
+// Lê o resultado da última medida do overdraw, se já disponível, e decide
+// se o pre-pass será utilizado no quadro atual.
+bool DepthPrepass_BeginFrame()
+{
+    if (depthprepass_query_pending)
+    {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(depthprepass_query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint samples_passed = 0;
+            glGetQueryObjectuiv(depthprepass_query, GL_QUERY_RESULT, &samples_passed);
+            depthprepass_query_pending = false;
+
+            float overdraw = (float)samples_passed / depthprepass_query_pixels;
+            if (g_MeasuredOverdraw == 0.0f)
+                g_MeasuredOverdraw = overdraw;
+            else
+                g_MeasuredOverdraw += OVERDRAW_SMOOTHING * (overdraw - g_MeasuredOverdraw);
+        }
+    }
+
+    bool available = depthprepass_programs[0].program_id != 0;
+
+    if (depthprepass_mode == PREPASS_OFF || !available)
+        g_DepthPrepassActive = false;
+    else if (depthprepass_mode == PREPASS_ON)
+        g_DepthPrepassActive = true;
+    else if (g_MeasuredOverdraw > PREPASS_ENABLE_OVERDRAW)
+        g_DepthPrepassActive = true;
+    else if (g_MeasuredOverdraw < PREPASS_DISABLE_OVERDRAW)
+        g_DepthPrepassActive = false;
+
+    return g_DepthPrepassActive;
+}
+
+// Início e fim do passo medido. O overdraw é normalizado pelo número de
+// amostras do framebuffer ligado (a janela tem multisampling, o G-buffer do
+// caminho "deferred" não).
+void DepthPrepass_BeginMeasure()
+{
+    if (depthprepass_query_pending)
+        return;
+
+    GLint viewport[4];
+    GLint samples = 0;
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_SAMPLES, &samples);
+    depthprepass_query_pixels = (float)viewport[2] * (float)viewport[3] * (float)(samples > 0 ? samples : 1);
+    if (depthprepass_query_pixels <= 0.0f)
+        return;
+
+    glBeginQuery(GL_SAMPLES_PASSED, depthprepass_query);
+    depthprepass_measuring = true;
+}
+
+void DepthPrepass_EndMeasure()
+{
+    if (!depthprepass_measuring)
+        return;
+
+    glEndQuery(GL_SAMPLES_PASSED);
+    depthprepass_measuring = false;
+    depthprepass_query_pending = true;
+}
+
+// Liga o programa do pre-pass (ou, com "overdraw", o da visualização do
+// overdraw) com as matrizes da câmera. Retorna a localização do uniform
+// "model", a ser definido para cada objeto.
+GLint DepthPrepass_UseProgram(const glm::mat4& view, const glm::mat4& projection, bool overdraw)
+{
+    const DepthPrepassProgram& program = depthprepass_programs[overdraw ? 1 : 0];
+    glUseProgram(program.program_id);
+    glUniformMatrix4fv(program.view_uniform       , 1 , GL_FALSE , glm::value_ptr(view));
+    glUniformMatrix4fv(program.projection_uniform , 1 , GL_FALSE , glm::value_ptr(projection));
+    return program.model_uniform;
+}
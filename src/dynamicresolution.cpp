@@ -0,0 +1,288 @@
+// Resolução dinâmica: a cena 3D é desenhada em um framebuffer fora da tela,
+// com uma fração ("escala") da resolução da janela, e depois ampliada para a
+// janela por um passo de tela cheia com "sharpening" (veja
+// "shader_upscale_fragment.glsl"). O texto do HUD é desenhado depois, direto
+// na janela, com a resolução nativa.
+//
+// A escala é ajustada a cada quadro a partir do tempo de GPU medido com
+// queries GL_TIME_ELAPSED, para que o quadro caiba em
+// g_DynamicResolutionTargetMs. As queries são lidas somente quando o
+// resultado já está disponível (alguns quadros depois), para que o CPU
+// nunca espere a GPU.
+//
+// O framebuffer fora da tela tem sempre o tamanho da janela, e a cena é
+// desenhada no seu canto inferior esquerdo, com glViewport(): mudar a escala
+// não realoca nada aqui. Os demais passos ("deferred.cpp", "clustered.cpp",
+// "shadows.cpp") utilizam o viewport e o framebuffer ativos.
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+// Funções definidas em main.cpp
+GLuint LoadGpuProgram(const char* vertex_filename, const char* fragment_filename, const char* header);
+
+// Unidade de textura da imagem ampliada. Veja "shadows.cpp" para as
+// unidades anteriores.
+#define DYNRES_SOURCE_UNIT 19
+
+// Limites da escala, e passo em que é arredondada. Mudamos a escala em
+// passos discretos para que o G-buffer do caminho "deferred", que tem o
+// tamanho do viewport, não seja realocado a cada quadro.
+#define DYNRES_MIN_SCALE  0.5f
+#define DYNRES_MAX_SCALE  1.0f
+#define DYNRES_SCALE_STEP (1.0f/16.0f)
+
+// A escala só diminui quando o quadro passa do orçamento, e só aumenta
+// quando o quadro usa menos que esta fração dele.
+#define DYNRES_HEADROOM 0.85f
+
+// Número de queries em uso ao mesmo tempo. Depois de uma mudança de escala,
+// ignoramos as medidas dos quadros que ainda foram desenhados com a antiga.
+#define DYNRES_QUERIES 4
+
+// Intensidade do sharpening quando a imagem é ampliada pelo fator máximo
+// (1/DYNRES_MIN_SCALE). Sem ampliação, nenhum sharpening é aplicado.
+#define DYNRES_SHARPNESS 0.6f
+
+bool  g_DynamicResolutionEnabled = true;
+float g_DynamicResolutionTargetMs = 16.0f; // Orçamento de GPU por quadro (60 fps, com folga para o HUD)
+float g_ResolutionScale = 1.0f;            // Fração da resolução da janela utilizada pela cena
+float g_GpuFrameTimeMs = 0.0f;             // Último tempo de GPU medido, em milissegundos
+int   g_SceneWidth = 0;                    // Resolução em que a cena foi desenhada no último quadro
+int   g_SceneHeight = 0;
+
+// Framebuffer da cena (com o mesmo multisampling da janela) e textura onde
+// o multisampling é resolvido, lida pelo passo de ampliação.
+GLuint dynres_scene_framebuffer = 0;
+GLuint dynres_color_renderbuffer = 0;
+GLuint dynres_depth_renderbuffer = 0;
+GLuint dynres_resolve_framebuffer = 0;
+GLuint dynres_resolve_texture = 0;
+GLint  dynres_samples = 0;
+int    dynres_width = 0;  // Tamanho dos buffers acima (o da janela)
+int    dynres_height = 0;
+bool   dynres_framebuffer_ok = false;
+bool   dynres_active = false; // Verdadeiro se o quadro atual está sendo desenhado fora da tela
+
+GLuint dynres_program_id = 0;
+GLint  dynres_source_scale_uniform;
+GLint  dynres_source_max_uniform;
+GLint  dynres_texel_size_uniform;
+GLint  dynres_sharpness_uniform;
+GLuint dynres_vertex_array_object_id = 0;
+
+GLuint dynres_queries[DYNRES_QUERIES];
+int    dynres_query_first = 0; // Query mais antiga ainda não lida
+int    dynres_query_count = 0; // Número de queries iniciadas e ainda não lidas
+bool   dynres_query_running = false;
+int    dynres_frames_to_ignore = 0;
+
+// Cria as queries e o programa do passo de ampliação. Chamada uma vez, após
+// a criação do contexto, com o framebuffer da janela ativo.
+void DynamicResolution_Init()
+{
+    glGenQueries(DYNRES_QUERIES, dynres_queries);
+    glGenVertexArrays(1, &dynres_vertex_array_object_id);
+
+    // Mesmo número de amostras do framebuffer da janela (GLFW_SAMPLES)
+    glGetIntegerv(GL_SAMPLES, &dynres_samples);
+
+    dynres_program_id = LoadGpuProgram("../../src/shader_fullscreen_vertex.glsl", "../../src/shader_upscale_fragment.glsl", NULL);
+
+    GLint linked_ok = GL_FALSE;
+    glGetProgramiv(dynres_program_id, GL_LINK_STATUS, &linked_ok);
+    if ( linked_ok == GL_FALSE )
+    {
+        fprintf(stderr, "ERROR: resolucao dinamica desativada, erro nos shaders.\n");
+        glDeleteProgram(dynres_program_id);
+        dynres_program_id = 0;
+        g_DynamicResolutionEnabled = false;
+        return;
+    }
+
+    dynres_source_scale_uniform = glGetUniformLocation(dynres_program_id, "source_scale");
+    dynres_source_max_uniform   = glGetUniformLocation(dynres_program_id, "source_max");
+    dynres_texel_size_uniform   = glGetUniformLocation(dynres_program_id, "texel_size");
+    dynres_sharpness_uniform    = glGetUniformLocation(dynres_program_id, "sharpness");
+
+    glUseProgram(dynres_program_id);
+    glUniform1i(glGetUniformLocation(dynres_program_id, "source"), DYNRES_SOURCE_UNIT);
+    glUseProgram(0);
+}
+
+// (Re)cria os buffers com width x height pixels.
+static void DynamicResolution_Resize(int width, int height)
+{
+    if (dynres_scene_framebuffer == 0)
+    {
+        glGenFramebuffers(1, &dynres_scene_framebuffer);
+        glGenFramebuffers(1, &dynres_resolve_framebuffer);
+        glGenRenderbuffers(1, &dynres_color_renderbuffer);
+        glGenRenderbuffers(1, &dynres_depth_renderbuffer);
+        glGenTextures(1, &dynres_resolve_texture);
+    }
+
+    dynres_width = width;
+    dynres_height = height;
+
+    glBindRenderbuffer(GL_RENDERBUFFER, dynres_color_renderbuffer);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, dynres_samples, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, dynres_depth_renderbuffer);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, dynres_samples, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glActiveTexture(GL_TEXTURE0 + DYNRES_SOURCE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, dynres_resolve_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, dynres_scene_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, dynres_color_renderbuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, dynres_depth_renderbuffer);
+    dynres_framebuffer_ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, dynres_resolve_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dynres_resolve_texture, 0);
+    dynres_framebuffer_ok = dynres_framebuffer_ok && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (!dynres_framebuffer_ok)
+        fprintf(stderr, "ERROR: Cannot create %dx%d dynamic resolution framebuffer.\n", width, height);
+}
+
+// Lê as queries já disponíveis e ajusta a escala. O tempo de GPU é
+// aproximadamente proporcional ao número de pixels, isto é, ao quadrado da
+// escala.
+static void DynamicResolution_UpdateScale()
+{
+    while (dynres_query_count > 0)
+    {
+        GLuint query = dynres_queries[dynres_query_first];
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 elapsed_ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed_ns);
+        dynres_query_first = (dynres_query_first + 1) % DYNRES_QUERIES;
+        dynres_query_count -= 1;
+
+        g_GpuFrameTimeMs = (float)(elapsed_ns / 1.0e6);
+
+        if (dynres_frames_to_ignore > 0)
+        {
+            dynres_frames_to_ignore -= 1;
+            continue;
+        }
+
+        if (!g_DynamicResolutionEnabled || g_GpuFrameTimeMs <= 0.0f)
+            continue;
+
+        float target = g_DynamicResolutionTargetMs;
+        if (g_GpuFrameTimeMs <= target && g_GpuFrameTimeMs >= DYNRES_HEADROOM * target)
+            continue;
+
+        // Escala que faria o quadro medido caber no orçamento (com folga, ao
+        // aumentar), arredondada para o passo mais próximo na direção da mudança.
+        float desired = g_ResolutionScale * sqrtf((g_GpuFrameTimeMs > target ? target : DYNRES_HEADROOM * target) / g_GpuFrameTimeMs);
+        float steps = desired / DYNRES_SCALE_STEP;
+        desired = DYNRES_SCALE_STEP * (desired < g_ResolutionScale ? floorf(steps) : floorf(steps + 0.5f));
+        desired = std::min(std::max(desired, DYNRES_MIN_SCALE), DYNRES_MAX_SCALE);
+
+        if (desired != g_ResolutionScale)
+        {
+            g_ResolutionScale = desired;
+            dynres_frames_to_ignore = dynres_query_count;
+        }
+    }
+}
+
+// Início do quadro: mede o tempo de GPU e, com a resolução dinâmica ativa,
+// liga o framebuffer da cena com o viewport da escala atual. Deve ser
+// chamada antes de limpar o framebuffer. "width" e "height" são o tamanho
+// do framebuffer da janela.
+void DynamicResolution_BeginFrame(int width, int height)
+{
+    DynamicResolution_UpdateScale();
+
+    if (!g_DynamicResolutionEnabled)
+        g_ResolutionScale = 1.0f;
+
+    dynres_active = g_DynamicResolutionEnabled && width > 0 && height > 0;
+    if (dynres_active && (width != dynres_width || height != dynres_height))
+        DynamicResolution_Resize(width, height);
+    dynres_active = dynres_active && dynres_framebuffer_ok;
+
+    if (dynres_active)
+    {
+        g_SceneWidth  = std::max(1, (int)(width  * g_ResolutionScale + 0.5f));
+        g_SceneHeight = std::max(1, (int)(height * g_ResolutionScale + 0.5f));
+        glBindFramebuffer(GL_FRAMEBUFFER, dynres_scene_framebuffer);
+        glViewport(0, 0, g_SceneWidth, g_SceneHeight);
+    }
+    else
+    {
+        g_SceneWidth  = width;
+        g_SceneHeight = height;
+    }
+
+    if (dynres_query_count < DYNRES_QUERIES)
+    {
+        int index = (dynres_query_first + dynres_query_count) % DYNRES_QUERIES;
+        glBeginQuery(GL_TIME_ELAPSED, dynres_queries[index]);
+        dynres_query_count += 1;
+        dynres_query_running = true;
+    }
+}
+
+// Fim da cena: amplia a imagem para a janela, e restaura o framebuffer e o
+// viewport da janela, onde o HUD será desenhado.
+void DynamicResolution_EndFrame(int width, int height)
+{
+    if (dynres_active)
+    {
+        // Resolvemos o multisampling (a cópia deve ter o mesmo tamanho)
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, dynres_scene_framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dynres_resolve_framebuffer);
+        glBlitFramebuffer(0, 0, g_SceneWidth, g_SceneHeight, 0, 0, g_SceneWidth, g_SceneHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+
+        // Ampliação: a imagem cobre a janela inteira, e o teste de
+        // profundidade não é necessário.
+        float scale_x = (float)g_SceneWidth / dynres_width;
+        float scale_y = (float)g_SceneHeight / dynres_height;
+        float sharpness = DYNRES_SHARPNESS * (1.0f - g_ResolutionScale) / (1.0f - DYNRES_MIN_SCALE);
+
+        glActiveTexture(GL_TEXTURE0 + DYNRES_SOURCE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, dynres_resolve_texture);
+        glActiveTexture(GL_TEXTURE0);
+
+        glUseProgram(dynres_program_id);
+        glUniform2f(dynres_source_scale_uniform, scale_x, scale_y);
+        glUniform2f(dynres_source_max_uniform, scale_x - 0.5f / dynres_width, scale_y - 0.5f / dynres_height);
+        glUniform2f(dynres_texel_size_uniform, 1.0f / dynres_width, 1.0f / dynres_height);
+        glUniform1f(dynres_sharpness_uniform, sharpness);
+
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(dynres_vertex_array_object_id);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    if (dynres_query_running)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        dynres_query_running = false;
+    }
+}
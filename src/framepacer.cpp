@@ -0,0 +1,220 @@
+// Ritmo dos quadros ("frame pacing") do laço principal em main(): controle
+// do vsync, limitador de quadros por segundo, e modo ocioso.
+//
+// O limitador espera até o instante em que o próximo quadro deve começar.
+// A maior parte da espera é feita com glfwWaitEventsTimeout(), que libera o
+// CPU (e retorna antes se o usuário interagir); como o sistema operacional
+// pode acordar o programa com atraso, os últimos milissegundos são esperados
+// em um laço ("spin") com glfwGetTime(). A margem do spin acompanha o maior
+// atraso observado nas esperas.
+//
+// No modo ocioso, quando nada se move na cena (veja SceneIsStatic() em
+// "main.cpp") e o usuário não interage há FRAMEPACER_IDLE_DELAY segundos, o
+// quadro é redesenhado somente FRAMEPACER_IDLE_FPS vezes por segundo. Como a
+// espera retorna a cada evento de entrada, o jogo responde imediatamente.
+//
+// A variação dos intervalos entre quadros ("jitter") é medida a cada segundo
+// e mostrada no HUD.
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+#include <GLFW/glfw3.h>
+
+// Modos de vsync, alternados com a tecla T. O adaptativo (intervalo -1)
+// sincroniza quando o quadro fica pronto a tempo, e troca imediatamente
+// quando atrasa; só existe com as extensões "swap_control_tear".
+#define VSYNC_OFF      0
+#define VSYNC_ON       1
+#define VSYNC_ADAPTIVE 2
+#define NUM_VSYNC_MODES 3
+const char* framepacer_vsync_names[NUM_VSYNC_MODES] = { "off", "on", "adaptativo" };
+
+// Limites do limitador, alternados com a tecla Y (0 = sem limite). Também
+// pode ser definido com o argumento "--fps N".
+#define NUM_FRAME_LIMITS 5
+const float framepacer_limits[NUM_FRAME_LIMITS] = { 0.0f, 30.0f, 60.0f, 120.0f, 144.0f };
+
+// Modo ocioso
+#define FRAMEPACER_IDLE_FPS   10.0f
+#define FRAMEPACER_IDLE_DELAY 0.5
+
+// Limites da margem do spin, em segundos
+#define FRAMEPACER_MIN_SPIN 0.0005
+#define FRAMEPACER_MAX_SPIN 0.004
+
+int   g_VsyncMode = VSYNC_ON;
+float g_FrameLimitFps = 0.0f;
+bool  g_AdaptiveFrameRate = true; // Modo ocioso permitido (tecla I)
+bool  g_FramePacerIdle = false;   // Verdadeiro se o último quadro foi limitado pelo modo ocioso
+
+// Estatísticas do último segundo: intervalo médio entre quadros, desvio
+// padrão ("jitter") e maior intervalo, em milissegundos.
+float g_FrameIntervalMs = 0.0f;
+float g_FrameJitterMs = 0.0f;
+float g_FrameIntervalMaxMs = 0.0f;
+
+GLFWwindow* framepacer_window = NULL;
+double framepacer_next_deadline = 0.0;  // Instante em que o próximo quadro deve começar
+double framepacer_last_activity = 0.0;  // Último evento de entrada (ou movimento na cena)
+double framepacer_spin_margin = 0.002;  // Parte final da espera feita em spin
+double framepacer_last_frame = 0.0;     // Fim do quadro anterior, para os intervalos
+
+// Somas dos intervalos da janela de estatísticas atual
+double framepacer_stats_start = 0.0;
+int    framepacer_stats_count = 0;
+double framepacer_stats_sum = 0.0;
+double framepacer_stats_sum_squares = 0.0;
+double framepacer_stats_max = 0.0;
+
+// Aplica o modo de vsync atual à janela. O modo adaptativo volta para o
+// vsync comum se não for suportado.
+static void FramePacer_ApplySwapInterval()
+{
+    if (g_VsyncMode == VSYNC_ADAPTIVE &&
+        !glfwExtensionSupported("WGL_EXT_swap_control_tear") &&
+        !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+    {
+        fprintf(stderr, "Vsync adaptativo nao suportado.\n");
+        g_VsyncMode = VSYNC_ON;
+    }
+
+    if (g_VsyncMode == VSYNC_ADAPTIVE)
+        glfwSwapInterval(-1);
+    else
+        glfwSwapInterval(g_VsyncMode == VSYNC_ON ? 1 : 0);
+}
+
+// Chamada uma vez, com o contexto OpenGL da janela já ativo
+void FramePacer_Init(GLFWwindow* window)
+{
+    framepacer_window = window;
+    FramePacer_ApplySwapInterval();
+
+    double now = glfwGetTime();
+    framepacer_next_deadline = now;
+    framepacer_last_activity = now;
+    framepacer_last_frame = now;
+    framepacer_stats_start = now;
+}
+
+void FramePacer_CycleVsync()
+{
+    g_VsyncMode = (g_VsyncMode + 1) % NUM_VSYNC_MODES;
+    FramePacer_ApplySwapInterval();
+}
+
+const char* FramePacer_VsyncName()
+{
+    return framepacer_vsync_names[g_VsyncMode];
+}
+
+void FramePacer_CycleLimit()
+{
+    int i = 0;
+    while (i < NUM_FRAME_LIMITS && framepacer_limits[i] != g_FrameLimitFps)
+        ++i;
+    g_FrameLimitFps = framepacer_limits[(i + 1) % NUM_FRAME_LIMITS];
+}
+
+// Chamada pelos callbacks de entrada: sai do modo ocioso
+void FramePacer_NotifyActivity()
+{
+    framepacer_last_activity = glfwGetTime();
+}
+
+// Acumula o intervalo do quadro que terminou em "now", e fecha a janela de
+// estatísticas a cada segundo.
+static void FramePacer_RecordInterval(double now)
+{
+    double interval = now - framepacer_last_frame;
+    framepacer_last_frame = now;
+
+    framepacer_stats_count += 1;
+    framepacer_stats_sum += interval;
+    framepacer_stats_sum_squares += interval * interval;
+    framepacer_stats_max = std::max(framepacer_stats_max, interval);
+
+    if (now - framepacer_stats_start >= 1.0)
+    {
+        double mean = framepacer_stats_sum / framepacer_stats_count;
+        double variance = std::max(0.0, framepacer_stats_sum_squares / framepacer_stats_count - mean * mean);
+        g_FrameIntervalMs    = (float)(1000.0 * mean);
+        g_FrameJitterMs      = (float)(1000.0 * sqrt(variance));
+        g_FrameIntervalMaxMs = (float)(1000.0 * framepacer_stats_max);
+
+        framepacer_stats_start = now;
+        framepacer_stats_count = 0;
+        framepacer_stats_sum = 0.0;
+        framepacer_stats_sum_squares = 0.0;
+        framepacer_stats_max = 0.0;
+    }
+}
+
+// Chamada no lugar de glfwPollEvents(), depois de glfwSwapBuffers(): espera
+// o início do próximo quadro, de acordo com o limitador e com o modo ocioso,
+// e processa os eventos de entrada. "scene_static" indica que nada se moveu
+// na cena neste quadro.
+void FramePacer_EndFrame(bool scene_static)
+{
+    double now = glfwGetTime();
+
+    if (!scene_static)
+        framepacer_last_activity = now;
+
+    g_FramePacerIdle = g_AdaptiveFrameRate && now - framepacer_last_activity >= FRAMEPACER_IDLE_DELAY;
+
+    float fps = g_FramePacerIdle ? FRAMEPACER_IDLE_FPS : g_FrameLimitFps;
+    if (g_FrameLimitFps > 0.0f && g_FramePacerIdle)
+        fps = std::min(fps, g_FrameLimitFps);
+
+    if (fps <= 0.0f)
+    {
+        framepacer_next_deadline = now;
+        glfwPollEvents();
+        FramePacer_RecordInterval(glfwGetTime());
+        return;
+    }
+
+    // O próximo prazo conta a partir do anterior, e não do fim deste
+    // quadro, para que os atrasos não se acumulem. Se estivermos mais de um
+    // quadro atrasados, recomeçamos a partir de agora.
+    double period = 1.0 / fps;
+    framepacer_next_deadline += period;
+    if (framepacer_next_deadline < now - period)
+        framepacer_next_deadline = now;
+
+    // Espera que libera o CPU. No modo ocioso, qualquer evento de entrada
+    // interrompe a espera.
+    double activity_before = framepacer_last_activity;
+    for (;;)
+    {
+        double remaining = framepacer_next_deadline - glfwGetTime();
+        if (remaining <= framepacer_spin_margin)
+            break;
+
+        double wait = remaining - framepacer_spin_margin;
+        double wait_start = glfwGetTime();
+        glfwWaitEventsTimeout(wait);
+        double overshoot = (glfwGetTime() - wait_start) - wait;
+
+        // Ajuste da margem: cresce logo com atrasos, e diminui devagar
+        if (overshoot > framepacer_spin_margin)
+            framepacer_spin_margin = std::min(overshoot, (double)FRAMEPACER_MAX_SPIN);
+        else
+            framepacer_spin_margin = std::max(0.99 * framepacer_spin_margin, (double)FRAMEPACER_MIN_SPIN);
+
+        if (g_FramePacerIdle && framepacer_last_activity != activity_before)
+        {
+            framepacer_next_deadline = glfwGetTime();
+            break;
+        }
+    }
+
+    // Espera final, precisa
+    while (glfwGetTime() < framepacer_next_deadline)
+        ;
+
+    glfwPollEvents();
+    FramePacer_RecordInterval(glfwGetTime());
+}
@@ -0,0 +1,76 @@
+// Carregamento das funções de OpenGL posteriores à versão 3.3. Veja
+// "glextensions.h".
+#include <cstring>
+
+#include "glextensions.h"
+
+PFNGLGETPROGRAMBINARYPROC glad_glGetProgramBinary = NULL;
+PFNGLPROGRAMBINARYPROC glad_glProgramBinary = NULL;
+PFNGLPROGRAMPARAMETERIPROC glad_glProgramParameteri = NULL;
+
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR = NULL;
+
+PFNGLDISPATCHCOMPUTEPROC glad_glDispatchCompute = NULL;
+PFNGLMEMORYBARRIERPROC glad_glMemoryBarrier = NULL;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glad_glMultiDrawElementsIndirect = NULL;
+
+int GLEXT_ARB_get_program_binary = 0;
+int GLEXT_KHR_parallel_shader_compile = 0;
+int GLEXT_VERSION_4_3 = 0;
+
+// Verifica se o contexto atual suporta a extensão "name".
+static bool GLExtensions_Has(const char* name)
+{
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint i = 0; i < num_extensions; ++i)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension != NULL && strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+void GLExtensions_Load(GLEXTloadproc load)
+{
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    int version = 10*major + minor;
+
+    if (version >= 41 || GLExtensions_Has("GL_ARB_get_program_binary"))
+    {
+        glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+
+        GLEXT_ARB_get_program_binary = glad_glGetProgramBinary != NULL
+                                    && glad_glProgramBinary != NULL
+                                    && glad_glProgramParameteri != NULL;
+    }
+
+    // As duas extensões são equivalentes, com o mesmo valor para as constantes.
+    if (GLExtensions_Has("GL_KHR_parallel_shader_compile"))
+        glad_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+    else if (GLExtensions_Has("GL_ARB_parallel_shader_compile"))
+        glad_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+
+    GLEXT_KHR_parallel_shader_compile = glad_glMaxShaderCompilerThreadsKHR != NULL;
+
+    // Deixamos o driver escolher o número de threads de compilação.
+    if (GLEXT_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+
+    if (version >= 43)
+    {
+        glad_glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)load("glDispatchCompute");
+        glad_glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)load("glMemoryBarrier");
+        glad_glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+
+        GLEXT_VERSION_4_3 = glad_glDispatchCompute != NULL
+                         && glad_glMemoryBarrier != NULL
+                         && glad_glMultiDrawElementsIndirect != NULL;
+    }
+}
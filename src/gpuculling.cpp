@@ -0,0 +1,306 @@
+// Caminho de renderização "GPU-driven" (OpenGL 4.3 ou superior): os dados de
+// todos os objetos do quadro são enviados uma única vez para um shader
+// storage buffer, um compute shader ("shader_culling.glsl") faz o
+// view-frustum culling e escreve um comando de desenho indireto por objeto,
+// e o quadro inteiro é desenhado com uma única chamada a
+// glMultiDrawElementsIndirect().
+//
+// Requer que todos os objetos estejam no mesmo VAO. Veja a função
+// BuildTrianglesAndAddToVirtualScene() em "main.cpp".
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "glextensions.h"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+// Funções definidas em main.cpp
+GLuint StartGpuProgram(const char* vertex_filename, const char* fragment_filename, const char* header);
+GLuint StartComputeProgram(const char* filename);
+bool SwapGpuProgram(GLuint& pending_program_id, GLuint& program_id, bool wait);
+void DiscardGpuProgram(GLuint& pending_program_id);
+void SetupTextureUnits(GLuint program_id);
+void SetupTeamColors(GLuint program_id);
+
+// Planos do frustum extraídos em Culling_BeginFrame(). Veja "culling.cpp".
+extern glm::vec4 g_FrustumPlanes[6];
+
+// Dados de cada objeto no shader storage buffer. Deve ter o mesmo layout
+// (std430) da estrutura DrawInstance de "shader_culling.glsl" e de
+// "shader_vertex.glsl".
+struct GpuDrawInstance
+{
+    glm::mat4 model;
+    glm::mat4 normal_matrix;
+    glm::vec4 bbox_min;
+    glm::vec4 bbox_max;
+    GLint     object_id;
+    GLuint    first_index;
+    GLuint    num_indices;
+    GLint     padding;
+};
+
+// Objetos enfileirados no quadro atual
+std::vector<GpuDrawInstance> g_GpuDrawInstances;
+
+// Variante dos shaders de "main.cpp" com INDIRECT_DRAW, e suas variáveis
+struct GpuDrawProgram
+{
+    GLuint program_id;
+    GLint  view_uniform;
+    GLint  projection_uniform;
+    GLint  camera_position_uniform;
+};
+
+GLuint gpuculling_program_id = 0;   // Compute shader de culling
+GLint  gpuculling_planes_uniform;
+GLint  gpuculling_count_uniform;
+GLint  gpuculling_enabled_uniform;
+
+// Uma variante de desenho por caminho de renderização de "main.cpp" (ex:
+// "forward", G-buffer do "deferred", "clustered"), cada uma com os #define
+// passados a GpuCulling_RequestShaders().
+#define GPUDRAW_MAX_VARIANTS 4
+GpuDrawProgram gpudraw_programs[GPUDRAW_MAX_VARIANTS];
+int gpudraw_num_variants = 0;
+
+// Variantes que escrevem somente a profundidade, para o "depth pre-pass", e
+// que somam uma cor constante por fragmento, para a visualização do
+// overdraw. Veja "depthprepass.cpp". Selecionadas em GpuCulling_DrawCulled()
+// pelos valores negativos de "variant" abaixo.
+#define GPUDRAW_DEPTH_ONLY -1
+#define GPUDRAW_OVERDRAW   -2
+GpuDrawProgram gpudraw_depth_program = { 0, -1, -1, -1 };
+GpuDrawProgram gpudraw_overdraw_program = { 0, -1, -1, -1 };
+
+// Programas pedidos por GpuCulling_RequestShaders() ainda sendo linkados (0:
+// nenhum). Os programas acima continuam em uso até que estes fiquem prontos.
+GLuint gpuculling_pending_program_id = 0;
+GLuint gpudraw_pending_program_ids[GPUDRAW_MAX_VARIANTS];
+GLuint gpudraw_pending_depth_program_id = 0;
+GLuint gpudraw_pending_overdraw_program_id = 0;
+
+GLuint gpuculling_instances_buffer = 0; // Shader storage buffer com GpuDrawInstance
+GLuint gpuculling_commands_buffer = 0;  // Comandos de desenho indireto
+GLuint gpuculling_draw_id_buffer = 0;   // Atributo "draw_id" = 0, 1, 2, ...
+size_t gpuculling_capacity = 0;         // Número de objetos que cabem nos buffers acima
+GLuint gpuculling_vertex_array_object_id = 0;
+size_t gpuculling_culled_count = 0;     // Número de comandos gerados pelo último GpuCulling_Cull()
+
+// Verdadeiro se o contexto suporta OpenGL 4.3 e todos os programas de GPU
+// deste caminho foram carregados com sucesso.
+bool GpuCulling_IsSupported()
+{
+    if (!GLEXT_VERSION_4_3 || gpuculling_program_id == 0 || gpudraw_num_variants == 0)
+        return false;
+
+    for (int i = 0; i < gpudraw_num_variants; ++i)
+        if (gpudraw_programs[i].program_id == 0)
+            return false;
+
+    if (gpudraw_depth_program.program_id == 0 || gpudraw_overdraw_program.program_id == 0)
+        return false;
+
+    return true;
+}
+
+// Instala a variante de desenho indireto "pending_program_id" (veja
+// GpuCulling_RequestShaders()) em "program", se ela já foi linkada com
+// sucesso. Retorna falso enquanto ela não terminou.
+static bool GpuCulling_SwapDrawProgram(GLuint& pending_program_id, GpuDrawProgram& program, bool wait)
+{
+    if (SwapGpuProgram(pending_program_id, program.program_id, wait))
+    {
+        program.view_uniform            = glGetUniformLocation(program.program_id, "view");
+        program.projection_uniform      = glGetUniformLocation(program.program_id, "projection");
+        program.camera_position_uniform = glGetUniformLocation(program.program_id, "camera_position");
+
+        SetupTextureUnits(program.program_id);
+        SetupTeamColors(program.program_id);
+    }
+    return pending_program_id == 0;
+}
+
+// Pede a compilação do compute shader de culling e da variante dos shaders
+// de "main.cpp" que lê os dados de cada objeto do shader storage buffer, uma
+// para cada string de #define em "variant_defines" (ex: "GBUFFER"). Os
+// programas são instalados por GpuCulling_PollShaders(). Chamada por
+// RequestRenderPathShaders() em "main.cpp".
+void GpuCulling_RequestShaders(const char* const variant_defines[], int num_variants)
+{
+    if (!GLEXT_VERSION_4_3)
+        return;
+
+    // Compute shader, carregado do cache em disco se possível
+    DiscardGpuProgram(gpuculling_pending_program_id);
+    gpuculling_pending_program_id = StartComputeProgram("../../src/shader_culling.glsl");
+
+    // Variantes de desenho indireto dos shaders de vértice e fragmentos
+    gpudraw_num_variants = std::min(num_variants, GPUDRAW_MAX_VARIANTS);
+    for (int i = 0; i < gpudraw_num_variants; ++i)
+    {
+        std::string header = "#version 430 core\n#define INDIRECT_DRAW\n";
+        if (variant_defines[i][0] != '\0')
+            header += std::string("#define ") + variant_defines[i] + "\n";
+        DiscardGpuProgram(gpudraw_pending_program_ids[i]);
+        gpudraw_pending_program_ids[i] = StartGpuProgram("../../src/shader_vertex.glsl", "../../src/shader_fragment.glsl", header.c_str());
+    }
+
+    DiscardGpuProgram(gpudraw_pending_depth_program_id);
+    gpudraw_pending_depth_program_id = StartGpuProgram("../../src/shader_vertex.glsl", "../../src/shader_shadow_fragment.glsl",
+                                                       "#version 430 core\n#define INDIRECT_DRAW\n#define DEPTH_PREPASS\n");
+    DiscardGpuProgram(gpudraw_pending_overdraw_program_id);
+    gpudraw_pending_overdraw_program_id = StartGpuProgram("../../src/shader_vertex.glsl", "../../src/shader_overdraw_fragment.glsl",
+                                                          "#version 430 core\n#define INDIRECT_DRAW\n#define DEPTH_PREPASS\n");
+}
+
+// Instala os programas pedidos por GpuCulling_RequestShaders() que já foram
+// linkados com sucesso; se a linkagem falhou, o programa anterior continua
+// em uso. Se "wait" é verdadeiro, esperamos todos terminarem. Retorna
+// verdadeiro quando não há mais nenhum pendente.
+bool GpuCulling_PollShaders(bool wait)
+{
+    if (!GLEXT_VERSION_4_3)
+        return true;
+
+    if (SwapGpuProgram(gpuculling_pending_program_id, gpuculling_program_id, wait))
+    {
+        gpuculling_planes_uniform  = glGetUniformLocation(gpuculling_program_id, "frustum_planes");
+        gpuculling_count_uniform   = glGetUniformLocation(gpuculling_program_id, "num_instances");
+        gpuculling_enabled_uniform = glGetUniformLocation(gpuculling_program_id, "culling_enabled");
+    }
+    bool done = gpuculling_pending_program_id == 0;
+
+    for (int i = 0; i < gpudraw_num_variants; ++i)
+        done = GpuCulling_SwapDrawProgram(gpudraw_pending_program_ids[i], gpudraw_programs[i], wait) && done;
+    done = GpuCulling_SwapDrawProgram(gpudraw_pending_depth_program_id, gpudraw_depth_program, wait) && done;
+    done = GpuCulling_SwapDrawProgram(gpudraw_pending_overdraw_program_id, gpudraw_overdraw_program, wait) && done;
+
+    return done;
+}
+
+// Cria os buffers deste caminho e adiciona o atributo "draw_id" (location = 3
+// em "shader_vertex.glsl") ao VAO compartilhado por todos os objetos.
+void GpuCulling_Init(GLuint vertex_array_object_id)
+{
+    if (!GLEXT_VERSION_4_3)
+        return;
+
+    gpuculling_vertex_array_object_id = vertex_array_object_id;
+
+    glGenBuffers(1, &gpuculling_instances_buffer);
+    glGenBuffers(1, &gpuculling_commands_buffer);
+    glGenBuffers(1, &gpuculling_draw_id_buffer);
+
+    glBindVertexArray(vertex_array_object_id);
+    // O buffer começa com um único valor, para que o atributo seja válido
+    // mesmo antes do primeiro GpuCulling_Cull() (ex: no caminho do CPU).
+    GLint first_draw_id = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, gpuculling_draw_id_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLint), &first_draw_id, GL_STATIC_DRAW);
+    glVertexAttribIPointer(3, 1, GL_INT, 0, 0);
+    glVertexAttribDivisor(3, 1); // Um valor por instância, não por vértice
+    glEnableVertexAttribArray(3);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+// Enfileira um objeto para ser desenhado por GpuCulling_Cull() e GpuCulling_DrawCulled().
+void GpuCulling_AddInstance(const glm::mat4& model, glm::vec3 bbox_min, glm::vec3 bbox_max, int object_id, size_t first_index, int num_indices)
+{
+    GpuDrawInstance instance;
+    instance.model       = model;
+    instance.normal_matrix = glm::inverseTranspose(model);
+    instance.bbox_min    = glm::vec4(bbox_min, 1.0f);
+    instance.bbox_max    = glm::vec4(bbox_max, 1.0f);
+    instance.object_id   = object_id;
+    instance.first_index = (GLuint)first_index;
+    instance.num_indices = (GLuint)num_indices;
+    instance.padding     = 0;
+    g_GpuDrawInstances.push_back(instance);
+}
+
+// Faz o culling na GPU dos objetos enfileirados no quadro, gerando os
+// comandos de desenho indireto que serão utilizados por GpuCulling_DrawCulled().
+void GpuCulling_Cull(const glm::mat4& view, const glm::mat4& projection, bool culling_enabled)
+{
+    size_t count = g_GpuDrawInstances.size();
+    gpuculling_culled_count = count;
+    if (count == 0)
+        return;
+
+    // Aumentamos os buffers, se necessário. O atributo "draw_id" contém
+    // simplesmente 0, 1, 2, ..., para que cada comando, com base_instance = i,
+    // leia o i-ésimo objeto.
+    if (count > gpuculling_capacity)
+    {
+        gpuculling_capacity = count * 2;
+
+        std::vector<GLint> draw_ids(gpuculling_capacity);
+        for (size_t i = 0; i < gpuculling_capacity; ++i)
+            draw_ids[i] = (GLint)i;
+
+        glBindBuffer(GL_ARRAY_BUFFER, gpuculling_draw_id_buffer);
+        glBufferData(GL_ARRAY_BUFFER, gpuculling_capacity * sizeof(GLint), draw_ids.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpuculling_commands_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, gpuculling_capacity * 5 * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // Enviamos os dados dos objetos. Chamamos glBufferData() com NULL antes
+    // ("orphaning") para não esperar a GPU terminar de usar o quadro anterior.
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpuculling_instances_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, gpuculling_capacity * sizeof(GpuDrawInstance), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GpuDrawInstance), g_GpuDrawInstances.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gpuculling_instances_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gpuculling_commands_buffer);
+
+    // Culling: uma invocação por objeto, em grupos de 64 (local_size_x)
+    glUseProgram(gpuculling_program_id);
+    glUniform4fv(gpuculling_planes_uniform, 6, glm::value_ptr(g_FrustumPlanes[0]));
+    glUniform1ui(gpuculling_count_uniform, (GLuint)count);
+    glUniform1i(gpuculling_enabled_uniform, culling_enabled);
+    glDispatchCompute((GLuint)((count + 63) / 64), 1, 1);
+
+    // Os comandos escritos pelo compute shader serão lidos como comandos de
+    // desenho indireto, e os dados dos objetos pelo vertex shader.
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    g_GpuDrawInstances.clear();
+}
+
+// Desenha, com uma única chamada, os objetos que passaram pelo último
+// GpuCulling_Cull(), com a variante "variant" dos shaders (índice em
+// GpuCulling_RequestShaders()), ou com GPUDRAW_DEPTH_ONLY ou GPUDRAW_OVERDRAW.
+// Pode ser chamada mais de uma vez por culling.
+void GpuCulling_DrawCulled(const glm::mat4& view, const glm::mat4& projection, int variant)
+{
+    if (gpuculling_culled_count == 0)
+        return;
+
+    const GpuDrawProgram& program = variant == GPUDRAW_DEPTH_ONLY ? gpudraw_depth_program
+                                  : variant == GPUDRAW_OVERDRAW   ? gpudraw_overdraw_program
+                                  : gpudraw_programs[variant];
+    glUseProgram(program.program_id);
+    glUniformMatrix4fv(program.view_uniform       , 1 , GL_FALSE , glm::value_ptr(view));
+    glUniformMatrix4fv(program.projection_uniform , 1 , GL_FALSE , glm::value_ptr(projection));
+    glm::vec4 camera_position = glm::inverse(view)[3];
+    glUniform4f(program.camera_position_uniform, camera_position.x, camera_position.y, camera_position.z, 1.0f);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gpuculling_instances_buffer);
+    glBindVertexArray(gpuculling_vertex_array_object_id);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gpuculling_commands_buffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLsizei)gpuculling_culled_count, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
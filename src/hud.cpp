@@ -0,0 +1,295 @@
+// HUD retido: os painéis do jogo (por enquanto, um cartão por unidade, na
+// ordem dos turnos, com o papel, a barra de vida e o destaque da unidade
+// ativa) são desenhados em uma textura fora da tela, que só é redesenhada
+// nas regiões que mudaram. O estado do jogo avisa as mudanças com
+// Hud_SetUnit() (veja UpdateHudUnit() em "main.cpp", chamada por
+// Character::take_damage() e PassTurn()); nos demais quadros, o HUD custa
+// somente uma composição da textura sobre a cena, com um triângulo de tela
+// cheia.
+//
+// Cada cartão é uma região retangular: ao redesenhá-lo, limitamos a escrita
+// ao seu retângulo com glScissor(). Os retângulos coloridos (fundo, faixa do
+// time, barras) são desenhados com glClear() dentro do scissor, e o texto
+// com TextRendering_DrawString(), no mesmo espaço NDC da janela. O texto
+// do HUD é desenhado na hora, sem passar pelo vetor de glifos do quadro, que
+// pode já ter texto pendente para a janela.
+//
+// A textura guarda cores com alfa pré-multiplicado, para que o texto possa
+// ser misturado sobre o fundo translúcido dos cartões e o resultado composto
+// sobre a cena com uma única operação de blending.
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/vec4.hpp>
+
+// Funções definidas em main.cpp
+GLuint LoadGpuProgram(const char* vertex_filename, const char* fragment_filename, const char* header);
+
+// Funções definidas em textrendering.cpp
+float TextRendering_LineHeight(GLFWwindow* window);
+float TextRendering_CharWidth(GLFWwindow* window);
+void TextRendering_DrawString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f, bool premultiplied_target = false);
+
+// Unidade de textura do HUD. Veja "textrendering.cpp" para as unidades
+// anteriores.
+#define HUD_TEXTURE_UNIT 21
+
+// Medidas dos cartões, em caracteres e linhas do texto
+#define HUD_CARD_CHARS  22
+#define HUD_CARD_LINES  2.2f
+#define HUD_CARD_TOP    2.5f  // Linhas livres acima do primeiro cartão (fps)
+
+struct HudUnit
+{
+    std::string name;
+    glm::vec4   color;
+    float       hp;
+    float       max_hp;
+    bool        active;
+    bool        dirty;
+};
+std::vector<HudUnit> hud_units;
+
+GLuint hud_framebuffer = 0;
+GLuint hud_texture = 0;
+int    hud_width = 0;   // Tamanho da textura (o do framebuffer da janela)
+int    hud_height = 0;
+int    hud_window_width = 0;  // Tamanho da janela em que o layout foi feito
+int    hud_window_height = 0;
+bool   hud_clear = true;      // Se a textura inteira deve ser limpa
+
+GLuint hud_program_id = 0;
+GLuint hud_vertex_array_object_id = 0;
+
+// Número de cartões redesenhados no último quadro
+int g_HudRedrawnRegions = 0;
+
+// Carrega o programa da composição. Chamada uma vez, após a criação do
+// contexto.
+void Hud_Init()
+{
+    glGenVertexArrays(1, &hud_vertex_array_object_id);
+
+    hud_program_id = LoadGpuProgram("../../src/shader_fullscreen_vertex.glsl", "../../src/shader_hud_fragment.glsl", NULL);
+
+    GLint linked_ok = GL_FALSE;
+    glGetProgramiv(hud_program_id, GL_LINK_STATUS, &linked_ok);
+    if ( linked_ok == GL_FALSE )
+    {
+        fprintf(stderr, "ERROR: HUD desativado, erro nos shaders.\n");
+        glDeleteProgram(hud_program_id);
+        hud_program_id = 0;
+        return;
+    }
+
+    glUseProgram(hud_program_id);
+    glUniform1i(glGetUniformLocation(hud_program_id, "hud"), HUD_TEXTURE_UNIT);
+    glUseProgram(0);
+}
+
+// Define o número de cartões. Como os cartões seguintes mudam de posição,
+// todo o HUD é redesenhado.
+void Hud_SetUnitCount(int count)
+{
+    if ((int)hud_units.size() == count)
+        return;
+
+    HudUnit unit;
+    unit.hp = unit.max_hp = 0.0f;
+    unit.active = false;
+    unit.dirty = true;
+    hud_units.resize(count, unit);
+    for (HudUnit& u : hud_units)
+        u.dirty = true;
+    hud_clear = true;
+}
+
+// Atualiza o cartão "index", marcando a sua região para ser redesenhada se
+// algo mudou.
+void Hud_SetUnit(int index, const char* name, const glm::vec4& color, float hp, float max_hp, bool active)
+{
+    if (index < 0 || index >= (int)hud_units.size())
+        return;
+
+    HudUnit& unit = hud_units[index];
+    if (unit.name == name && unit.color == color && unit.hp == hp && unit.max_hp == max_hp && unit.active == active)
+        return;
+
+    unit.name = name;
+    unit.color = color;
+    unit.hp = hp;
+    unit.max_hp = max_hp;
+    unit.active = active;
+    unit.dirty = true;
+}
+
+// (Re)cria a textura com width x height pixels.
+static void Hud_Resize(int width, int height)
+{
+    if (hud_framebuffer == 0)
+    {
+        glGenFramebuffers(1, &hud_framebuffer);
+        glGenTextures(1, &hud_texture);
+    }
+
+    hud_width = width;
+    hud_height = height;
+
+    glActiveTexture(GL_TEXTURE0 + HUD_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, hud_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, hud_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hud_texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr, "ERROR: Cannot create %dx%d HUD framebuffer.\n", width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Limita a escrita ao retângulo (x0,y0)-(x1,y1), em NDC. O scissor deve
+// estar ligado.
+static void Hud_SetScissor(float x0, float y0, float x1, float y1)
+{
+    int px0 = (int)((x0 * 0.5f + 0.5f) * hud_width + 0.5f);
+    int py0 = (int)((y0 * 0.5f + 0.5f) * hud_height + 0.5f);
+    int px1 = (int)((x1 * 0.5f + 0.5f) * hud_width + 0.5f);
+    int py1 = (int)((y1 * 0.5f + 0.5f) * hud_height + 0.5f);
+    glScissor(std::min(px0, px1), std::min(py0, py1), std::abs(px1 - px0), std::abs(py1 - py0));
+}
+
+// Preenche o retângulo (x0,y0)-(x1,y1), em NDC, com a cor "color" (com
+// alfa não pré-multiplicado).
+static void Hud_FillRect(float x0, float y0, float x1, float y1, const glm::vec4& color)
+{
+    Hud_SetScissor(x0, y0, x1, y1);
+    glClearColor(color.r * color.a, color.g * color.a, color.b * color.a, color.a);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+// Redesenha o cartão "index" na textura (ligada como framebuffer)
+static void Hud_DrawUnitCard(GLFWwindow* window, int index)
+{
+    const HudUnit& unit = hud_units[index];
+
+    float lineheight = TextRendering_LineHeight(window);
+    float charwidth = TextRendering_CharWidth(window);
+    float width = HUD_CARD_CHARS * charwidth;
+    float height = HUD_CARD_LINES * lineheight;
+    float margin = charwidth;
+
+    float x0 = 1.0f - margin - width;
+    float x1 = 1.0f - margin;
+    float y1 = 1.0f - HUD_CARD_TOP * lineheight - index * (height + lineheight / 4);
+    float y0 = y1 - height;
+
+    // O fundo substitui todo o conteúdo anterior da região (glClear não faz
+    // blending); o resto é desenhado por cima.
+    Hud_FillRect(x0, y0, x1, y1, unit.active ? glm::vec4(1.0f, 0.85f, 0.4f, 0.85f) : glm::vec4(1.0f, 1.0f, 1.0f, 0.55f));
+    Hud_FillRect(x0, y0, x0 + charwidth / 2, y1, glm::vec4(unit.color.r, unit.color.g, unit.color.b, 1.0f));
+
+    // Barra de vida
+    float fraction = unit.max_hp > 0.0f ? std::min(std::max(unit.hp / unit.max_hp, 0.0f), 1.0f) : 0.0f;
+    float bar_x0 = x0 + charwidth;
+    float bar_x1 = x1 - charwidth / 2;
+    float bar_y0 = y0 + lineheight / 5;
+    float bar_y1 = bar_y0 + lineheight / 3;
+    Hud_FillRect(bar_x0, bar_y0, bar_x1, bar_y1, glm::vec4(0.25f, 0.0f, 0.0f, 0.9f));
+    if (fraction > 0.0f)
+        Hud_FillRect(bar_x0, bar_y0, bar_x0 + fraction * (bar_x1 - bar_x0), bar_y1,
+                     glm::vec4(1.0f - fraction, 0.2f + 0.6f * fraction, 0.1f, 1.0f));
+
+    // O texto fica limitado à região do cartão
+    Hud_SetScissor(x0, y0, x1, y1);
+
+    char buffer[64];
+    snprintf(buffer, 64, "%s%s %.0f/%.0f", unit.active ? "> " : "", unit.name.c_str(), unit.hp, unit.max_hp);
+    TextRendering_DrawString(window, buffer, x0 + charwidth, y1 - lineheight * 0.85f, 1.0f, true);
+}
+
+// Redesenha as regiões que mudaram e compõe o HUD sobre a cena. Chamada a
+// cada quadro, com o framebuffer da janela ativo, antes do texto imediato
+// (que fica por cima). "width" e "height" são o tamanho do framebuffer da
+// janela.
+void Hud_Draw(GLFWwindow* window, int width, int height)
+{
+    g_HudRedrawnRegions = 0;
+    if (hud_program_id == 0 || width <= 0 || height <= 0)
+        return;
+
+    // O layout é feito em NDC a partir das medidas do texto, que dependem do
+    // tamanho da janela; se ele mudar, redesenhamos tudo.
+    int window_width, window_height;
+    glfwGetWindowSize(window, &window_width, &window_height);
+    if (width != hud_width || height != hud_height)
+    {
+        Hud_Resize(width, height);
+        hud_clear = true;
+    }
+    if (window_width != hud_window_width || window_height != hud_window_height)
+    {
+        hud_window_width = window_width;
+        hud_window_height = window_height;
+        hud_clear = true;
+    }
+    if (hud_clear)
+        for (HudUnit& unit : hud_units)
+            unit.dirty = true;
+
+    bool any_dirty = hud_clear;
+    for (const HudUnit& unit : hud_units)
+        any_dirty = any_dirty || unit.dirty;
+
+    if (any_dirty)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, hud_framebuffer);
+        glViewport(0, 0, hud_width, hud_height);
+
+        if (hud_clear)
+        {
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            hud_clear = false;
+        }
+
+        glEnable(GL_SCISSOR_TEST);
+        for (size_t i = 0; i < hud_units.size(); ++i)
+        {
+            if (!hud_units[i].dirty)
+                continue;
+            Hud_DrawUnitCard(window, (int)i);
+            hud_units[i].dirty = false;
+            g_HudRedrawnRegions += 1;
+        }
+        glDisable(GL_SCISSOR_TEST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+    }
+
+    // Composição: um triângulo de tela cheia, com alfa pré-multiplicado
+    glActiveTexture(GL_TEXTURE0 + HUD_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, hud_texture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUseProgram(hud_program_id);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glBindVertexArray(hud_vertex_array_object_id);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glUseProgram(0);
+}
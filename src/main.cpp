@@ -18,6 +18,7 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 // Headers abaixo são específicos de C++
 #include <map>
@@ -38,6 +39,7 @@
 #include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
 
 // Headers da biblioteca para carregar modelos obj
 #include <tiny_obj_loader.h>
@@ -48,6 +50,10 @@
 // Headers locais, definidos na pasta "include/"
 #include "utils.h"
 #include "matrices.h"
+#include "glextensions.h"
+#include "lights.h"
+#include "simulation.h"
+#include "pathfinding.h"
 
 // Header de tempo
 #include<time.h>
@@ -83,15 +89,6 @@ struct ObjModel
     }
 };
 
-// Estrutura que representa uma elevação no mapa
-struct Plateau
-{
-    glm::vec3 position;     // Posição do centro do planalto
-    glm::vec3 scale;        // Escala das medidas do planalto
-    glm::vec2 bottom_limit; // Menores coordenadas de área pertencentes ao planalto
-    glm::vec2 top_limit;    // Maiores coordenadas de área pertencentes ao planalto
-};
-
 // Declaração de funções utilizadas para pilha de matrizes de modelagem.
 void PushMatrix(glm::mat4 M);
 void PopMatrix(glm::mat4& M);
@@ -99,14 +96,37 @@ void PopMatrix(glm::mat4& M);
 // Declaração de várias funções utilizadas em main().  Essas estão definidas
 // logo após a definição de main() neste arquivo.
 void BuildTrianglesAndAddToVirtualScene(ObjModel*); // Constrói representação de um ObjModel como malha de triângulos para renderização
+void UploadVirtualScene(); // Envia para a GPU as malhas construídas pela função acima
 void ComputeNormals(ObjModel* model); // Computa normais de um ObjModel, caso não existam.
 void ComputeNormalsFlat(ObjModel* model);
 void LoadShadersFromFiles(); // Carrega os shaders de vértice e fragmento, criando um programa de GPU
+void SetupTextureUnits(GLuint program_id); // Associa as variáveis TextureImage* dos shaders às unidades de textura
+void SetupTeamColors(GLuint program_id); // Envia as cores dos times para os shaders
 void DrawVirtualObject(const char* object_name); // Desenha um objeto armazenado em g_VirtualScene
+void QueueVirtualObject(const char* object_name, glm::mat4 model, int object_id); // Enfileira um objeto para ser desenhado por DrawRenderQueue()
+void DrawRenderQueue(glm::mat4 view, glm::mat4 projection); // Aplica o culling e desenha os objetos enfileirados no quadro atual
+void DrawTransparentQueue(glm::mat4 view, glm::mat4 projection); // Desenha os objetos transparentes separados por DrawRenderQueue()
+void DrawScene(glm::mat4 view, glm::mat4 projection); // Desenha todos os objetos da cena
+bool SceneIsStatic(); // Verdadeiro se nada se move na cena (veja "framepacer.cpp")
+void SimulationStep(); // Um passo fixo do movimento controlado pelo teclado
+void MoveActiveCharacterTo(GLFWwindow* window); // Planeja o caminho até o ponto do terreno sob o cursor
+void InterpolateRenderState(float alpha); // Estado desenhado, entre dois passos
+void RestoreSimulationState(); // Desfaz InterpolateRenderState()
+void UpdateSceneLights(float time); // Monta a lista de luzes pontuais e spots do quadro
 GLuint LoadShader_Vertex(const char* filename);   // Carrega um vertex shader
 GLuint LoadShader_Fragment(const char* filename); // Carrega um fragment shader
-void LoadShader(const char* filename, GLuint shader_id); // Função utilizada pelas duas acima
+void LoadShader(const char* filename, GLuint shader_id, const char* header = NULL); // Função utilizada pelas duas acima
+std::string ReadShaderSource(const char* filename, const char* header); // Lê o código de um shader
+void CompileShader(GLuint shader_id, const std::string& source, const char* filename); // Compila o código de um shader
+void PrintShaderLog(GLuint shader_id, const char* filename); // Imprime erros e "warnings" da compilação de um shader
+bool PrintProgramLog(GLuint program_id); // Imprime erros da linkagem de um programa de GPU
 GLuint CreateGpuProgram(GLuint vertex_shader_id, GLuint fragment_shader_id); // Cria um programa de GPU
+GLuint CreateGpuProgramFromSources(const std::string& vertex_source, const std::string& fragment_source, const char* vertex_name, const char* fragment_name); // Idem, utilizando o cache em disco
+GLuint LoadGpuProgram(const char* vertex_filename, const char* fragment_filename, const char* header); // Idem, lendo os shaders de arquivos
+GLuint StartGpuProgram(const char* vertex_filename, const char* fragment_filename, const char* header); // Idem, sem esperar a linkagem
+GLuint StartComputeProgram(const char* filename); // Idem, com um compute shader
+bool SwapGpuProgram(GLuint& pending_program_id, GLuint& program_id, bool wait); // Substitui um programa quando o novo estiver linkado
+void DiscardGpuProgram(GLuint& pending_program_id); // Cancela um programa iniciado por StartGpuProgram()
 void PrintObjModelInfo(ObjModel*); // Função para debugging
 void BuildMeshes(int argc, char* argv[]);
 
@@ -116,6 +136,9 @@ void TextRendering_Init();
 float TextRendering_LineHeight(GLFWwindow* window);
 float TextRendering_CharWidth(GLFWwindow* window);
 void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f);
+void TextRendering_Flush(bool premultiplied_target = false);
+int TextRendering_CreateText(int count = 1);
+void TextRendering_PrintText(GLFWwindow* window, int text, const std::string &str, float x, float y, float scale = 1.0f);
 void TextRendering_PrintMatrix(GLFWwindow* window, glm::mat4 M, float x, float y, float scale = 1.0f);
 void TextRendering_PrintVector(GLFWwindow* window, glm::vec4 v, float x, float y, float scale = 1.0f);
 void TextRendering_PrintMatrixVectorProduct(GLFWwindow* window, glm::mat4 M, glm::vec4 v, float x, float y, float scale = 1.0f);
@@ -128,6 +151,110 @@ void TextRendering_ShowEulerAngles(GLFWwindow* window);
 void TextRendering_ShowProjection(GLFWwindow* window);
 void TextRendering_ShowFramesPerSecond(GLFWwindow* window);
 void TextRendering_ShowCharacterData(GLFWwindow* window);
+void TextRendering_ShowCullingStats(GLFWwindow* window);
+
+// Declaração de funções de view-frustum culling. Estas funções estão
+// definidas no arquivo "culling.cpp".
+void Culling_BeginFrame(const glm::mat4& projection_view);
+void Culling_TransformAABB(const glm::mat4& model, glm::vec3 bbox_min, glm::vec3 bbox_max, glm::vec3& world_min, glm::vec3& world_max);
+bool Culling_TestBox(glm::vec3 world_min, glm::vec3 world_max);
+int  Culling_AddBox(glm::vec3 world_min, glm::vec3 world_max);
+void Culling_Run();
+bool Culling_IsVisible(int index);
+
+// Declaração de funções de occlusion culling. Estas funções estão definidas
+// no arquivo "occlusion.cpp".
+void Occlusion_BeginFrame(const glm::mat4& projection_view);
+void Occlusion_AddOccluder(const glm::mat4& model, glm::vec3 bbox_min, glm::vec3 bbox_max);
+bool Occlusion_TestBox(glm::vec3 world_min, glm::vec3 world_max);
+
+// Declaração de funções do caminho de renderização com culling na GPU e
+// desenho indireto (OpenGL 4.3). Definidas no arquivo "gpuculling.cpp".
+bool GpuCulling_IsSupported();
+void GpuCulling_RequestShaders(const char* const variant_defines[], int num_variants);
+bool GpuCulling_PollShaders(bool wait);
+void GpuCulling_Init(GLuint vertex_array_object_id);
+void GpuCulling_AddInstance(const glm::mat4& model, glm::vec3 bbox_min, glm::vec3 bbox_max, int object_id, size_t first_index, int num_indices);
+void GpuCulling_Cull(const glm::mat4& view, const glm::mat4& projection, bool culling_enabled);
+void GpuCulling_DrawCulled(const glm::mat4& view, const glm::mat4& projection, int variant); // variant = -1: profundidade, -2: overdraw
+
+// Declaração de funções do caminho de renderização "deferred". Definidas no
+// arquivo "deferred.cpp".
+bool Deferred_IsSupported();
+void Deferred_RequestShaders();
+bool Deferred_PollShaders(bool wait);
+void Deferred_Init();
+bool Deferred_BeginGeometryPass();
+void Deferred_DrawLighting(const glm::mat4& view, const glm::mat4& projection, const std::vector<SceneLight>& lights, float sun_intensity);
+extern int g_DeferredLightCount;
+
+// Caminho de renderização "clustered forward". Veja "clustered.cpp".
+void Clustered_Init();
+void Clustered_SetupProgram(GLuint program_id);
+void Clustered_BeginFrame(const glm::mat4& view, const glm::mat4& projection, const std::vector<SceneLight>& lights, float sun_intensity);
+extern int g_ClusteredLightCount;
+extern int g_ClusteredMaxLightsPerCluster;
+
+// Sombras do sol ("cascaded shadow maps"). Veja "shadows.cpp".
+void Shadows_Init(GLuint vertex_array_object_id);
+void Shadows_SetupProgram(GLuint program_id);
+void Shadows_AddCaster(const glm::mat4& model, glm::vec3 bbox_min, glm::vec3 bbox_max, size_t first_index, int num_indices, bool is_static);
+void Shadows_Render(const glm::mat4& view, const glm::mat4& projection, glm::vec3 light_direction, bool enabled);
+extern int g_ShadowStaticCascadesRedrawn;
+extern int g_ShadowDynamicCastersDrawn;
+
+// "Depth pre-pass" dos objetos opacos e medida do overdraw. Veja "depthprepass.cpp".
+void DepthPrepass_Init();
+void DepthPrepass_RequestShaders();
+bool DepthPrepass_PollShaders(bool wait);
+void DepthPrepass_CycleMode();
+const char* DepthPrepass_ModeName();
+bool DepthPrepass_BeginFrame();
+void DepthPrepass_BeginMeasure();
+void DepthPrepass_EndMeasure();
+GLint DepthPrepass_UseProgram(const glm::mat4& view, const glm::mat4& projection, bool overdraw);
+extern float g_MeasuredOverdraw;
+extern bool  g_DepthPrepassActive;
+
+// Resolução dinâmica da cena 3D. Veja "dynamicresolution.cpp".
+void DynamicResolution_Init();
+void DynamicResolution_BeginFrame(int width, int height);
+void DynamicResolution_EndFrame(int width, int height);
+extern bool  g_DynamicResolutionEnabled;
+extern float g_ResolutionScale;
+extern float g_GpuFrameTimeMs;
+extern int   g_SceneWidth;
+extern int   g_SceneHeight;
+
+// Vsync, limitador de quadros e modo ocioso do laço principal. Veja "framepacer.cpp".
+void FramePacer_Init(GLFWwindow* window);
+void FramePacer_CycleVsync();
+const char* FramePacer_VsyncName();
+void FramePacer_CycleLimit();
+void FramePacer_NotifyActivity();
+void FramePacer_EndFrame(bool scene_static);
+extern float g_FrameLimitFps;
+extern bool  g_AdaptiveFrameRate;
+extern bool  g_FramePacerIdle;
+extern float g_FrameIntervalMs;
+extern float g_FrameJitterMs;
+extern float g_FrameIntervalMaxMs;
+
+// HUD retido, redesenhado somente nas regiões que mudam. Veja "hud.cpp".
+void Hud_Init();
+void Hud_SetUnitCount(int count);
+void Hud_SetUnit(int index, const char* name, const glm::vec4& color, float hp, float max_hp, bool active);
+void Hud_Draw(GLFWwindow* window, int width, int height);
+
+// Declaração de funções do cache em disco de programas de GPU. Definidas no
+// arquivo "shadercache.cpp".
+void ShaderCache_Init();
+void ShaderCache_SetRetrievable(GLuint program_id);
+GLuint ShaderCache_LoadProgram(const std::string& sources);
+void ShaderCache_StoreProgram(GLuint program_id, const std::string& sources);
+
+// Modo de benchmark ("main --benchmark"). Definido no arquivo "benchmark.cpp".
+void Benchmark_Run(const glm::mat4& view, const glm::mat4& projection);
 
 // Funções callback para comunicação com o sistema operacional e interação do
 // usuário. Veja mais comentários nas definições das mesmas, abaixo.
@@ -139,20 +266,19 @@ void CursorPosCallback(GLFWwindow* window, double xpos, double ypos);
 void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 
 // Funções de personagens
-void CreateCharacters(glm::vec3 land_size);
 void DrawCharacters();
+void UpdateHudUnit(int index);
+void UpdateHudUnits();
+void FollowActiveCharacter(const glm::vec4& position);
+void PrintAttackHit(int index, float hp, bool double_damage);
 
 // Funções de textura.
 void LoadTextureImage(const char* filename);
 GLint bbox_min_uniform;
 GLint bbox_max_uniform;
 
-void PassTurn();
-
 // Animação
 float attack_anim_melee_angle(float duration);
-void init_time(void);
-float get_delta_time(void);
 glm::vec4 quadratic_bezier(glm::vec4 p1, glm::vec4 p2, glm::vec4 p3, float t);
 glm::vec4 animate_projectile(glm::vec4 p1, glm::vec4 p2, glm::vec4 p3, float duration);
 
@@ -161,7 +287,7 @@ glm::vec4 animate_projectile(glm::vec4 p1, glm::vec4 p2, glm::vec4 p3, float dur
 struct SceneObject
 {
     std::string  name;        // Nome do objeto
-    void*        first_index; // Índice do primeiro vértice dentro do vetor indices[] definido em BuildTrianglesAndAddToVirtualScene()
+    size_t       first_index; // Índice do primeiro vértice dentro do vetor g_SceneIndices[] definido em BuildTrianglesAndAddToVirtualScene()
     int          num_indices; // Número de índices do objeto dentro do vetor indices[] definido em BuildTrianglesAndAddToVirtualScene()
     GLenum       rendering_mode; // Modo de rasterização (GL_TRIANGLES, GL_TRIANGLE_STRIP, etc.)
     GLuint       vertex_array_object_id; // ID do VAO onde estão armazenados os atributos do modelo
@@ -169,6 +295,59 @@ struct SceneObject
     glm::vec3    bbox_max;
 };
 
+// Identificadores de objeto ("object_id" em shader_fragment.glsl)
+#define LAND        0
+#define WATER       1
+#define CHAR_TEAM_1 2
+#define CHAR_TEAM_2 3
+
+// Uma permutação dos shaders "shader_vertex.glsl" e "shader_fragment.glsl",
+// compilada com um conjunto de #define (ex: "MATERIAL_LAND"), e os endereços
+// das suas variáveis uniform. Veja GetShaderProgram().
+struct ShaderProgram
+{
+    GLuint program_id;
+    int    draw_order;  // Programas com menor valor são desenhados antes
+    GLint  model_uniform;
+    GLint  view_uniform;
+    GLint  projection_uniform;
+    GLint  object_id_uniform;
+    GLint  bbox_min_uniform;
+    GLint  bbox_max_uniform;
+    GLint  normal_matrix_uniform;
+    GLint  camera_position_uniform;
+};
+
+// Comando de desenho enfileirado durante a construção do quadro. Os objetos
+// não são desenhados imediatamente: primeiro enfileiramos todos, depois
+// testamos suas bounding boxes contra o frustum em lote, e só então enviamos
+// para a GPU os que são visíveis. Veja DrawRenderQueue().
+struct DrawCommand
+{
+    SceneObject* object;    // Objeto de g_VirtualScene a ser desenhado
+    glm::mat4    model;     // Matriz de modelagem
+    int          object_id; // Valor de "object_id" em shader_fragment.glsl
+    glm::vec3    world_min; // AABB do objeto em coordenadas globais
+    glm::vec3    world_max;
+    int          cull_index; // Índice retornado por Culling_AddBox()
+    ShaderProgram* program; // Permutação dos shaders que desenha o objeto
+    float        sort_depth; // Distância (ao quadrado) da câmera, para a ordenação em DrawRenderQueue()
+    int          depth_bucket; // Faixa de distância dos objetos opacos. Veja CompareFrontToBack().
+};
+
+ShaderProgram* GetShaderProgram(const char* defines, int draw_order); // Compila (ou busca no cache) uma permutação dos shaders
+void RequestShaderProgram(const char* defines, int draw_order); // Inicia a compilação de uma permutação, sem esperar o seu término
+void PollShaderPrograms(bool wait); // Instala as permutações cuja compilação já terminou
+void ReloadShadersFromFiles(); // Recarrega os shaders sem interromper a renderização
+void RequestMaterialShaderPrograms(); // Pede a compilação das permutações de cada material
+std::string RenderPathShaderKey(const std::string& material, int path); // Chave da permutação de um material em um caminho de renderização
+void LoadRenderPathShaders(); // Carrega os shaders dos caminhos de culling na GPU e "deferred"
+void RequestRenderPathShaders(); // Idem, sem esperar a compilação
+bool PollRenderPathShaders(bool wait); // Instala os programas pedidos acima que já foram linkados
+ShaderProgram* ProgramForObject(int object_id); // Permutação que desenha objetos com este object_id
+
+void DrawVirtualObject(const SceneObject& object); // Desenha um objeto sem buscá-lo pelo nome
+
 // Abaixo definimos variáveis globais utilizadas em várias funções do código.
 
 // A cena virtual é uma lista de objetos nomeados, guardados em um dicionário
@@ -177,6 +356,76 @@ struct SceneObject
 // estes são acessados.
 std::map<std::string, SceneObject> g_VirtualScene;
 
+// Atributos dos vértices de todos os objetos de g_VirtualScene, concatenados
+// em um único conjunto de buffers (e um único VAO), de forma que qualquer
+// objeto possa ser desenhado sem trocar de VAO, e que todos possam ser
+// desenhados com uma única chamada de desenho indireto. Estes vetores são
+// preenchidos por BuildTrianglesAndAddToVirtualScene() e enviados para a GPU
+// (e então esvaziados) por UploadVirtualScene().
+std::vector<GLuint> g_SceneIndices;
+std::vector<float>  g_SceneModelCoefficients;
+std::vector<float>  g_SceneNormalCoefficients;
+std::vector<float>  g_SceneTextureCoefficients;
+GLuint g_SceneVertexArrayObjectId = 0;
+
+// Fila de desenho do quadro atual. Veja QueueVirtualObject().
+std::vector<DrawCommand> g_RenderQueue;
+
+// Objetos transparentes visíveis da fila, ordenados por DrawRenderQueue() e
+// desenhados por DrawTransparentQueue().
+std::vector<const DrawCommand*> g_TransparentCommands;
+
+// Variável que controla se o view-frustum culling está ativo, e contadores
+// de objetos desenhados e descartados no último quadro (mostrados no HUD).
+bool g_FrustumCullingEnabled = true;
+int  g_DrawnObjects = 0;
+int  g_CulledObjects = 0;
+
+// Análogo para o occlusion culling dos personagens escondidos atrás da terra
+// e dos planaltos.
+bool g_OcclusionCullingEnabled = true;
+int  g_OccludedObjects = 0;
+
+// Variável que controla se o culling e o desenho são feitos pela GPU, com
+// glMultiDrawElementsIndirect(). Só pode ser ativada com OpenGL 4.3.
+bool g_GpuCullingEnabled = false;
+
+// Caminhos de renderização, alternados com a tecla M. No caminho "forward",
+// cada objeto é iluminado ao ser desenhado, somente pelo sol. No "deferred",
+// os objetos são desenhados em um G-buffer e iluminados depois, pelo sol e
+// pelas luzes de g_SceneLights. Veja "deferred.cpp". No "clustered", cada
+// objeto é iluminado ao ser desenhado, pelo sol e pelas luzes do cluster de
+// cada fragmento, mantendo o MSAA. Veja "clustered.cpp".
+#define RENDER_FORWARD   0
+#define RENDER_DEFERRED  1
+#define RENDER_CLUSTERED 2
+#define NUM_RENDER_PATHS 3
+int g_RenderPath = RENDER_FORWARD;
+const char* g_RenderPathNames[NUM_RENDER_PATHS] = { "forward", "deferred", "clustered" };
+
+// #define de "shader_fragment.glsl" das permutações de cada caminho
+const char* const g_RenderPathDefines[NUM_RENDER_PATHS] = { "", "GBUFFER", "CLUSTERED_LIGHTING" };
+
+// Caminho utilizado para desenhar o quadro atual. Difere de g_RenderPath se
+// o caminho escolhido não pôde ser utilizado (ex: G-buffer não foi criado).
+// Veja ProgramForObject().
+int g_FrameRenderPath = RENDER_FORWARD;
+
+// Variável que controla se o sol projeta sombras (tecla K), e o sentido do
+// sol, o mesmo vetor "l" de "shader_fragment.glsl".
+bool g_ShadowsEnabled = true;
+const glm::vec3 g_SunDirection = glm::vec3(4.0f, 4.0f, 3.5f);
+
+// Variável que controla a visualização do overdraw (tecla X): a cena é
+// desenhada somando uma cor constante por fragmento. Veja DrawRenderQueue().
+bool g_ShowOverdraw = false;
+
+// Luzes pontuais e spots do quadro atual: tochas dos personagens, o feitiço
+// do personagem ativo e, no modo noturno (tecla N), fogueiras espalhadas
+// pelo terreno. Veja UpdateSceneLights().
+std::vector<SceneLight> g_SceneLights;
+bool g_NightMode = false;
+
 // Pilha que guardará as matrizes de modelagem.
 std::stack<glm::mat4>  g_MatrixStack;
 
@@ -202,6 +451,18 @@ float g_CameraTheta = 0.0f; // Ângulo no plano ZX em relação ao eixo Z
 float g_CameraPhi = 0.0f;   // Ângulo em relação ao eixo Y
 float g_CameraDistance = 3.5f; // Distância da câmera para a origem
 
+// Caminho que o personagem "g_MovePathOwner" está seguindo, a partir do
+// ponto "g_MovePathNext", escolhido com o botão direito do mouse. Veja
+// MoveActiveCharacterTo().
+std::vector<glm::vec4> g_MovePath;
+size_t g_MovePathNext = 0;
+int g_MovePathOwner = -1;
+
+// Matrizes "view" e "projection" do último quadro desenhado, para encontrar
+// o ponto do terreno sob o cursor
+glm::mat4 g_LastView;
+glm::mat4 g_LastProjection;
+
 // Variáveis que controlam rotação do antebraço
 float g_ForearmAngleZ = 0.0f;
 float g_ForearmAngleX = 0.0f;
@@ -216,9 +477,6 @@ bool g_UsePerspectiveProjection = true;
 // Variável que controla se o texto informativo será mostrado na tela.
 bool g_ShowInfoText = true;
 
-// Variável de tempo
-float old_time = 0.0f;
-
 // Variáveis que definem um programa de GPU (shaders). Veja função LoadShadersFromFiles().
 GLuint vertex_shader_id;
 GLuint fragment_shader_id;
@@ -228,6 +486,61 @@ GLint view_uniform;
 GLint projection_uniform;
 GLint object_id_uniform;
 
+// Permutações dos shaders já compiladas, indexadas pelos seus #define.
+std::map<std::string, ShaderProgram> g_ShaderPrograms;
+
+// Permutação dos shaders sendo compilada pelo driver. Enquanto a compilação
+// não termina, continuamos desenhando com a permutação anterior de mesma
+// chave em g_ShaderPrograms. Veja PollShaderPrograms().
+struct PendingShaderProgram
+{
+    std::string key;        // #define da permutação (chave em g_ShaderPrograms)
+    int         draw_order;
+    GLuint      program_id;
+    GLuint      vertex_shader_id;
+    GLuint      fragment_shader_id;
+    std::string sources;    // Código dos dois shaders, chave do cache em disco
+};
+std::vector<PendingShaderProgram> g_PendingShaderPrograms;
+
+// Programas de GPU dos demais módulos (culling na GPU, "deferred", "depth
+// pre-pass") sendo compilados e linkados. Veja StartGpuProgram().
+struct PendingGpuProgram
+{
+    GLuint      program_id;
+    int         num_shaders;
+    GLuint      shader_ids[2];
+    std::string shader_names[2];
+    std::string sources;    // Código dos shaders, chave do cache em disco
+};
+std::vector<PendingGpuProgram> g_PendingGpuPrograms;
+
+// Sem a extensão KHR_parallel_shader_compile, consultar o resultado de uma
+// linkagem a termina. Esperamos no máximo uma por quadro; veja
+// PollShaderPrograms().
+bool g_ShaderWaitedThisFrame = false;
+
+// Indica que a tecla R foi pressionada e os shaders ainda estão sendo
+// recompilados. Veja ReloadShadersFromFiles().
+bool g_ShaderReloadInProgress = false;
+
+// #define adicionados a todas as permutações. Utilizado pelo modo de
+// benchmark para comparar variantes dos shaders. Veja "benchmark.cpp".
+std::string g_ShaderExtraDefines;
+
+// Permutação utilizada para cada object_id (LAND, WATER, CHAR_TEAM_1 e
+// CHAR_TEAM_2). Objetos com outros identificadores utilizam a permutação
+// sem nenhum material, que escolhe o material pelo object_id.
+// Há um conjunto de permutações para cada caminho de renderização.
+#define NUM_MATERIAL_OBJECT_IDS 4
+ShaderProgram* g_ObjectPrograms[NUM_RENDER_PATHS][NUM_MATERIAL_OBJECT_IDS];
+ShaderProgram* g_DefaultPrograms[NUM_RENDER_PATHS];
+
+// Cores de cada time (Kd e Ka), enviadas para "team_Kd" e "team_Ka" em
+// "shader_fragment.glsl".
+const glm::vec4 g_TeamDiffuseColors[2] = { glm::vec4(1.0f,0.01f,0.01f,1.0f), glm::vec4(0.01f,0.2f,1.0f,1.0f) };
+const glm::vec4 g_TeamAmbientColors[2] = { glm::vec4(0.9f,0.1f,0.1f,1.0f),   glm::vec4(0.2f,0.2f,1.0f,1.0f) };
+
 // Classes
 class Lookat_Camera{
 public:
@@ -242,9 +555,12 @@ public:
     // Outras vars
     float distance = 3.5f; // Distância da câmera para a origem
     //Parâmetros
-    float speed;
+    float speed;    // Unidades por segundo
     float nearplane;  // Posição do "near plane"
     float farplane; // Posição do "far plane"
+    // Estado no passo anterior da simulação, para a interpolação
+    glm::vec4 previous_position;
+    glm::vec4 previous_view;
 
     //Funções
     void init();
@@ -253,77 +569,18 @@ public:
     void update_camera();
     void set_nearplane(float near_value);
     void set_farplane(float far_value);
-};
-
-class Free_Camera{
-public:
-    // Vetores
-    glm::vec4 position;
-    glm::vec4 view;
-    glm::vec4 up;
-    glm::vec4 right;
-    glm::vec4 v;
-    // Ângulos
-    float phi;
-    // Parâmetros
-    float speed;
-    // Near e Far
-    float nearplane = -0.1f;
-    float farplane  = -10.0f;
-
-    void init(glm::vec4 pos, glm::vec4 origin);
-    void init_char(glm::vec4 pos, glm::vec4 origin);
-    void move(glm::vec4 direction);
-    void move2D(glm::vec4 direction);
-    void rotate(glm::vec4 axis, float angle);
-    void look(float dtheta, float dphi);
-};
-
-class Scenary{
-public:
-    glm::vec3 land_size;            // Escala das medidas da terra
-    std::vector<Plateau> plateaus;  // Lista de planaltos
-
-    void build();
-    void draw();
-    float heigth(glm::vec4 dot);
-};
-
-#define SPEARMAN    1
-#define GUARDIAN    2
-#define ARCHER      3
-class Character{
-public:
-    float max_hp;
-    float current_hp;
-    float max_movement;
-    float remaining_movement;
-    int max_actions;
-    int remaining_actions;
-    float range;
-    float damage;
-    int team;
-    int initiative;
-    glm::vec4 position;
-    int role;
-    Free_Camera camera;
-    glm::vec4 facing_vector;
-    bool isAttacking = false;
-
-    void attack();
-    void init_attributes(int type);
-    void take_damage(float delta, int alvo);
-    void end_turn() {
-        remaining_movement = max_movement;
-        remaining_actions = max_actions;
+    void save_state() {
+        previous_position = position;
+        previous_view = view;
     }
-    void set_team(int team_number) {
-        team = team_number;
+    // Leva ao estado anterior uma mudança da órbita (look() ou "distance")
+    // feita fora dos passos da simulação. O ponto "lookat" não muda, então a
+    // posição anterior se desloca tanto quanto a atual, e o deslocamento do
+    // ponto "lookat" no passo (unidade ativa, pan) continua interpolado.
+    void follow_orbit(glm::vec4 old_position) {
+        previous_position += position - old_position;
+        previous_view = view;
     }
-    void draw();
-    void move();
-    void moveFP(glm::vec4 direction);
-
 };
 
 bool moveFoward = false;
@@ -350,16 +607,47 @@ Free_Camera free_camera;
 #define FREE_CAM        2
 int cam_mode;
 
-// Cenário
-Scenary scenary;
-
-// Characters
-std::vector<Character> characters;
-int active_character;
-int target;  // Alvo de um ataque
-
 int main(int argc, char* argv[])
 {
+    // Interpretamos as opções abaixo, em qualquer ordem, e as removemos da
+    // lista de argumentos, pois BuildMeshes() interpreta os argumentos
+    // restantes como modelos ".obj" adicionais.
+    //
+    //   --benchmark    mede o tempo de quadro em uma cena fixa e termina o
+    //                  programa. Veja "benchmark.cpp".
+    //   --fps N        limita o laço principal a N quadros por segundo. Veja
+    //                  "framepacer.cpp".
+    //   --tick-rate N  executa N passos da simulação por segundo (o padrão é
+    //                  SIMULATION_TICK_RATE), independente da taxa de
+    //                  quadros. Veja "simulation.h".
+    bool benchmark_mode = false;
+    int remaining_argc = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if ( strcmp(argv[i], "--benchmark") == 0 )
+        {
+            benchmark_mode = true;
+        }
+        else if ( strcmp(argv[i], "--fps") == 0 || strcmp(argv[i], "--tick-rate") == 0 )
+        {
+            if ( i + 1 >= argc )
+            {
+                fprintf(stderr, "ERROR: argumento \"%s\" sem valor.\n", argv[i]);
+                continue;
+            }
+            if ( strcmp(argv[i], "--fps") == 0 )
+                g_FrameLimitFps = (float)atof(argv[i + 1]);
+            else
+                Simulation_SetTickRate(atof(argv[i + 1]));
+            i += 1;
+        }
+        else
+        {
+            argv[remaining_argc++] = argv[i];
+        }
+    }
+    argc = remaining_argc;
+
     // Inicializamos a biblioteca GLFW, utilizada para criar uma janela do
     // sistema operacional, onde poderemos renderizar com OpenGL.
     int success = glfwInit();
@@ -416,6 +704,10 @@ int main(int argc, char* argv[])
     // biblioteca GLAD.
     gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
 
+    // Carregamento das funções de versões posteriores a OpenGL 3.3, caso o
+    // contexto as suporte. Veja "glextensions.h".
+    GLExtensions_Load((GLEXTloadproc) glfwGetProcAddress);
+
     // Definimos a função de callback que será chamada sempre que a janela for
     // redimensionada, por consequência alterando o tamanho do "framebuffer"
     // (região de memória onde são armazenados os pixels da imagem).
@@ -430,6 +722,10 @@ int main(int argc, char* argv[])
 
     printf("GPU: %s, %s, OpenGL %s, GLSL %s\n", vendor, renderer, glversion, glslversion);
 
+    // Os programas de GPU já linkados em execuções anteriores, para esta
+    // mesma GPU e driver, são carregados de um cache em disco.
+    ShaderCache_Init();
+
     // Carregamos os shaders de vértices e de fragmentos que serão utilizados
     // para renderização. Veja slides 217-219 do documento "Aula_03_Rendering_Pipeline_Grafico.pdf".
     //
@@ -445,9 +741,31 @@ int main(int argc, char* argv[])
     // Construímos a representação de objetos geométricos através de malhas de triângulos
     BuildMeshes(argc, argv);
 
+    // Preparamos o caminho de culling na GPU (somente OpenGL 4.3)
+    GpuCulling_Init(g_SceneVertexArrayObjectId);
+
+    // Preparamos o caminho de renderização "deferred"
+    Deferred_Init();
+    Clustered_Init();
+
+    // Preparamos os shadow maps do sol
+    Shadows_Init(g_SceneVertexArrayObjectId);
+
+    // Preparamos a medida do overdraw do "depth pre-pass"
+    DepthPrepass_Init();
+
+    // Preparamos o framebuffer da cena com resolução dinâmica
+    DynamicResolution_Init();
+
+    // Definimos o vsync e iniciamos a medida do ritmo dos quadros
+    FramePacer_Init(window);
+
     // Inicializamos o código para renderização de texto.
     TextRendering_Init();
 
+    // Inicializamos o HUD retido
+    Hud_Init();
+
     // Habilitamos o Z-buffer. Veja slide 108 do documento "Aula_09_Projecoes.pdf".
     glEnable(GL_DEPTH_TEST);
 
@@ -456,8 +774,8 @@ int main(int argc, char* argv[])
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
 
-    //Habilitando alpha blend
-    glEnable(GL_BLEND);
+    // O alpha blending não fica habilitado: somente o passo de objetos
+    // transparentes de DrawRenderQueue() (e o texto) o utilizam.
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // Variáveis auxiliares utilizadas para chamada à função
@@ -472,23 +790,64 @@ int main(int argc, char* argv[])
     glm::vec4 origin = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
     free_camera.init(lookat_camera.position, origin);
 
-    // Construindo o cenário
+    // A simulação avisa o jogo das mudanças que precisam ser mostradas, e
+    // utiliza o relógio da GLFW nas animações
+    SimulationHooks simulation_hooks = { UpdateHudUnit, UpdateHudUnits, FollowActiveCharacter, PrintAttackHit };
+    Simulation_SetHooks(simulation_hooks);
+    Simulation_SetClock(glfwGetTime);
+
+    // Construindo o cenário e a grade de navegação sobre ele
     scenary.build();
+    Pathfinding_Build(scenary);
 
     // Criamos os personagens
     CreateCharacters(scenary.land_size);
 
     // Iniciando com 1º personagem
     active_character = 0;
+    UpdateHudUnits();
 
     // Câmera começa em 3º pessoa
     cam_mode = THIRD_PERSON;
 
+    // No modo de benchmark, utilizamos a câmera inicial em 3º pessoa, que
+    // mostra o terreno inteiro.
+    if ( benchmark_mode )
+    {
+        float field_of_view = 3.141592 / 2.4f;
+        glm::mat4 view = Matrix_Camera_View(lookat_camera.position, lookat_camera.view, lookat_camera.up);
+        glm::mat4 projection = Matrix_Perspective(field_of_view, 16.0f/9.0f, lookat_camera.nearplane, lookat_camera.farplane);
+        Benchmark_Run(view, projection);
+        glfwTerminate();
+        return 0;
+    }
+
+    // Instante do quadro anterior, e se a cena estava parada nele
+    double previous_frame_time = glfwGetTime();
+    bool scene_static = false;
+
     // Ficamos em loop, renderizando, até que o usuário feche a janela
     while (!glfwWindowShouldClose(window))
     {
+        // Executamos os passos fixos da simulação correspondentes ao tempo
+        // passado desde o quadro anterior. Se a cena estava parada, o tempo
+        // que o limitador de quadros esperou não é simulado, para que o
+        // primeiro movimento depois da espera não dê um salto.
+        double frame_time = glfwGetTime();
+        int ticks = Simulation_AccumulateTime(scene_static ? 0.0 : frame_time - previous_frame_time);
+        previous_frame_time = frame_time;
+        for (int i = 0; i < ticks; ++i)
+            SimulationStep();
+
         // Aqui executamos as operações de renderização
 
+        // A cena 3D é desenhada fora da tela, com a resolução ajustada ao
+        // tempo de GPU dos últimos quadros, e ampliada para a janela antes
+        // do HUD. Veja "dynamicresolution.cpp".
+        int framebuffer_width, framebuffer_height;
+        glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+        DynamicResolution_BeginFrame(framebuffer_width, framebuffer_height);
+
         // Definimos a cor do "fundo" do framebuffer como branco.  Tal cor é
         // definida como coeficientes RGBA: Red, Green, Blue, Alpha; isto é:
         // Vermelho, Verde, Azul, Alpha (valor de transparência).
@@ -501,10 +860,17 @@ int main(int argc, char* argv[])
         // e também resetamos todos os pixels do Z-buffer (depth buffer).
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // Instalamos os shaders recarregados (tecla R) que já ficaram prontos.
+        PollShaderPrograms(false);
+
         // Pedimos para a GPU utilizar o programa de GPU criado acima (contendo
         // os shaders de vértice e fragmentos).
         glUseProgram(program_id);
 
+        // Desenhamos os personagens e as câmeras entre os dois últimos passos
+        // da simulação, pois o quadro raramente coincide com um passo.
+        InterpolateRenderState(Simulation_InterpolationFactor());
+
         // Computamos a matriz "View" utilizando os parâmetros da câmera para
         // definir o sistema de coordenadas da câmera.
         glm::mat4 view;
@@ -569,105 +935,20 @@ int main(int argc, char* argv[])
         // efetivamente aplicadas em todos os pontos.
         glUniformMatrix4fv(view_uniform       , 1 , GL_FALSE , glm::value_ptr(view));
         glUniformMatrix4fv(projection_uniform , 1 , GL_FALSE , glm::value_ptr(projection));
+        g_LastView = view;
+        g_LastProjection = projection;
 
-        #define LAND        0
-        #define WATER       1
-        #define CHAR_TEAM_1 2
-        #define CHAR_TEAM_2 3
-
-        glm::mat4 model = Matrix_Translate(0.0, 0.3, 0.0) * Matrix_Scale(0.5f, 0.5f, 0.5f);
-        glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-        glUniform1i(object_id_uniform, 2);
-        DrawVirtualObject("shield");
-
-        model = Matrix_Translate(0.0, 0.3, 0.0) * Matrix_Scale(0.5f, 0.5f, 0.5f);
-        glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-        glUniform1i(object_id_uniform, 2);
-        DrawVirtualObject("wewe");
-
-        model = Matrix_Translate(0.0, 0.0, 0.0) * Matrix_Scale(1.0f, 1.0f, 1.0f);
-        glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-        glUniform1i(object_id_uniform, 7);
-        DrawVirtualObject("sword");
-
-        model = Matrix_Translate(0.0, 0.0, 0.0) * Matrix_Scale(1.0f, 1.0f, 1.0f);
-        glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-        glUniform1i(object_id_uniform, 7);
-        DrawVirtualObject("armsofsparta");
-
-        // Desenhamos o cenário
-        scenary.draw();
-
-        // Desenhamos os personagens
-        DrawCharacters();
-
-        // Controle de Movimentos
-        glm::vec4 direction = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
-        glm::vec4 foward_vec = glm::vec4(lookat_camera.view.x, 0.0f, lookat_camera.view.z, 0.0f);
-        glm::vec4 right_vec = Matrix_Rotate_Y(-3.1415/2)*foward_vec;
-        switch(cam_mode){
-        case THIRD_PERSON:
-            if ( panLookatRight )
-                lookat_camera.move(right_vec);
-
-            if ( panLookatLeft )
-                lookat_camera.move(-right_vec);
+        // Atualizamos as luzes da cena, que se movem com os personagens.
+        UpdateSceneLights((float)glfwGetTime());
 
-            if ( panLookatUp )
-                lookat_camera.move(foward_vec);
+        // Desenhamos a cena: cenário, personagens e demais objetos.
+        DrawScene(view, projection);
 
-            if ( panLookatDown )
-                lookat_camera.move(-foward_vec);
+        // Ampliamos a cena para a janela, onde o HUD é desenhado com a
+        // resolução nativa.
+        DynamicResolution_EndFrame(framebuffer_width, framebuffer_height);
 
-            if ( rotateLeft ){
-                characters[active_character].facing_vector = characters[active_character].facing_vector*Matrix_Rotate_Y(-0.1);
-                characters[active_character].camera.view = normalize(characters[active_character].facing_vector);
-            }
-
-            if ( rotateRight ){
-                characters[active_character].facing_vector = characters[active_character].facing_vector*Matrix_Rotate_Y(0.1);
-                characters[active_character].camera.view = normalize(characters[active_character].facing_vector);
-            }
-
-            if ( moveFoward )
-                characters[active_character].move();
-
-            break;
-        case FIRST_PERSON:
-            if (moveFoward){
-                characters[active_character].moveFP(characters[active_character].camera.view);
-            }
-
-            if (moveBackwards){
-                characters[active_character].moveFP(-characters[active_character].camera.view);
-            }
-
-            if (moveLeft){
-                characters[active_character].moveFP(-characters[active_character].camera.right);
-            }
-
-            if (moveRight){
-                characters[active_character].moveFP(characters[active_character].camera.right);
-            }
-            break;
-        case FREE_CAM:
-            if (moveFoward)
-                free_camera.move(free_camera.view);
-
-            if (moveBackwards)
-                free_camera.move(-free_camera.view);
-
-            if (moveLeft)
-                free_camera.move(-free_camera.right);
-
-            if (moveRight)
-                free_camera.move(free_camera.right);
-            break;
-        }
-
-        // Testa o final do turno
-        if (characters[active_character].remaining_movement <= 0 && characters[active_character].remaining_actions <= 0)
-            PassTurn();
+        RestoreSimulationState();
 
         // Pegamos um vértice com coordenadas de modelo (0.5, 0.5, 0.5, 1) e o
         // passamos por todos os sistemas de coordenadas armazenados nas
@@ -676,12 +957,21 @@ int main(int argc, char* argv[])
         //glm::vec4 p_model(0.5f, 0.5f, 0.5f, 1.0f);
         //TextRendering_ShowModelViewProjection(window, projection, view, model, p_model);
 
+        // Compomos o HUD retido (cartões das unidades) sobre a cena; somente
+        // os cartões que mudaram desde o último quadro são redesenhados.
+        Hud_Draw(window, framebuffer_width, framebuffer_height);
+
         // Imprimimos na tela informação sobre o número de quadros renderizados
         // por segundo (frames per second).
         TextRendering_ShowFramesPerSecond(window);
 
         TextRendering_ShowCharacterData(window);
 
+        TextRendering_ShowCullingStats(window);
+
+        // Desenhamos, com uma única chamada, todo o texto impresso acima.
+        TextRendering_Flush();
+
         // O framebuffer onde OpenGL executa as operações de renderização não
         // é o mesmo que está sendo mostrado para o usuário, caso contrário
         // seria possível ver artefatos conhecidos como "screen tearing". A
@@ -693,8 +983,10 @@ int main(int argc, char* argv[])
         // Verificamos com o sistema operacional se houve alguma interação do
         // usuário (teclado, mouse, ...). Caso positivo, as funções de callback
         // definidas anteriormente usando glfwSet*Callback() serão chamadas
-        // pela biblioteca GLFW.
-        glfwPollEvents();
+        // pela biblioteca GLFW. Antes, esperamos o início do próximo quadro,
+        // de acordo com o limitador de quadros e com o modo ocioso.
+        scene_static = SceneIsStatic();
+        FramePacer_EndFrame(scene_static);
     }
 
     // Finalizamos o uso dos recursos do sistema operacional
@@ -704,6 +996,396 @@ int main(int argc, char* argv[])
     return 0;
 }
 
+// Função que enfileira todos os objetos da cena (cenário, personagens e
+// demais objetos), aplica o culling, e desenha os objetos visíveis com as
+// matrizes "view" e "projection". Chamada uma vez por quadro pelo laço
+// principal em main(), e também pelo modo de benchmark.
+void DrawScene(glm::mat4 view, glm::mat4 projection)
+{
+    // Extraímos os planos do frustum da câmera atual, utilizados para
+    // descartar os objetos fora do campo de visão. Veja "culling.cpp".
+    Culling_BeginFrame(projection * view);
+    g_DrawnObjects = 0;
+    g_CulledObjects = 0;
+
+    // Limpamos o Z-buffer de baixa resolução onde o cenário será
+    // rasterizado como oclusor. Veja "occlusion.cpp".
+    Occlusion_BeginFrame(projection * view);
+    g_OccludedObjects = 0;
+
+    // No caminho "deferred", os objetos são desenhados no G-buffer. Se este
+    // não pôde ser criado, desenhamos o quadro pelo caminho "forward". No
+    // "clustered", distribuímos as luzes entre os clusters antes de desenhar.
+    // A visualização do overdraw desenha diretamente na tela.
+    g_FrameRenderPath = g_ShowOverdraw ? RENDER_FORWARD : g_RenderPath;
+    if ( g_FrameRenderPath == RENDER_DEFERRED && !Deferred_BeginGeometryPass() )
+        g_FrameRenderPath = RENDER_FORWARD;
+    if ( g_FrameRenderPath == RENDER_CLUSTERED )
+        Clustered_BeginFrame(view, projection, g_SceneLights, g_NightMode ? 0.15f : 1.0f);
+
+    glm::mat4 model = Matrix_Translate(0.0, 0.3, 0.0) * Matrix_Scale(0.5f, 0.5f, 0.5f);
+    QueueVirtualObject("shield", model, 2);
+
+    model = Matrix_Translate(0.0, 0.3, 0.0) * Matrix_Scale(0.5f, 0.5f, 0.5f);
+    QueueVirtualObject("wewe", model, 2);
+
+    model = Matrix_Translate(0.0, 0.0, 0.0) * Matrix_Scale(1.0f, 1.0f, 1.0f);
+    QueueVirtualObject("sword", model, 7);
+
+    model = Matrix_Translate(0.0, 0.0, 0.0) * Matrix_Scale(1.0f, 1.0f, 1.0f);
+    QueueVirtualObject("armsofsparta", model, 7);
+
+    // Desenhamos o cenário
+    scenary.draw();
+
+    // Desenhamos os personagens
+    DrawCharacters();
+
+    // Shadow maps do sol, com os objetos enfileirados acima
+    Shadows_Render(view, projection, g_SunDirection, g_ShadowsEnabled);
+
+    // Enviamos para a GPU os objetos enfileirados acima que passaram no
+    // teste de culling.
+    DrawRenderQueue(view, projection);
+
+    // Iluminação do G-buffer, com as luzes do quadro. O sol é mais fraco no
+    // modo noturno. Os objetos transparentes são desenhados depois, sobre a
+    // cena já composta, com as permutações do caminho "forward".
+    if ( g_FrameRenderPath == RENDER_DEFERRED )
+    {
+        g_FrameRenderPath = RENDER_FORWARD;
+        Deferred_DrawLighting(view, projection, g_SceneLights, g_NightMode ? 0.15f : 1.0f);
+        DrawTransparentQueue(view, projection);
+    }
+}
+
+// Controle de Movimentos: um passo fixo da simulação, com as teclas
+// pressionadas. Chamada pelo laço principal em main() tantas vezes quanto
+// necessário para acompanhar o tempo real; veja Simulation_AccumulateTime().
+void SimulationStep()
+{
+    Simulation_SaveState();
+    lookat_camera.save_state();
+    free_camera.save_state();
+
+    // O caminho escolhido com o mouse foi planejado da posição e do movimento
+    // restante de quando foi escolhido: o movimento pelo teclado o cancela
+    if (moveFoward || moveBackwards || moveLeft || moveRight || rotateLeft || rotateRight)
+        g_MovePathOwner = -1;
+
+    glm::vec4 foward_vec = glm::vec4(lookat_camera.view.x, 0.0f, lookat_camera.view.z, 0.0f);
+    glm::vec4 right_vec = Matrix_Rotate_Y(-3.1415/2)*foward_vec;
+    float turn = 6.0f * (float)Simulation_TickSeconds(); // 0.1 radiano por passo, a 60 passos por segundo
+    switch(cam_mode){
+    case THIRD_PERSON:
+        if ( panLookatRight )
+            lookat_camera.move(right_vec);
+
+        if ( panLookatLeft )
+            lookat_camera.move(-right_vec);
+
+        if ( panLookatUp )
+            lookat_camera.move(foward_vec);
+
+        if ( panLookatDown )
+            lookat_camera.move(-foward_vec);
+
+        if ( rotateLeft ){
+            characters[active_character].facing_vector = characters[active_character].facing_vector*Matrix_Rotate_Y(-turn);
+            characters[active_character].camera.view = normalize(characters[active_character].facing_vector);
+        }
+
+        if ( rotateRight ){
+            characters[active_character].facing_vector = characters[active_character].facing_vector*Matrix_Rotate_Y(turn);
+            characters[active_character].camera.view = normalize(characters[active_character].facing_vector);
+        }
+
+        if ( moveFoward )
+            characters[active_character].move();
+
+        // O personagem segue o caminho escolhido com o mouse, até que seja
+        // movido pelo teclado (veja abaixo)
+        if ( g_MovePathOwner == active_character )
+        {
+            if ( !characters[active_character].follow_path(g_MovePath, g_MovePathNext) )
+                g_MovePathOwner = -1;
+        }
+
+        break;
+    case FIRST_PERSON:
+        if (moveFoward){
+            characters[active_character].moveFP(characters[active_character].camera.view);
+        }
+
+        if (moveBackwards){
+            characters[active_character].moveFP(-characters[active_character].camera.view);
+        }
+
+        if (moveLeft){
+            characters[active_character].moveFP(-characters[active_character].camera.right);
+        }
+
+        if (moveRight){
+            characters[active_character].moveFP(characters[active_character].camera.right);
+        }
+        break;
+    case FREE_CAM:
+        if (moveFoward)
+            free_camera.move(free_camera.view);
+
+        if (moveBackwards)
+            free_camera.move(-free_camera.view);
+
+        if (moveLeft)
+            free_camera.move(-free_camera.right);
+
+        if (moveRight)
+            free_camera.move(free_camera.right);
+        break;
+    }
+
+    // Testa o final do turno
+    if (characters[active_character].remaining_movement <= 0 && characters[active_character].remaining_actions <= 0)
+        PassTurn();
+
+    // O caminho é do personagem que o recebeu, somente no seu turno
+    if (g_MovePathOwner != active_character)
+        g_MovePathOwner = -1;
+}
+
+// Encontra o ponto do terreno sob o cursor, marchando ao longo do raio que
+// sai da câmera, e planeja o caminho de menor custo do personagem ativo até
+// ele com o movimento que lhe resta. Se o ponto está longe demais, o
+// personagem anda até onde for possível em sua direção.
+void MoveActiveCharacterTo(GLFWwindow* window)
+{
+    double cursor_x, cursor_y;
+    int width, height;
+    glfwGetCursorPos(window, &cursor_x, &cursor_y);
+    glfwGetWindowSize(window, &width, &height);
+    if (width <= 0 || height <= 0)
+        return;
+
+    // Coordenadas normalizadas (NDC) do cursor, levadas de volta ao mundo nos
+    // planos "near" e "far"
+    float ndc_x = 2.0f * (float)cursor_x / width - 1.0f;
+    float ndc_y = 1.0f - 2.0f * (float)cursor_y / height;
+    glm::mat4 inverse = glm::inverse(g_LastProjection * g_LastView);
+    glm::vec4 near_point = inverse * glm::vec4(ndc_x, ndc_y, -1.0f, 1.0f);
+    glm::vec4 far_point = inverse * glm::vec4(ndc_x, ndc_y, 1.0f, 1.0f);
+    near_point /= near_point.w;
+    far_point /= far_point.w;
+
+    // A convenção de sinal de "z" de Matrix_Perspective() não importa: o raio
+    // sai do ponto mais próximo da câmera
+    if (norm(far_point - lookat_camera.position) < norm(near_point - lookat_camera.position))
+        std::swap(near_point, far_point);
+
+    glm::vec4 direction = far_point - near_point;
+    float length = norm(direction);
+    if (length <= 0.0f)
+        return;
+    direction /= length;
+
+    float half_x = scenary.land_size.x / 2;
+    float half_z = scenary.land_size.z / 2;
+    const float ray_step = 0.01f;
+    for (float t = 0.0f; t < length; t += ray_step)
+    {
+        glm::vec4 point = near_point + t * direction;
+        if (point.x < -half_x || point.x > half_x || point.z < -half_z || point.z > half_z)
+            continue;
+
+        float heigth = scenary.heigth(point);
+        if (point.y > heigth)
+            continue;
+
+        // Clique na água: não há para onde ir
+        if (heigth < 0.0f)
+            return;
+
+        Character& character = characters[active_character];
+        Pathfinding_FindPath(character.position, point, character.remaining_movement, g_MovePath);
+        g_MovePathNext = 0;
+        g_MovePathOwner = g_MovePath.empty() ? -1 : active_character;
+        return;
+    }
+}
+
+// Estado da simulação substituído por InterpolateRenderState(): somente os
+// campos interpolados de cada personagem, em um vetor reutilizado entre os
+// quadros.
+struct SavedCharacterState
+{
+    glm::vec4 position;
+    glm::vec4 facing_vector;
+    glm::vec4 camera_position;
+    glm::vec4 camera_view;
+};
+static std::vector<SavedCharacterState> saved_characters;
+static glm::vec4 saved_lookat_position, saved_lookat_view;
+static glm::vec4 saved_free_position, saved_free_view;
+
+// Substitui as posições e direções dos personagens e das câmeras pelas
+// interpoladas entre o passo anterior e o atual, com peso "alpha" no atual.
+// O estado da simulação é guardado, e deve ser devolvido com
+// RestoreSimulationState() depois de desenhar a cena.
+void InterpolateRenderState(float alpha)
+{
+    saved_characters.resize(characters.size());
+    for (size_t i = 0; i < characters.size(); ++i)
+    {
+        Character& character = characters[i];
+        SavedCharacterState& saved = saved_characters[i];
+        saved.position = character.position;
+        saved.facing_vector = character.facing_vector;
+        saved.camera_position = character.camera.position;
+        saved.camera_view = character.camera.view;
+
+        character.position = glm::mix(character.previous_position, character.position, alpha);
+        character.facing_vector = normalize(glm::mix(character.previous_facing_vector, character.facing_vector, alpha));
+        character.camera.position = glm::mix(character.camera.previous_position, character.camera.position, alpha);
+        character.camera.view = normalize(glm::mix(character.camera.previous_view, character.camera.view, alpha));
+    }
+
+    saved_lookat_position = lookat_camera.position;
+    saved_lookat_view = lookat_camera.view;
+    lookat_camera.position = glm::mix(lookat_camera.previous_position, lookat_camera.position, alpha);
+    lookat_camera.view = normalize(glm::mix(lookat_camera.previous_view, lookat_camera.view, alpha));
+
+    saved_free_position = free_camera.position;
+    saved_free_view = free_camera.view;
+    free_camera.position = glm::mix(free_camera.previous_position, free_camera.position, alpha);
+    free_camera.view = normalize(glm::mix(free_camera.previous_view, free_camera.view, alpha));
+}
+
+void RestoreSimulationState()
+{
+    // O desenho não cria nem remove personagens. Ele pode ter terminado a
+    // animação de ataque ("isAttacking"), que não é interpolada; devolvemos
+    // somente o que foi substituído.
+    assert(saved_characters.size() == characters.size());
+    for (size_t i = 0; i < saved_characters.size(); ++i)
+    {
+        const SavedCharacterState& saved = saved_characters[i];
+        characters[i].position = saved.position;
+        characters[i].facing_vector = saved.facing_vector;
+        characters[i].camera.position = saved.camera_position;
+        characters[i].camera.view = saved.camera_view;
+    }
+
+    lookat_camera.position = saved_lookat_position;
+    lookat_camera.view = saved_lookat_view;
+    free_camera.position = saved_free_position;
+    free_camera.view = saved_free_view;
+}
+
+// Função que indica se nada se move na cena: nenhum personagem ou câmera
+// sendo movido pelo teclado ou mouse, e nenhuma animação de ataque em
+// andamento. Utilizada pelo modo ocioso de "framepacer.cpp".
+bool SceneIsStatic()
+{
+    if ( moveFoward || moveBackwards || moveLeft || moveRight || rotateLeft || rotateRight )
+        return false;
+
+    if ( panLookatRight || panLookatLeft || panLookatUp || panLookatDown )
+        return false;
+
+    if ( g_LeftMouseButtonPressed || g_RightMouseButtonPressed || g_MiddleMouseButtonPressed )
+        return false;
+
+    if ( g_ShaderReloadInProgress )
+        return false;
+
+    if ( g_MovePathOwner >= 0 )
+        return false;
+
+    for (size_t i = 0; i < characters.size(); ++i)
+        if ( characters[i].isAttacking )
+            return false;
+
+    return true;
+}
+
+// Número de fogueiras em cada direção do terreno no modo noturno
+#define CAMPFIRES_PER_SIDE 16
+
+// Função que monta a lista de luzes do quadro, g_SceneLights, no instante
+// "time" (em segundos), utilizado para a chama das tochas e fogueiras.
+void UpdateSceneLights(float time)
+{
+    g_SceneLights.clear();
+
+    // Uma tocha acima de cada personagem
+    for (size_t i = 0; i < characters.size(); ++i)
+    {
+        const Character& character = characters[i];
+        float flicker = 1.0f + 0.15f * sinf(13.0f*time + 1.7f*i) * sinf(7.0f*time + 0.9f*i);
+
+        SceneLight torch;
+        torch.position_radius = glm::vec4(character.position.x, character.position.y + 0.25f, character.position.z, 0.6f);
+        torch.color           = flicker * glm::vec4(1.0f, 0.55f, 0.2f, 1.0f);
+        torch.spot_direction  = glm::vec4(0.0f, -1.0f, 0.0f, -1.0f);
+        g_SceneLights.push_back(torch);
+    }
+
+    // Feitiço do personagem ativo: um spot na direção em que ele está virado
+    if ( !characters.empty() )
+    {
+        const Character& character = characters[active_character];
+        glm::vec4 direction = normalize(character.facing_vector - glm::vec4(0.0f, 0.3f, 0.0f, 0.0f));
+
+        SceneLight spell;
+        spell.position_radius = glm::vec4(character.position.x, character.position.y + 0.2f, character.position.z, 1.5f);
+        spell.color           = glm::vec4(0.4f, 0.6f, 2.0f, 1.0f);
+        spell.spot_direction  = glm::vec4(direction.x, direction.y, direction.z, cosf(0.4f));
+        g_SceneLights.push_back(spell);
+    }
+
+    if ( !g_NightMode )
+        return;
+
+    // Fogueiras em uma grade sobre o terreno, com posições levemente
+    // deslocadas e chamas fora de fase. As alturas de todas são calculadas
+    // de uma vez só.
+    float campfire_x[CAMPFIRES_PER_SIDE*CAMPFIRES_PER_SIDE];
+    float campfire_z[CAMPFIRES_PER_SIDE*CAMPFIRES_PER_SIDE];
+    float campfire_height[CAMPFIRES_PER_SIDE*CAMPFIRES_PER_SIDE];
+    for (int i = 0; i < CAMPFIRES_PER_SIDE; ++i)
+    {
+        for (int j = 0; j < CAMPFIRES_PER_SIDE; ++j)
+        {
+            float phase = (float)(7*i + 13*j);
+            float u = (i + 0.5f + 0.3f*sinf(phase)) / CAMPFIRES_PER_SIDE - 0.5f;
+            float v = (j + 0.5f + 0.3f*cosf(phase)) / CAMPFIRES_PER_SIDE - 0.5f;
+            campfire_x[i*CAMPFIRES_PER_SIDE + j] = u * scenary.land_size.x;
+            campfire_z[i*CAMPFIRES_PER_SIDE + j] = v * scenary.land_size.z;
+        }
+    }
+    scenary.heigths(campfire_x, campfire_z, campfire_height, CAMPFIRES_PER_SIDE*CAMPFIRES_PER_SIDE);
+
+    for (int i = 0; i < CAMPFIRES_PER_SIDE; ++i)
+    {
+        for (int j = 0; j < CAMPFIRES_PER_SIDE; ++j)
+        {
+            float phase = (float)(7*i + 13*j);
+            glm::vec4 position = glm::vec4(campfire_x[i*CAMPFIRES_PER_SIDE + j], 0.0f, campfire_z[i*CAMPFIRES_PER_SIDE + j], 1.0f);
+
+            float height = campfire_height[i*CAMPFIRES_PER_SIDE + j];
+            if ( height < 0.0f )
+                continue;
+
+            float flicker = 1.0f + 0.25f * sinf(11.0f*time + phase) * sinf(5.0f*time + 2.0f*phase);
+
+            SceneLight campfire;
+            campfire.position_radius = glm::vec4(position.x, height + 0.05f, position.z, 0.35f);
+            campfire.color           = flicker * glm::vec4(1.0f, 0.4f, 0.1f, 1.0f);
+            campfire.spot_direction  = glm::vec4(0.0f, -1.0f, 0.0f, -1.0f);
+            g_SceneLights.push_back(campfire);
+        }
+    }
+}
+
 // Função que carrega uma imagem para ser utilizada como textura
 void LoadTextureImage(const char* filename)
 {
@@ -761,16 +1443,23 @@ void LoadTextureImage(const char* filename)
 // Função que desenha um objeto armazenado em g_VirtualScene. Veja definição
 // dos objetos na função BuildTrianglesAndAddToVirtualScene().
 void DrawVirtualObject(const char* object_name)
+{
+    DrawVirtualObject(g_VirtualScene[object_name]);
+}
+
+// Versão da função acima que recebe diretamente o objeto, evitando as buscas
+// por nome em g_VirtualScene. Utilizada por DrawRenderQueue().
+void DrawVirtualObject(const SceneObject& object)
 {
     // "Ligamos" o VAO. Informamos que queremos utilizar os atributos de
     // vértices apontados pelo VAO criado pela função BuildTrianglesAndAddToVirtualScene(). Veja
     // comentários detalhados dentro da definição de BuildTrianglesAndAddToVirtualScene().
-    glBindVertexArray(g_VirtualScene[object_name].vertex_array_object_id);
+    glBindVertexArray(object.vertex_array_object_id);
 
     // Setamos as variáveis "bbox_min" e "bbox_max" do fragment shader
     // com os parâmetros da axis-aligned bounding box (AABB) do modelo.
-    glm::vec3 bbox_min = g_VirtualScene[object_name].bbox_min;
-    glm::vec3 bbox_max = g_VirtualScene[object_name].bbox_max;
+    glm::vec3 bbox_min = object.bbox_min;
+    glm::vec3 bbox_max = object.bbox_max;
     glUniform4f(bbox_min_uniform, bbox_min.x, bbox_min.y, bbox_min.z, 1.0f);
     glUniform4f(bbox_max_uniform, bbox_max.x, bbox_max.y, bbox_max.z, 1.0f);
 
@@ -780,10 +1469,10 @@ void DrawVirtualObject(const char* object_name)
     // a documentação da função glDrawElements() em
     // http://docs.gl/gl3/glDrawElements.
     glDrawElements(
-        g_VirtualScene[object_name].rendering_mode,
-        g_VirtualScene[object_name].num_indices,
+        object.rendering_mode,
+        object.num_indices,
         GL_UNSIGNED_INT,
-        (void*)g_VirtualScene[object_name].first_index
+        (void*)(object.first_index * sizeof(GLuint))
     );
 
     // "Desligamos" o VAO, evitando assim que operações posteriores venham a
@@ -791,6 +1480,349 @@ void DrawVirtualObject(const char* object_name)
     glBindVertexArray(0);
 }
 
+// Função que enfileira um objeto armazenado em g_VirtualScene para ser
+// desenhado com a matriz de modelagem "model" ao final do quadro, por
+// DrawRenderQueue(). Também computamos aqui a AABB do objeto em coordenadas
+// globais, utilizada pelo frustum culling.
+void QueueVirtualObject(const char* object_name, glm::mat4 model, int object_id)
+{
+    DrawCommand command;
+    command.object    = &g_VirtualScene[object_name];
+    command.model     = model;
+    command.object_id = object_id;
+    command.program   = ProgramForObject(object_id);
+
+    // Todos os objetos, exceto a água, projetam sombra. A terra e os
+    // planaltos não se movem, e ficam no cache estático das sombras.
+    if (g_ShadowsEnabled && object_id != WATER)
+        Shadows_AddCaster(model, command.object->bbox_min, command.object->bbox_max,
+                          command.object->first_index, command.object->num_indices, object_id == LAND);
+
+    // Quando o culling é feito na GPU, nenhum trabalho por objeto é feito aqui.
+    if (g_GpuCullingEnabled)
+    {
+        command.cull_index = -1;
+        g_RenderQueue.push_back(command);
+        return;
+    }
+
+    Culling_TransformAABB(model, command.object->bbox_min, command.object->bbox_max, command.world_min, command.world_max);
+    command.cull_index = Culling_AddBox(command.world_min, command.world_max);
+
+    g_RenderQueue.push_back(command);
+}
+
+// Objetos transparentes, desenhados com alpha blending depois de todos os
+// objetos opacos. No caminho "deferred", o G-buffer não suporta blending;
+// eles são desenhados pelo caminho "forward" depois da composição, que
+// escreve a profundidade da cena. Veja DrawScene().
+static bool IsTransparent(const DrawCommand& command)
+{
+    return command.object_id == WATER;
+}
+
+// Largura, em unidades do mundo, das faixas de distância em que os objetos
+// opacos são agrupados por permutação
+#define SORT_DEPTH_BUCKET 0.5f
+
+// Critérios de ordenação dos comandos de desenho em DrawRenderQueue(). Os
+// opacos são desenhados da frente para trás, para que o teste de
+// profundidade descarte os fragmentos escondidos antes do fragment shader
+// ("early-Z"). A distância é arredondada para faixas de SORT_DEPTH_BUCKET, e
+// dentro de cada faixa os objetos são agrupados pela permutação, para trocar
+// menos de programa; a ordem exata só desfaz os empates restantes. Os
+// transparentes são desenhados de trás para frente, para que o blending os
+// combine na ordem correta.
+static bool CompareFrontToBack(const DrawCommand* a, const DrawCommand* b)
+{
+    if (a->depth_bucket != b->depth_bucket)
+        return a->depth_bucket < b->depth_bucket;
+    if (a->program->draw_order != b->program->draw_order)
+        return a->program->draw_order < b->program->draw_order;
+    return a->sort_depth < b->sort_depth;
+}
+
+// Faixa de distância de um objeto opaco com "sort_depth" já calculado
+static int DepthBucket(float sort_depth)
+{
+    return (int)(sqrt(sort_depth) / SORT_DEPTH_BUCKET);
+}
+
+static bool CompareBackToFront(const DrawCommand* a, const DrawCommand* b)
+{
+    return a->sort_depth > b->sort_depth;
+}
+
+// Distância ao quadrado entre "camera_position" e o ponto da caixa
+// [world_min, world_max] mais próximo dela. É zero quando a câmera está
+// dentro da caixa (ex: o terreno), que então é desenhada primeiro.
+static float DistanceToBox(glm::vec4 camera_position, glm::vec3 world_min, glm::vec3 world_max)
+{
+    glm::vec3 c = glm::vec3(camera_position);
+    glm::vec3 d = glm::max(glm::max(world_min - c, c - world_max), glm::vec3(0.0f));
+    return glm::dot(d, d);
+}
+
+// Desenha, na ordem dada, os comandos de "commands", trocando de programa
+// somente quando a permutação muda.
+static void DrawCommandList(const std::vector<const DrawCommand*>& commands, const glm::mat4& view, const glm::mat4& projection, glm::vec4 camera_position)
+{
+    const ShaderProgram* current = NULL;
+
+    glBindVertexArray(g_SceneVertexArrayObjectId);
+    for (size_t i = 0; i < commands.size(); ++i)
+    {
+        const DrawCommand& command = *commands[i];
+        const SceneObject& object = *command.object;
+
+        if (command.program != current)
+        {
+            current = command.program;
+            glUseProgram(current->program_id);
+            glUniformMatrix4fv(current->view_uniform       , 1 , GL_FALSE , glm::value_ptr(view));
+            glUniformMatrix4fv(current->projection_uniform , 1 , GL_FALSE , glm::value_ptr(projection));
+            glUniform4f(current->camera_position_uniform, camera_position.x, camera_position.y, camera_position.z, 1.0f);
+        }
+
+        // A matriz das normais é computada aqui uma vez por objeto, ao invés
+        // de uma vez por vértice em "shader_vertex.glsl".
+        glm::mat4 normal_matrix = glm::inverseTranspose(command.model);
+
+        glUniformMatrix4fv(current->model_uniform, 1 , GL_FALSE , glm::value_ptr(command.model));
+        glUniformMatrix4fv(current->normal_matrix_uniform, 1 , GL_FALSE , glm::value_ptr(normal_matrix));
+        glUniform1i(current->object_id_uniform, command.object_id);
+        glUniform4f(current->bbox_min_uniform, object.bbox_min.x, object.bbox_min.y, object.bbox_min.z, 1.0f);
+        glUniform4f(current->bbox_max_uniform, object.bbox_max.x, object.bbox_max.y, object.bbox_max.z, 1.0f);
+        glDrawElements(object.rendering_mode, object.num_indices, GL_UNSIGNED_INT, (void*)(object.first_index * sizeof(GLuint)));
+    }
+    glBindVertexArray(0);
+}
+
+// Desenha, na ordem dada, somente a profundidade dos comandos de
+// "commands" (ou, com "overdraw", a cor da visualização do overdraw), com
+// um único programa. Veja "depthprepass.cpp".
+static void DrawDepthList(const std::vector<const DrawCommand*>& commands, const glm::mat4& view, const glm::mat4& projection, bool overdraw)
+{
+    GLint model_uniform = DepthPrepass_UseProgram(view, projection, overdraw);
+
+    glBindVertexArray(g_SceneVertexArrayObjectId);
+    for (size_t i = 0; i < commands.size(); ++i)
+    {
+        const SceneObject& object = *commands[i]->object;
+        glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(commands[i]->model));
+        glDrawElements(object.rendering_mode, object.num_indices, GL_UNSIGNED_INT, (void*)(object.first_index * sizeof(GLuint)));
+    }
+    glBindVertexArray(0);
+}
+
+// Programas de cada passo de DrawRenderQueue(): as permutações de cada
+// objeto, somente profundidade ("depth pre-pass"), ou a visualização do
+// overdraw. Os valores negativos são os mesmos de GpuCulling_DrawCulled().
+#define PASS_COLOR     0
+#define PASS_DEPTH    -1
+#define PASS_OVERDRAW -2
+
+// Desenha os comandos de "commands" com o programa do passo "pass". No
+// culling na GPU, desenha os objetos do último GpuCulling_Cull(), que
+// devem ser os mesmos de "commands".
+static void DrawPass(const std::vector<const DrawCommand*>& commands, const glm::mat4& view, const glm::mat4& projection, glm::vec4 camera_position, int pass)
+{
+    if (g_GpuCullingEnabled)
+        GpuCulling_DrawCulled(view, projection, pass == PASS_COLOR ? g_FrameRenderPath : pass);
+    else if (pass == PASS_COLOR)
+        DrawCommandList(commands, view, projection, camera_position);
+    else
+        DrawDepthList(commands, view, projection, pass == PASS_OVERDRAW);
+}
+
+// Envia os comandos de "commands" para o culling na GPU
+static void CullOnGpu(const std::vector<const DrawCommand*>& commands, const glm::mat4& view, const glm::mat4& projection)
+{
+    for (size_t i = 0; i < commands.size(); ++i)
+    {
+        const DrawCommand& command = *commands[i];
+        GpuCulling_AddInstance(command.model, command.object->bbox_min, command.object->bbox_max,
+                               command.object_id, command.object->first_index, command.object->num_indices);
+    }
+    GpuCulling_Cull(view, projection, g_FrustumCullingEnabled);
+}
+
+// Estado do OpenGL do passo de objetos transparentes: blending ligado, e
+// Z-buffer somente testado, sem escrita, para que um objeto transparente não
+// esconda outro desenhado depois dele. Na visualização do overdraw, o
+// blending já está ligado, somando as cores.
+static void BeginTransparentPass()
+{
+    glEnable(GL_BLEND);
+    if (!g_ShowOverdraw)
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+}
+
+static void EndTransparentPass()
+{
+    glDepthMask(GL_TRUE);
+    if (!g_ShowOverdraw)
+        glDisable(GL_BLEND);
+}
+
+// Função que desenha todos os objetos enfileirados no quadro atual, em dois
+// passos: primeiro os objetos opacos, sem blending, da frente para trás, e
+// depois os transparentes (água), com blending, de trás para frente. No
+// caminho "deferred", o segundo passo fica para depois da iluminação do
+// G-buffer; veja DrawTransparentQueue().
+//
+// Se o "depth pre-pass" estiver ativo (veja "depthprepass.cpp"), os objetos
+// opacos são desenhados duas vezes: primeiro somente a profundidade, e
+// depois a cor, com glDepthFunc(GL_EQUAL) e sem escrita no Z-buffer. O passo
+// que testa a profundidade com GL_LESS é medido, para estimar o overdraw.
+//
+// Com OpenGL 4.3 (e g_GpuCullingEnabled), os objetos de cada passo são
+// enviados para a GPU, que faz o culling e desenha tudo com uma única
+// chamada. Veja "gpuculling.cpp". Neste caso a distância de cada objeto é
+// medida até a origem do seu sistema de coordenadas, para não computarmos
+// AABBs no CPU.
+//
+// Caso contrário, testamos em lote as AABBs de todos os objetos contra o
+// frustum da câmera (veja "culling.cpp"), compactamos os objetos visíveis em
+// listas de comandos de desenho ordenadas, e as percorremos no CPU, com o
+// VAO compartilhado ligado uma única vez.
+void DrawRenderQueue(glm::mat4 view, glm::mat4 projection)
+{
+    // Posição da câmera em coordenadas globais, enviada para o fragment shader
+    glm::vec4 camera_position = glm::inverse(view)[3];
+
+    static std::vector<const DrawCommand*> opaque_commands;
+    std::vector<const DrawCommand*>& transparent_commands = g_TransparentCommands;
+    opaque_commands.clear();
+    transparent_commands.clear();
+
+    if (g_GpuCullingEnabled)
+    {
+        for (size_t i = 0; i < g_RenderQueue.size(); ++i)
+        {
+            DrawCommand& command = g_RenderQueue[i];
+            glm::vec4 offset = command.model[3] - camera_position;
+            command.sort_depth = glm::dot(offset, offset);
+            command.depth_bucket = DepthBucket(command.sort_depth);
+            if (IsTransparent(command))
+                transparent_commands.push_back(&command);
+            else
+                opaque_commands.push_back(&command);
+        }
+    }
+    else
+    {
+        Culling_Run();
+
+        for (size_t i = 0; i < g_RenderQueue.size(); ++i)
+        {
+            DrawCommand& command = g_RenderQueue[i];
+
+            if (g_FrustumCullingEnabled && !Culling_IsVisible(command.cull_index))
+            {
+                g_CulledObjects += 1;
+                continue;
+            }
+
+            if (IsTransparent(command))
+            {
+                // Objetos transparentes são ordenados pelo centro da AABB
+                glm::vec3 offset = 0.5f * (command.world_min + command.world_max) - glm::vec3(camera_position);
+                command.sort_depth = glm::dot(offset, offset);
+                transparent_commands.push_back(&command);
+            }
+            else
+            {
+                command.sort_depth = DistanceToBox(camera_position, command.world_min, command.world_max);
+                command.depth_bucket = DepthBucket(command.sort_depth);
+                opaque_commands.push_back(&command);
+            }
+        }
+    }
+
+    std::sort(opaque_commands.begin(), opaque_commands.end(), CompareFrontToBack);
+    std::sort(transparent_commands.begin(), transparent_commands.end(), CompareBackToFront);
+
+    // Na visualização do overdraw, cada fragmento soma uma cor constante a
+    // um fundo preto. O Z-buffer, já limpo, é mantido.
+    int color_pass = PASS_COLOR;
+    if (g_ShowOverdraw)
+    {
+        color_pass = PASS_OVERDRAW;
+
+        GLfloat clear_color[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+    }
+
+    if (g_GpuCullingEnabled)
+        CullOnGpu(opaque_commands, view, projection);
+
+    if (DepthPrepass_BeginFrame())
+    {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        DepthPrepass_BeginMeasure();
+        DrawPass(opaque_commands, view, projection, camera_position, PASS_DEPTH);
+        DepthPrepass_EndMeasure();
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+        DrawPass(opaque_commands, view, projection, camera_position, color_pass);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+    else
+    {
+        DepthPrepass_BeginMeasure();
+        DrawPass(opaque_commands, view, projection, camera_position, color_pass);
+        DepthPrepass_EndMeasure();
+    }
+
+    if (g_GpuCullingEnabled)
+        g_DrawnObjects = g_RenderQueue.size();
+    else
+        g_DrawnObjects = opaque_commands.size() + transparent_commands.size();
+
+    if (g_FrameRenderPath != RENDER_DEFERRED)
+        DrawTransparentQueue(view, projection);
+}
+
+// Segundo passo de DrawRenderQueue(): desenha os objetos transparentes, com
+// blending, sobre os opacos já desenhados, e esvazia a fila de desenho.
+void DrawTransparentQueue(glm::mat4 view, glm::mat4 projection)
+{
+    glm::vec4 camera_position = glm::inverse(view)[3];
+    int color_pass = g_ShowOverdraw ? PASS_OVERDRAW : PASS_COLOR;
+
+    if (!g_TransparentCommands.empty())
+    {
+        if (g_GpuCullingEnabled)
+            CullOnGpu(g_TransparentCommands, view, projection);
+
+        BeginTransparentPass();
+        DrawPass(g_TransparentCommands, view, projection, camera_position, color_pass);
+        EndTransparentPass();
+    }
+
+    if (g_ShowOverdraw)
+    {
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_BLEND);
+    }
+
+    glUseProgram(program_id);
+
+    g_TransparentCommands.clear();
+    g_RenderQueue.clear();
+}
+
 // Função que carrega os shaders de vértices e de fragmentos que serão
 // utilizados para renderização. Veja slides 217-219 do documento "Aula_03_Rendering_Pipeline_Grafico.pdf".
 //
@@ -814,33 +1846,327 @@ void LoadShadersFromFiles()
     //       |
     //       o-- shader_fragment.glsl
     //
-    vertex_shader_id = LoadShader_Vertex("../../src/shader_vertex.glsl");
-    fragment_shader_id = LoadShader_Fragment("../../src/shader_fragment.glsl");
 
-    // Deletamos o programa de GPU anterior, caso ele exista.
-    if ( program_id != 0 )
-        glDeleteProgram(program_id);
+    // Os shaders são compilados em várias permutações, uma para cada
+    // material (veja o início de "shader_fragment.glsl"). As permutações
+    // anteriores, caso existam, são substituídas pelas novas. A ordem de
+    // desenho coloca a água por último, pois ela é transparente.
+    RequestMaterialShaderPrograms();
 
-    // Criamos um programa de GPU utilizando os shaders carregados acima.
-    program_id = CreateGpuProgram(vertex_shader_id, fragment_shader_id);
+    // Esperamos a compilação de todas as permutações.
+    PollShaderPrograms(true);
+
+    for (int path = 0; path < NUM_RENDER_PATHS; ++path)
+    {
+        g_ObjectPrograms[path][LAND]        = &g_ShaderPrograms[RenderPathShaderKey("MATERIAL_LAND", path)];
+        g_ObjectPrograms[path][CHAR_TEAM_1] = &g_ShaderPrograms[RenderPathShaderKey("MATERIAL_CHARACTER", path)];
+        g_ObjectPrograms[path][CHAR_TEAM_2] = g_ObjectPrograms[path][CHAR_TEAM_1];
+        g_ObjectPrograms[path][WATER]       = &g_ShaderPrograms[RenderPathShaderKey("MATERIAL_WATER", path)];
+        g_DefaultPrograms[path]             = &g_ShaderPrograms[RenderPathShaderKey("", path)];
+    }
+
+    LoadRenderPathShaders();
+}
+
+// Chave em g_ShaderPrograms da permutação com o material "material" (ou
+// nenhum, se vazio) para o caminho de renderização "path".
+std::string RenderPathShaderKey(const std::string& material, int path)
+{
+    std::string path_define = g_RenderPathDefines[path];
+    if ( material.empty() || path_define.empty() )
+        return material + path_define;
+    return material + " " + path_define;
+}
+
+// Pede a compilação de todas as permutações utilizadas por ProgramForObject(),
+// para todos os caminhos de renderização.
+void RequestMaterialShaderPrograms()
+{
+    for (int path = 0; path < NUM_RENDER_PATHS; ++path)
+    {
+        RequestShaderProgram(RenderPathShaderKey("MATERIAL_LAND", path).c_str(), 0);
+        RequestShaderProgram(RenderPathShaderKey("MATERIAL_CHARACTER", path).c_str(), 1);
+        RequestShaderProgram(RenderPathShaderKey("", path).c_str(), 2);
+        RequestShaderProgram(RenderPathShaderKey("MATERIAL_WATER", path).c_str(), 3);
+    }
+}
+
+// Carrega os demais shaders dos caminhos de culling na GPU e "deferred", e
+// do "depth pre-pass", esperando a sua compilação.
+void LoadRenderPathShaders()
+{
+    RequestRenderPathShaders();
+    PollRenderPathShaders(true);
+}
+
+// Pede a compilação dos shaders de LoadRenderPathShaders(). Os programas
+// atuais continuam em uso até que os novos estejam linkados; veja
+// PollRenderPathShaders().
+void RequestRenderPathShaders()
+{
+    // Variantes dos shaders acima para o caminho de culling na GPU, uma para
+    // cada caminho de renderização.
+    GpuCulling_RequestShaders(g_RenderPathDefines, NUM_RENDER_PATHS);
+
+    // Volumes de luz e composição do caminho "deferred"
+    Deferred_RequestShaders();
+
+    // Variantes de "shader_vertex.glsl" do "depth pre-pass"
+    DepthPrepass_RequestShaders();
+}
+
+// Instala os programas pedidos por RequestRenderPathShaders() que já foram
+// linkados. Quando não há mais nenhum pendente, desativa os caminhos cujos
+// shaders não puderam ser carregados e retorna verdadeiro.
+bool PollRenderPathShaders(bool wait)
+{
+    bool done = GpuCulling_PollShaders(wait);
+    done = Deferred_PollShaders(wait) && done;
+    done = DepthPrepass_PollShaders(wait) && done;
+    if (!done)
+        return false;
+
+    if (!GpuCulling_IsSupported())
+        g_GpuCullingEnabled = false;
+    if (!Deferred_IsSupported() && g_RenderPath == RENDER_DEFERRED)
+        g_RenderPath = RENDER_FORWARD;
+    return true;
+}
+
+// Versão de LoadShadersFromFiles() utilizada pela tecla R: os shaders são
+// compilados enquanto continuamos desenhando com os programas atuais, que
+// são substituídos por PollShaderPrograms(), chamada a cada quadro, à medida
+// que as novas permutações ficam prontas.
+void ReloadShadersFromFiles()
+{
+    RequestMaterialShaderPrograms();
+    RequestRenderPathShaders();
+    g_ShaderReloadInProgress = true;
+}
+
+// Função que retorna a permutação dos shaders compilada com os #define
+// listados em "defines" (separados por espaço), compilando-a na primeira vez
+// em que é pedida. Os programas ficam em g_ShaderPrograms até que sejam
+// substituídos por uma nova compilação da mesma permutação.
+ShaderProgram* GetShaderProgram(const char* defines, int draw_order)
+{
+    std::map<std::string, ShaderProgram>::iterator it = g_ShaderPrograms.find(defines);
+    if ( it != g_ShaderPrograms.end() )
+        return &it->second;
+
+    RequestShaderProgram(defines, draw_order);
+    PollShaderPrograms(true);
+
+    return &g_ShaderPrograms[defines];
+}
+
+// Substitui a permutação "key" de g_ShaderPrograms pelo programa já linkado
+// "new_program_id". O ShaderProgram é alterado no lugar, para que os
+// ponteiros em g_ObjectPrograms e nos comandos de desenho continuem válidos.
+static void InstallShaderProgram(const std::string& key, int draw_order, GLuint new_program_id)
+{
+    ShaderProgram& program = g_ShaderPrograms[key];
+    if ( program.program_id != 0 )
+        glDeleteProgram(program.program_id);
+
+    program.program_id         = new_program_id;
+    program.draw_order         = draw_order;
+    program.model_uniform      = glGetUniformLocation(program.program_id, "model");
+    program.view_uniform       = glGetUniformLocation(program.program_id, "view");
+    program.projection_uniform = glGetUniformLocation(program.program_id, "projection");
+    program.object_id_uniform  = glGetUniformLocation(program.program_id, "object_id");
+    program.bbox_min_uniform   = glGetUniformLocation(program.program_id, "bbox_min");
+    program.bbox_max_uniform   = glGetUniformLocation(program.program_id, "bbox_max");
+    program.normal_matrix_uniform   = glGetUniformLocation(program.program_id, "normal_matrix");
+    program.camera_position_uniform = glGetUniformLocation(program.program_id, "camera_position");
+
+    // Variáveis em "shader_fragment.glsl" que não mudam entre quadros
+    SetupTextureUnits(program.program_id);
+    SetupTeamColors(program.program_id);
+
+    // A permutação sem material é a utilizada por objetos sem material
+    // próprio. As variáveis abaixo continuam se referindo a ela, pois são
+    // utilizadas por DrawVirtualObject().
+    if ( key.empty() )
+    {
+        program_id         = program.program_id;
+        model_uniform      = program.model_uniform;
+        view_uniform       = program.view_uniform;
+        projection_uniform = program.projection_uniform;
+        object_id_uniform  = program.object_id_uniform;
+        bbox_min_uniform   = program.bbox_min_uniform;
+        bbox_max_uniform   = program.bbox_max_uniform;
+    }
+}
+
+// Inicia a compilação da permutação dos shaders com os #define listados em
+// "defines" (separados por espaço). Se o programa está no cache em disco, ele
+// é instalado imediatamente; senão, os shaders são enviados ao driver e a
+// permutação fica em g_PendingShaderPrograms até que PollShaderPrograms()
+// encontre a linkagem terminada. Não consultamos o resultado da compilação
+// aqui, pois isto obrigaria o driver a terminá-la.
+void RequestShaderProgram(const char* defines, int draw_order)
+{
+    // Cabeçalho que substitui a linha "#version" dos arquivos
+    std::string header = "#version 330 core\n";
+    std::stringstream names(std::string(defines) + " " + g_ShaderExtraDefines);
+    std::string name;
+    while ( names >> name )
+        header += "#define " + name + "\n";
+
+    std::string vertex_source   = ReadShaderSource("../../src/shader_vertex.glsl", header.c_str());
+    std::string fragment_source = ReadShaderSource("../../src/shader_fragment.glsl", header.c_str());
+
+    PendingShaderProgram pending;
+    pending.key        = defines;
+    pending.draw_order = draw_order;
+    pending.sources    = vertex_source + '\0' + fragment_source;
+
+    // Um pedido anterior da mesma permutação, ainda não terminado, é
+    // descartado.
+    for (size_t i = 0; i < g_PendingShaderPrograms.size(); ++i)
+    {
+        PendingShaderProgram& old = g_PendingShaderPrograms[i];
+        if ( old.key == pending.key )
+        {
+            glDeleteShader(old.vertex_shader_id);
+            glDeleteShader(old.fragment_shader_id);
+            glDeleteProgram(old.program_id);
+            g_PendingShaderPrograms.erase(g_PendingShaderPrograms.begin() + i);
+            break;
+        }
+    }
+
+    GLuint cached_program_id = ShaderCache_LoadProgram(pending.sources);
+    if ( cached_program_id != 0 )
+    {
+        InstallShaderProgram(pending.key, draw_order, cached_program_id);
+        return;
+    }
+
+    const GLchar* vertex_string   = vertex_source.c_str();
+    const GLchar* fragment_string = fragment_source.c_str();
+    const GLint   vertex_length   = static_cast<GLint>( vertex_source.length() );
+    const GLint   fragment_length = static_cast<GLint>( fragment_source.length() );
+
+    pending.vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(pending.vertex_shader_id, 1, &vertex_string, &vertex_length);
+    glCompileShader(pending.vertex_shader_id);
+
+    pending.fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(pending.fragment_shader_id, 1, &fragment_string, &fragment_length);
+    glCompileShader(pending.fragment_shader_id);
 
-    // Buscamos o endereço das variáveis definidas dentro do Vertex Shader.
-    // Utilizaremos estas variáveis para enviar dados para a placa de vídeo
-    // (GPU)! Veja arquivo "shader_vertex.glsl" e "shader_fragment.glsl".
-    model_uniform           = glGetUniformLocation(program_id, "model"); // Variável da matriz "model"
-    view_uniform            = glGetUniformLocation(program_id, "view"); // Variável da matriz "view" em shader_vertex.glsl
-    projection_uniform      = glGetUniformLocation(program_id, "projection"); // Variável da matriz "projection" em shader_vertex.glsl
-    object_id_uniform       = glGetUniformLocation(program_id, "object_id"); // Variável "object_id" em shader_fragment.glsl
-    bbox_min_uniform        = glGetUniformLocation(program_id, "bbox_min");
-    bbox_max_uniform        = glGetUniformLocation(program_id, "bbox_max");
-
-    // Variáveis em "shader_fragment.glsl" para acesso das imagens de textura
+    pending.program_id = glCreateProgram();
+    glAttachShader(pending.program_id, pending.vertex_shader_id);
+    glAttachShader(pending.program_id, pending.fragment_shader_id);
+    ShaderCache_SetRetrievable(pending.program_id);
+    glLinkProgram(pending.program_id);
+
+    g_PendingShaderPrograms.push_back(pending);
+}
+
+// Verifica as permutações em g_PendingShaderPrograms, instalando as que já
+// foram linkadas. Se "wait" é verdadeiro, esperamos todas terminarem.
+//
+// Com a extensão KHR_parallel_shader_compile, o driver compila em outras
+// threads e GL_COMPLETION_STATUS_KHR nos diz, sem bloquear, quais programas
+// estão prontos. Sem ela, a compilação só acontece quando consultamos o
+// resultado; terminamos então uma permutação por quadro, para distribuir a
+// espera entre vários quadros.
+void PollShaderPrograms(bool wait)
+{
+    if ( !wait )
+        g_ShaderWaitedThisFrame = false;
+
+    size_t i = 0;
+    while ( i < g_PendingShaderPrograms.size() )
+    {
+        PendingShaderProgram& pending = g_PendingShaderPrograms[i];
+
+        if ( !wait && GLEXT_KHR_parallel_shader_compile )
+        {
+            GLint completed = GL_FALSE;
+            glGetProgramiv(pending.program_id, GL_COMPLETION_STATUS_KHR, &completed);
+            if ( completed == GL_FALSE )
+            {
+                ++i;
+                continue;
+            }
+        }
+        else if ( !wait )
+        {
+            if ( g_ShaderWaitedThisFrame )
+                break;
+            g_ShaderWaitedThisFrame = true;
+        }
+
+        PrintShaderLog(pending.vertex_shader_id, "../../src/shader_vertex.glsl");
+        PrintShaderLog(pending.fragment_shader_id, "../../src/shader_fragment.glsl");
+
+        glDeleteShader(pending.vertex_shader_id);
+        glDeleteShader(pending.fragment_shader_id);
+
+        // Se a nova versão dos shaders tem erros, continuamos utilizando a
+        // anterior.
+        if ( PrintProgramLog(pending.program_id) )
+        {
+            ShaderCache_StoreProgram(pending.program_id, pending.sources);
+            InstallShaderProgram(pending.key, pending.draw_order, pending.program_id);
+        }
+        else
+        {
+            fprintf(stderr, "ERROR: Keeping previous version of shader permutation \"%s\".\n", pending.key.c_str());
+            glDeleteProgram(pending.program_id);
+        }
+
+        g_PendingShaderPrograms.erase(g_PendingShaderPrograms.begin() + i);
+    }
+
+    // Na recarga pedida pela tecla R, os shaders dos caminhos de culling na
+    // GPU e "deferred" são instalados da mesma forma, à medida que ficam
+    // prontos.
+    if ( g_ShaderReloadInProgress && PollRenderPathShaders(wait) && g_PendingShaderPrograms.empty() )
+    {
+        g_ShaderReloadInProgress = false;
+        fprintf(stdout,"Shaders recarregados!\n");
+        fflush(stdout);
+    }
+}
+
+// Função que retorna a permutação dos shaders que desenha objetos com o
+// identificador "object_id".
+ShaderProgram* ProgramForObject(int object_id)
+{
+    // Ex: no passo de geometria do caminho "deferred", a permutação que
+    // escreve no G-buffer.
+    if ( object_id >= 0 && object_id < NUM_MATERIAL_OBJECT_IDS )
+        return g_ObjectPrograms[g_FrameRenderPath][object_id];
+    return g_DefaultPrograms[g_FrameRenderPath];
+}
+
+// Função que envia as cores dos times para as variáveis "team_Kd" e
+// "team_Ka" de "shader_fragment.glsl".
+void SetupTeamColors(GLuint program_id)
+{
+    glUseProgram(program_id);
+    glUniform4fv(glGetUniformLocation(program_id, "team_Kd"), 2, glm::value_ptr(g_TeamDiffuseColors[0]));
+    glUniform4fv(glGetUniformLocation(program_id, "team_Ka"), 2, glm::value_ptr(g_TeamAmbientColors[0]));
+    glUseProgram(0);
+}
+
+// Função que associa as variáveis TextureImage* de "shader_fragment.glsl" às
+// unidades de textura onde as imagens foram carregadas por LoadTextureImage().
+void SetupTextureUnits(GLuint program_id)
+{
     glUseProgram(program_id);
     glUniform1i(glGetUniformLocation(program_id, "TextureImage0"), 0);
     glUniform1i(glGetUniformLocation(program_id, "TextureImage1"), 1);
     glUniform1i(glGetUniformLocation(program_id, "TextureImage2"), 2);
     glUniform1i(glGetUniformLocation(program_id, "TextureImage3"), 3);
     glUniform1i(glGetUniformLocation(program_id, "TextureImage4"), 4);
+    Clustered_SetupProgram(program_id);
+    Shadows_SetupProgram(program_id);
     glUseProgram(0);
 }
 
@@ -927,17 +2253,15 @@ void ComputeNormals(ObjModel* model)
     }
 }
 
-// Constrói triângulos para futura renderização a partir de um ObjModel.
+// Constrói triângulos para futura renderização a partir de um ObjModel. Os
+// vértices são adicionados aos vetores g_Scene*, que serão enviados para a GPU
+// por UploadVirtualScene() depois que todos os modelos forem carregados.
 void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
 {
-    GLuint vertex_array_object_id;
-    glGenVertexArrays(1, &vertex_array_object_id);
-    glBindVertexArray(vertex_array_object_id);
-
-    std::vector<GLuint> indices;
-    std::vector<float>  model_coefficients;
-    std::vector<float>  normal_coefficients;
-    std::vector<float>  texture_coefficients;
+    std::vector<GLuint>& indices              = g_SceneIndices;
+    std::vector<float>&  model_coefficients   = g_SceneModelCoefficients;
+    std::vector<float>&  normal_coefficients  = g_SceneNormalCoefficients;
+    std::vector<float>&  texture_coefficients = g_SceneTextureCoefficients;
 
     for (size_t shape = 0; shape < model->shapes.size(); ++shape)
     {
@@ -991,6 +2315,12 @@ void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
                     normal_coefficients.push_back( nz ); // Z
                     normal_coefficients.push_back( 0.0f ); // W
                 }
+                else
+                {
+                    // Todos os objetos compartilham os mesmos buffers, então
+                    // cada vértice precisa de uma normal, mesmo que nula.
+                    normal_coefficients.insert(normal_coefficients.end(), 4, 0.0f);
+                }
 
                 if ( idx.texcoord_index != -1 )
                 {
@@ -999,6 +2329,10 @@ void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
                     texture_coefficients.push_back( u );
                     texture_coefficients.push_back( v );
                 }
+                else
+                {
+                    texture_coefficients.insert(texture_coefficients.end(), 2, 0.0f);
+                }
             }
         }
 
@@ -1006,16 +2340,30 @@ void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
 
         SceneObject theobject;
         theobject.name           = model->shapes[shape].name;
-        theobject.first_index    = (void*)first_index; // Primeiro índice
+        theobject.first_index    = first_index; // Primeiro índice
         theobject.num_indices    = last_index - first_index + 1; // Número de indices
         theobject.rendering_mode = GL_TRIANGLES;       // Índices correspondem ao tipo de rasterização GL_TRIANGLES.
-        theobject.vertex_array_object_id = vertex_array_object_id;
+        theobject.vertex_array_object_id = 0; // Definido por UploadVirtualScene()
 
         theobject.bbox_min = bbox_min;
         theobject.bbox_max = bbox_max;
 
         g_VirtualScene[model->shapes[shape].name] = theobject;
     }
+}
+
+// Envia para a GPU os vértices de todos os objetos construídos por
+// BuildTrianglesAndAddToVirtualScene(), em um único VAO compartilhado.
+void UploadVirtualScene()
+{
+    std::vector<GLuint>& indices              = g_SceneIndices;
+    std::vector<float>&  model_coefficients   = g_SceneModelCoefficients;
+    std::vector<float>&  normal_coefficients  = g_SceneNormalCoefficients;
+    std::vector<float>&  texture_coefficients = g_SceneTextureCoefficients;
+
+    GLuint vertex_array_object_id;
+    glGenVertexArrays(1, &vertex_array_object_id);
+    glBindVertexArray(vertex_array_object_id);
 
     GLuint VBO_model_coefficients_id;
     glGenBuffers(1, &VBO_model_coefficients_id);
@@ -1069,6 +2417,16 @@ void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
     // "Desligamos" o VAO, evitando assim que operações posteriores venham a
     // alterar o mesmo. Isso evita bugs.
     glBindVertexArray(0);
+
+    for (std::map<std::string, SceneObject>::iterator it = g_VirtualScene.begin(); it != g_VirtualScene.end(); ++it)
+        it->second.vertex_array_object_id = vertex_array_object_id;
+    g_SceneVertexArrayObjectId = vertex_array_object_id;
+
+    // Os vértices já estão na GPU; liberamos a memória do CPU.
+    std::vector<GLuint>().swap(indices);
+    std::vector<float>().swap(model_coefficients);
+    std::vector<float>().swap(normal_coefficients);
+    std::vector<float>().swap(texture_coefficients);
 }
 
 // Carrega um Vertex Shader de um arquivo GLSL. Veja definição de LoadShader() abaixo.
@@ -1100,8 +2458,18 @@ GLuint LoadShader_Fragment(const char* filename)
 }
 
 // Função auxilar, utilizada pelas duas funções acima. Carrega código de GPU de
-// um arquivo GLSL e faz sua compilação.
-void LoadShader(const char* filename, GLuint shader_id)
+// um arquivo GLSL e faz sua compilação. Se "header" não for NULL, ele
+// substitui a primeira linha do arquivo (a diretiva #version), permitindo
+// compilar variantes do mesmo shader com outra versão e outros #define.
+void LoadShader(const char* filename, GLuint shader_id, const char* header)
+{
+    std::string str = ReadShaderSource(filename, header);
+    CompileShader(shader_id, str, filename);
+}
+
+// Lê o código de um shader de um arquivo GLSL, substituindo a primeira linha
+// por "header" (se não for NULL). Veja LoadShader().
+std::string ReadShaderSource(const char* filename, const char* header)
 {
     // Lemos o arquivo de texto indicado pela variável "filename"
     // e colocamos seu conteúdo em memória, apontado pela variável
@@ -1117,6 +2485,16 @@ void LoadShader(const char* filename, GLuint shader_id)
     std::stringstream shader;
     shader << file.rdbuf();
     std::string str = shader.str();
+    if ( header != NULL )
+        str = header + str.substr(std::min(str.size(), str.find('\n') + 1));
+    return str;
+}
+
+// Compila o código GLSL "str" no shader "shader_id", imprimindo no terminal
+// qualquer erro ou "warning" de compilação. O nome "filename" é utilizado
+// somente nas mensagens.
+void CompileShader(GLuint shader_id, const std::string& str, const char* filename)
+{
     const GLchar* shader_string = str.c_str();
     const GLint   shader_string_length = static_cast<GLint>( str.length() );
 
@@ -1126,6 +2504,13 @@ void LoadShader(const char* filename, GLuint shader_id)
     // Compila o código do shader GLSL (em tempo de execução)
     glCompileShader(shader_id);
 
+    PrintShaderLog(shader_id, filename);
+}
+
+// Imprime no terminal qualquer erro ou "warning" da compilação do shader
+// "shader_id". Se a compilação ainda não terminou, esperamos o seu término.
+void PrintShaderLog(GLuint shader_id, const char* filename)
+{
     // Verificamos se ocorreu algum erro ou "warning" durante a compilação
     GLint compiled_ok;
     glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compiled_ok);
@@ -1180,9 +2565,28 @@ GLuint CreateGpuProgram(GLuint vertex_shader_id, GLuint fragment_shader_id)
     glAttachShader(program_id, vertex_shader_id);
     glAttachShader(program_id, fragment_shader_id);
 
+    // Pedimos que o binário do programa fique disponível para o cache em
+    // disco. Veja "shadercache.cpp".
+    ShaderCache_SetRetrievable(program_id);
+
     // Linkagem dos shaders acima ao programa
     glLinkProgram(program_id);
 
+    PrintProgramLog(program_id);
+
+    // Os "Shader Objects" podem ser marcados para deleção após serem linkados
+    glDeleteShader(vertex_shader_id);
+    glDeleteShader(fragment_shader_id);
+
+    // Retornamos o ID gerado acima
+    return program_id;
+}
+
+// Imprime no terminal qualquer erro de linkagem do programa "program_id", e
+// retorna se a linkagem teve sucesso. Se ela ainda não terminou, esperamos o
+// seu término.
+bool PrintProgramLog(GLuint program_id)
+{
     // Verificamos se ocorreu algum erro durante a linkagem
     GLint linked_ok = GL_FALSE;
     glGetProgramiv(program_id, GL_LINK_STATUS, &linked_ok);
@@ -1212,14 +2616,192 @@ GLuint CreateGpuProgram(GLuint vertex_shader_id, GLuint fragment_shader_id)
         fprintf(stderr, "%s", output.c_str());
     }
 
-    // Os "Shader Objects" podem ser marcados para deleção após serem linkados
-    glDeleteShader(vertex_shader_id);
-    glDeleteShader(fragment_shader_id);
+    return linked_ok != GL_FALSE;
+}
+
+// Cria um programa de GPU a partir do código dos shaders de vértice e de
+// fragmentos. Se o mesmo programa (mesmo código, mesmos #define, mesma GPU e
+// mesmo driver) já foi linkado em uma execução anterior, ele é carregado do
+// cache em disco, sem compilar os shaders. Veja "shadercache.cpp".
+GLuint CreateGpuProgramFromSources(const std::string& vertex_source, const std::string& fragment_source, const char* vertex_name, const char* fragment_name)
+{
+    std::string sources = vertex_source + '\0' + fragment_source;
+
+    GLuint program_id = ShaderCache_LoadProgram(sources);
+    if ( program_id != 0 )
+        return program_id;
+
+    GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
+    CompileShader(vertex_shader_id, vertex_source, vertex_name);
+    GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+    CompileShader(fragment_shader_id, fragment_source, fragment_name);
+
+    program_id = CreateGpuProgram(vertex_shader_id, fragment_shader_id);
+    ShaderCache_StoreProgram(program_id, sources);
 
-    // Retornamos o ID gerado acima
     return program_id;
 }
 
+// Versão da função acima que lê o código dos shaders de arquivos GLSL, com a
+// primeira linha substituída por "header" (veja LoadShader()).
+GLuint LoadGpuProgram(const char* vertex_filename, const char* fragment_filename, const char* header)
+{
+    return CreateGpuProgramFromSources(ReadShaderSource(vertex_filename, header),
+                                       ReadShaderSource(fragment_filename, header),
+                                       vertex_filename, fragment_filename);
+}
+
+// Inicia a compilação e a linkagem de um programa com os shaders de tipos
+// "types" e códigos "sources", sem esperar o seu término, como
+// RequestShaderProgram(). Programas do cache em disco já retornam linkados.
+static GLuint StartGpuProgramFromSources(int num_shaders, const GLenum types[], const std::string sources[], const char* const names[])
+{
+    PendingGpuProgram pending;
+    pending.num_shaders = num_shaders;
+    pending.sources     = sources[0];
+    for (int i = 1; i < num_shaders; ++i)
+        pending.sources += '\0' + sources[i];
+
+    GLuint cached_program_id = ShaderCache_LoadProgram(pending.sources);
+    if ( cached_program_id != 0 )
+        return cached_program_id;
+
+    pending.program_id = glCreateProgram();
+    for (int i = 0; i < num_shaders; ++i)
+    {
+        const GLchar* shader_string = sources[i].c_str();
+        const GLint   shader_length = static_cast<GLint>( sources[i].length() );
+
+        pending.shader_ids[i]   = glCreateShader(types[i]);
+        pending.shader_names[i] = names[i];
+        glShaderSource(pending.shader_ids[i], 1, &shader_string, &shader_length);
+        glCompileShader(pending.shader_ids[i]);
+        glAttachShader(pending.program_id, pending.shader_ids[i]);
+    }
+    ShaderCache_SetRetrievable(pending.program_id);
+    glLinkProgram(pending.program_id);
+
+    g_PendingGpuPrograms.push_back(pending);
+    return pending.program_id;
+}
+
+// Versão de LoadGpuProgram() que não espera a linkagem. O programa só pode
+// ser utilizado depois de instalado por SwapGpuProgram().
+GLuint StartGpuProgram(const char* vertex_filename, const char* fragment_filename, const char* header)
+{
+    const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    const std::string sources[2] = { ReadShaderSource(vertex_filename, header), ReadShaderSource(fragment_filename, header) };
+    const char* const names[2] = { vertex_filename, fragment_filename };
+    return StartGpuProgramFromSources(2, types, sources, names);
+}
+
+// Idem, para um programa com um único compute shader
+GLuint StartComputeProgram(const char* filename)
+{
+    const GLenum types[1] = { GL_COMPUTE_SHADER };
+    const std::string sources[1] = { ReadShaderSource(filename, NULL) };
+    const char* const names[1] = { filename };
+    return StartGpuProgramFromSources(1, types, sources, names);
+}
+
+// Verifica se o programa "program_id", iniciado por StartGpuProgram(), já foi
+// linkado, com as mesmas regras de PollShaderPrograms(). Quando sim, imprime
+// os erros, guarda o programa no cache em disco, e retorna verdadeiro, com o
+// resultado da linkagem em "linked_ok".
+static bool PollGpuProgram(GLuint program_id, bool wait, bool* linked_ok)
+{
+    for (size_t i = 0; i < g_PendingGpuPrograms.size(); ++i)
+    {
+        PendingGpuProgram& pending = g_PendingGpuPrograms[i];
+        if ( pending.program_id != program_id )
+            continue;
+
+        if ( !wait && GLEXT_KHR_parallel_shader_compile )
+        {
+            GLint completed = GL_FALSE;
+            glGetProgramiv(pending.program_id, GL_COMPLETION_STATUS_KHR, &completed);
+            if ( completed == GL_FALSE )
+                return false;
+        }
+        else if ( !wait )
+        {
+            if ( g_ShaderWaitedThisFrame )
+                return false;
+            g_ShaderWaitedThisFrame = true;
+        }
+
+        for (int k = 0; k < pending.num_shaders; ++k)
+        {
+            PrintShaderLog(pending.shader_ids[k], pending.shader_names[k].c_str());
+            glDeleteShader(pending.shader_ids[k]);
+        }
+
+        *linked_ok = PrintProgramLog(pending.program_id);
+        if ( *linked_ok )
+            ShaderCache_StoreProgram(pending.program_id, pending.sources);
+
+        g_PendingGpuPrograms.erase(g_PendingGpuPrograms.begin() + i);
+        return true;
+    }
+
+    // Carregado do cache em disco, já linkado
+    GLint status = GL_FALSE;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &status);
+    *linked_ok = status != GL_FALSE;
+    return true;
+}
+
+// Se o programa "pending_program_id" (veja StartGpuProgram()) já foi
+// linkado com sucesso, ele substitui "program_id", que é apagado, e
+// retornamos verdadeiro. Se a linkagem falhou, "program_id" continua em uso.
+// Terminada a linkagem, "pending_program_id" passa a ser 0.
+bool SwapGpuProgram(GLuint& pending_program_id, GLuint& program_id, bool wait)
+{
+    if ( pending_program_id == 0 )
+        return false;
+
+    bool linked_ok = false;
+    if ( !PollGpuProgram(pending_program_id, wait, &linked_ok) )
+        return false;
+
+    if ( linked_ok )
+    {
+        if ( program_id != 0 )
+            glDeleteProgram(program_id);
+        program_id = pending_program_id;
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: Keeping previous version of GPU program.\n");
+        glDeleteProgram(pending_program_id);
+    }
+
+    pending_program_id = 0;
+    return linked_ok;
+}
+
+// Cancela a compilação de um programa iniciado por StartGpuProgram() (ex:
+// pedido de novo antes de terminar).
+void DiscardGpuProgram(GLuint& pending_program_id)
+{
+    if ( pending_program_id == 0 )
+        return;
+
+    for (size_t i = 0; i < g_PendingGpuPrograms.size(); ++i)
+    {
+        PendingGpuProgram& pending = g_PendingGpuPrograms[i];
+        if ( pending.program_id == pending_program_id )
+        {
+            for (int k = 0; k < pending.num_shaders; ++k)
+                glDeleteShader(pending.shader_ids[k]);
+            g_PendingGpuPrograms.erase(g_PendingGpuPrograms.begin() + i);
+            break;
+        }
+    }
+    glDeleteProgram(pending_program_id);
+    pending_program_id = 0;
+}
+
 // Definição da função que será chamada sempre que a janela do sistema
 // operacional for redimensionada, por consequência alterando o tamanho do
 // "framebuffer" (região de memória onde são armazenados os pixels da imagem).
@@ -1249,6 +2831,8 @@ double g_LastCursorPosX, g_LastCursorPosY;
 // Função callback chamada sempre que o usuário aperta algum dos botões do mouse
 void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
+    FramePacer_NotifyActivity();
+
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
     {
         // Se o usuário pressionou o botão esquerdo do mouse, guardamos a
@@ -1274,6 +2858,10 @@ void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
         // com o botão esquerdo pressionado.
         glfwGetCursorPos(window, &g_LastCursorPosX, &g_LastCursorPosY);
         g_RightMouseButtonPressed = true;
+
+        // Em 3º pessoa, o personagem ativo anda até o ponto clicado
+        if (cam_mode == THIRD_PERSON)
+            MoveActiveCharacterTo(window);
     }
     if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_RELEASE)
     {
@@ -1303,6 +2891,8 @@ void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 // cima da janela OpenGL.
 void CursorPosCallback(GLFWwindow* window, double xpos, double ypos)
 {
+    FramePacer_NotifyActivity();
+
     // Abaixo executamos o seguinte: caso o botão esquerdo do mouse esteja
     // pressionado, computamos quanto que o mouse se movimento desde o último
     // instante de tempo, e usamos esta movimentação para atualizar os
@@ -1343,18 +2933,27 @@ void CursorPosCallback(GLFWwindow* window, double xpos, double ypos)
         float dy = ypos - g_LastCursorPosY;
         glm::vec4 view2D;
 
+        // O mouse muda a direção fora dos passos da simulação; o estado
+        // anterior acompanha, para que InterpolateRenderState() mostre todo o
+        // movimento já no próximo quadro.
+        glm::vec4 old_position;
         switch(cam_mode){
         case THIRD_PERSON:
+            old_position = lookat_camera.position;
             lookat_camera.look(dx,dy);
+            lookat_camera.follow_orbit(old_position); // A câmera look-at também muda de posição
             break;
         case FIRST_PERSON:
             characters[active_character].camera.look(dx, dy);
             view2D = glm::vec4(characters[active_character].camera.view.x, 0.0f, characters[active_character].camera.view.z, 0.0f);
             view2D = normalize(view2D);
             characters[active_character].facing_vector = view2D;
+            characters[active_character].camera.previous_view = characters[active_character].camera.view;
+            characters[active_character].previous_facing_vector = view2D;
             break;
         case FREE_CAM:
             free_camera.look(dx, dy);
+            free_camera.previous_view = free_camera.view;
             break;
         }
 
@@ -1400,6 +2999,8 @@ void CursorPosCallback(GLFWwindow* window, double xpos, double ypos)
 // Função callback chamada sempre que o usuário movimenta a "rodinha" do mouse.
 void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
+    FramePacer_NotifyActivity();
+
     // Atualizamos a distância da câmera para a origem utilizando a
     // movimentação da "rodinha", simulando um ZOOM.
     lookat_camera.distance -= 0.1f*yoffset;
@@ -1413,7 +3014,10 @@ void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
     if (lookat_camera.distance < 0.4)
         lookat_camera.distance = 0.4;
 
+    // Como em CursorPosCallback(), o zoom não é interpolado
+    glm::vec4 old_position = lookat_camera.position;
     lookat_camera.update_camera();
+    lookat_camera.follow_orbit(old_position);
 }
 
 // Definição da função que será chamada sempre que o usuário pressionar alguma
@@ -1428,6 +3032,9 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mod)
             std::exit(100 + i);
     // ==============
 
+    // Qualquer tecla tira o laço principal do modo ocioso
+    FramePacer_NotifyActivity();
+
     // Se o usuário pressionar a tecla ESC, fechamos a janela.
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GL_TRUE);
@@ -1467,8 +3074,8 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mod)
     // Se o usuário apertar a tecla R, recarregamos os shaders dos arquivos "shader_fragment.glsl" e "shader_vertex.glsl".
     if (key == GLFW_KEY_R && action == GLFW_PRESS)
     {
-        LoadShadersFromFiles();
-        fprintf(stdout,"Shaders recarregados!\n");
+        ReloadShadersFromFiles();
+        fprintf(stdout,"Recarregando shaders...\n");
         fflush(stdout);
     }
 
@@ -1479,11 +3086,75 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mod)
             cam_mode = FIRST_PERSON;
         else
             cam_mode = THIRD_PERSON;
+        g_MovePathOwner = -1; // O caminho só é seguido em 3º pessoa
+    }
+
+    // Tecla C = liga/desliga o view-frustum culling
+    if (key == GLFW_KEY_C && action == GLFW_PRESS)
+        g_FrustumCullingEnabled = !g_FrustumCullingEnabled;
+
+    // Tecla V = liga/desliga o occlusion culling
+    if (key == GLFW_KEY_V && action == GLFW_PRESS)
+        g_OcclusionCullingEnabled = !g_OcclusionCullingEnabled;
+
+    // Tecla G = alterna entre culling no CPU e culling/desenho indireto na GPU
+    if (key == GLFW_KEY_G && action == GLFW_PRESS)
+    {
+        if (GpuCulling_IsSupported())
+            g_GpuCullingEnabled = !g_GpuCullingEnabled;
+        else
+            fprintf(stderr, "Culling na GPU requer OpenGL 4.3.\n");
+    }
+
+    // Tecla M = alterna entre os caminhos de renderização
+    if (key == GLFW_KEY_M && action == GLFW_PRESS)
+    {
+        g_RenderPath = (g_RenderPath + 1) % NUM_RENDER_PATHS;
+        if (g_RenderPath == RENDER_DEFERRED && !Deferred_IsSupported())
+        {
+            fprintf(stderr, "Caminho deferred indisponivel: erro nos shaders.\n");
+            g_RenderPath = RENDER_CLUSTERED;
+        }
     }
 
+    // Tecla N = alterna o modo noturno (sol fraco e fogueiras acesas)
+    if (key == GLFW_KEY_N && action == GLFW_PRESS)
+        g_NightMode = !g_NightMode;
+
+    // Tecla K = liga/desliga as sombras do sol
+    if (key == GLFW_KEY_K && action == GLFW_PRESS)
+        g_ShadowsEnabled = !g_ShadowsEnabled;
+
+    // Tecla Z = alterna o "depth pre-pass" entre desligado, ligado e automático
+    if (key == GLFW_KEY_Z && action == GLFW_PRESS)
+        DepthPrepass_CycleMode();
+
+    // Tecla X = liga/desliga a visualização do overdraw
+    if (key == GLFW_KEY_X && action == GLFW_PRESS)
+        g_ShowOverdraw = !g_ShowOverdraw;
+
+    // Tecla U = liga/desliga a resolução dinâmica
+    if (key == GLFW_KEY_U && action == GLFW_PRESS)
+        g_DynamicResolutionEnabled = !g_DynamicResolutionEnabled;
+
+    // Tecla T = alterna o vsync entre desligado, ligado e adaptativo
+    if (key == GLFW_KEY_T && action == GLFW_PRESS)
+        FramePacer_CycleVsync();
+
+    // Tecla Y = alterna o limite de quadros por segundo
+    if (key == GLFW_KEY_Y && action == GLFW_PRESS)
+        FramePacer_CycleLimit();
+
+    // Tecla I = liga/desliga o modo ocioso (poucos quadros com a cena parada)
+    if (key == GLFW_KEY_I && action == GLFW_PRESS)
+        g_AdaptiveFrameRate = !g_AdaptiveFrameRate;
+
     // Tecla L = ativa câmera livre
     if (key == GLFW_KEY_L && action == GLFW_PRESS)
+    {
         cam_mode = FREE_CAM;
+        g_MovePathOwner = -1;
+    }
 
     // Teclas de Movimentação
     if (key == GLFW_KEY_W && action == GLFW_PRESS)
@@ -1576,6 +3247,9 @@ void TextRendering_ShowEulerAngles(GLFWwindow* window)
 
 void TextRendering_ShowCharacterData(GLFWwindow* window)
 {
+    // Texto retido: os vértices só são recalculados quando os dados mudam
+    static int text = TextRendering_CreateText();
+
     float pad = TextRendering_LineHeight(window);
 
     char buffer[80];
@@ -1584,7 +3258,69 @@ void TextRendering_ShowCharacterData(GLFWwindow* window)
             characters[active_character].remaining_actions, characters[active_character].max_actions,
             characters[active_character].remaining_movement, characters[active_character].max_movement);
 
-    TextRendering_PrintString(window, buffer, -1.0f+pad/10, -1.0f+2*pad/10, 1.0f);
+    TextRendering_PrintText(window, text, buffer, -1.0f+pad/10, -1.0f+2*pad/10, 1.0f);
+}
+
+// Escrevemos na tela o número de objetos desenhados e descartados pelo
+// view-frustum culling e pelo occlusion culling no último quadro.
+void TextRendering_ShowCullingStats(GLFWwindow* window)
+{
+    if ( !g_ShowInfoText )
+        return;
+
+    // Um texto retido por linha
+    static int first_line = TextRendering_CreateText(7);
+
+    float lineheight = TextRendering_LineHeight(window);
+    float pad = lineheight;
+
+    char buffer[80];
+    snprintf(buffer, 80, "Culling %s (%s): %d desenhados, %d descartados",
+             g_FrustumCullingEnabled ? "on" : "off", g_GpuCullingEnabled ? "GPU" : "CPU",
+             g_DrawnObjects, g_CulledObjects);
+
+    TextRendering_PrintText(window, first_line + 0, buffer, -1.0f+pad/10, 1.0f-lineheight, 1.0f);
+
+    snprintf(buffer, 80, "Oclusao %s: %d escondidos",
+             g_OcclusionCullingEnabled ? "on" : "off", g_OccludedObjects);
+
+    TextRendering_PrintText(window, first_line + 1, buffer, -1.0f+pad/10, 1.0f-2*lineheight, 1.0f);
+
+    if ( g_RenderPath == RENDER_DEFERRED )
+        snprintf(buffer, 80, "Render %s: %d luzes%s", g_RenderPathNames[g_RenderPath],
+                 g_DeferredLightCount, g_NightMode ? " (noite)" : "");
+    else if ( g_RenderPath == RENDER_CLUSTERED )
+        snprintf(buffer, 80, "Render %s: %d luzes, max %d/cluster%s", g_RenderPathNames[g_RenderPath],
+                 g_ClusteredLightCount, g_ClusteredMaxLightsPerCluster, g_NightMode ? " (noite)" : "");
+    else
+        snprintf(buffer, 80, "Render %s", g_RenderPathNames[g_RenderPath]);
+
+    TextRendering_PrintText(window, first_line + 2, buffer, -1.0f+pad/10, 1.0f-3*lineheight, 1.0f);
+
+    snprintf(buffer, 80, "Sombras %s: %d cascatas redesenhadas, %d dinamicos",
+             g_ShadowsEnabled ? "on" : "off", g_ShadowStaticCascadesRedrawn, g_ShadowDynamicCastersDrawn);
+
+    TextRendering_PrintText(window, first_line + 3, buffer, -1.0f+pad/10, 1.0f-4*lineheight, 1.0f);
+
+    snprintf(buffer, 80, "Pre-pass %s (%s): overdraw %.2fx%s", DepthPrepass_ModeName(),
+             g_DepthPrepassActive ? "on" : "off", g_MeasuredOverdraw, g_ShowOverdraw ? " (visualizando)" : "");
+
+    TextRendering_PrintText(window, first_line + 4, buffer, -1.0f+pad/10, 1.0f-5*lineheight, 1.0f);
+
+    snprintf(buffer, 80, "Resolucao %s: %dx%d (%.0f%%), GPU %.1f ms",
+             g_DynamicResolutionEnabled ? "dinamica" : "nativa", g_SceneWidth, g_SceneHeight,
+             100.0f * g_ResolutionScale, g_GpuFrameTimeMs);
+
+    TextRendering_PrintText(window, first_line + 5, buffer, -1.0f+pad/10, 1.0f-6*lineheight, 1.0f);
+
+    char limit[16] = "sem limite";
+    if ( g_FrameLimitFps > 0.0f )
+        snprintf(limit, 16, "%.0f fps", g_FrameLimitFps);
+    snprintf(buffer, 80, "Vsync %s, %s%s: %.1f ms, jitter %.2f, max %.1f",
+             FramePacer_VsyncName(), limit, g_FramePacerIdle ? " (ocioso)" : "",
+             g_FrameIntervalMs, g_FrameJitterMs, g_FrameIntervalMaxMs);
+
+    TextRendering_PrintText(window, first_line + 6, buffer, -1.0f+pad/10, 1.0f-7*lineheight, 1.0f);
 }
 
 // Escrevemos na tela qual matriz de projeção está sendo utilizada.
@@ -1615,6 +3351,7 @@ void TextRendering_ShowFramesPerSecond(GLFWwindow* window)
     static int   ellapsed_frames = 0;
     static char  buffer[20] = "?? fps";
     static int   numchars = 7;
+    static int   text = TextRendering_CreateText();
 
     ellapsed_frames += 1;
 
@@ -1635,7 +3372,9 @@ void TextRendering_ShowFramesPerSecond(GLFWwindow* window)
     float lineheight = TextRendering_LineHeight(window);
     float charwidth = TextRendering_CharWidth(window);
 
-    TextRendering_PrintString(window, buffer, 1.0f-(numchars + 1)*charwidth, 1.0f-lineheight, 1.0f);
+    // O texto só muda uma vez por segundo; nos demais quadros, os vértices
+    // calculados anteriormente são reutilizados.
+    TextRendering_PrintText(window, text, buffer, 1.0f-(numchars + 1)*charwidth, 1.0f-lineheight, 1.0f);
 }
 
 // Função para debugging: imprime no terminal todas informações de um modelo
@@ -1875,69 +3614,32 @@ void BuildMeshes(int argc, char* argv[]){
         ObjModel model(argv[1]);
         BuildTrianglesAndAddToVirtualScene(&model);
     }
-}
-
-void CreateCharacters(glm::vec3 land_size) {
 
-    glm::vec4 origin = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-    // Team 1
-    Character spearman_1;
-    spearman_1.init_attributes(SPEARMAN);
-    spearman_1.set_team(1);
-    spearman_1.position = glm::vec4(land_size.x / 4, 0.0f, -land_size.z / 4, 1.0f);
-    spearman_1.position.y = scenary.heigth(spearman_1.position);
-    spearman_1.camera.init_char(spearman_1.position, glm::vec4(spearman_1.position.x, spearman_1.position.y, -spearman_1.position.z, 1.0f));
-    spearman_1.facing_vector = spearman_1.camera.view;
-    characters.push_back(spearman_1);
-
-    Character guardian_1;
-    guardian_1.init_attributes(GUARDIAN);
-    guardian_1.set_team(1);
-    guardian_1.position = glm::vec4(0.0f, 0.0f, -land_size.z / 4, 1.0f);
-    guardian_1.position.y = scenary.heigth(guardian_1.position);
-    guardian_1.camera.init_char(guardian_1.position, glm::vec4(guardian_1.position.x, guardian_1.position.y, -guardian_1.position.z, 1.0f));
-    guardian_1.facing_vector = guardian_1.camera.view;
-    characters.push_back(guardian_1);
-
-    Character archer_1;
-    archer_1.init_attributes(ARCHER);
-    archer_1.set_team(1);
-    archer_1.position = glm::vec4(-land_size.x / 4, 0.0f, -land_size.z / 4, 1.0f);
-    archer_1.position.y = scenary.heigth(archer_1.position);
-    archer_1.camera.init_char(archer_1.position, glm::vec4(archer_1.position.x, archer_1.position.y, -archer_1.position.z, 1.0f));
-    archer_1.facing_vector = archer_1.camera.view;
-    characters.push_back(archer_1);
-
-    // Team 2
-    Character spearman_2;
-    spearman_2.init_attributes(SPEARMAN);
-    spearman_2.set_team(2);
-    spearman_2.position = glm::vec4(land_size.x / 4, 0.0f, land_size.z / 4, 1.0f);
-    spearman_2.position.y = scenary.heigth(spearman_2.position);
-    spearman_2.camera.init_char(spearman_2.position, glm::vec4(spearman_2.position.x, spearman_2.position.y, -spearman_2.position.z, 1.0f));
-    spearman_2.facing_vector = spearman_2.camera.view;
-    characters.push_back(spearman_2);
-
-    Character guardian_2;
-    guardian_2.init_attributes(GUARDIAN);
-    guardian_2.set_team(2);
-    guardian_2.position = glm::vec4(0.0f, 0.0f, land_size.z / 4, 1.0f);
-    guardian_2.position.y = scenary.heigth(guardian_2.position);
-    guardian_2.camera.init_char(guardian_2.position, glm::vec4(guardian_2.position.x, guardian_2.position.y, -guardian_2.position.z, 1.0f));
-    guardian_2.facing_vector = guardian_2.camera.view;
-    characters.push_back(guardian_2);
-
-    Character archer_2;
-    archer_2.init_attributes(ARCHER);
-    archer_2.set_team(2);
-    archer_2.position = glm::vec4(-land_size.x / 4, 0.0f, land_size.z / 4, 1.0f);
-    archer_2.position.y = scenary.heigth(archer_2.position);
-    archer_2.camera.init_char(archer_2.position, glm::vec4(archer_2.position.x, archer_2.position.y, -archer_2.position.z, 1.0f));
-    archer_2.facing_vector = archer_2.camera.view;
-    characters.push_back(archer_2);
+    // Enviamos todos os modelos acima para a GPU de uma só vez
+    UploadVirtualScene();
 }
 
 void Character::draw() {
+    // Teste hierárquico: se a caixa que envolve o personagem inteiro está
+    // fora do frustum, descartamos todas as suas partes de uma vez, sem
+    // precisar computar suas matrizes de modelagem.
+    glm::vec3 center = glm::vec3(position.x, position.y, position.z);
+    if (g_FrustumCullingEnabled && bbox_valid && !Culling_TestBox(center + bbox_min, center + bbox_max))
+    {
+        g_CulledObjects += num_parts;
+        return;
+    }
+
+    // Da mesma forma, descartamos o personagem se ele está completamente
+    // escondido atrás da terra ou dos planaltos.
+    if (g_OcclusionCullingEnabled && bbox_valid && !Occlusion_TestBox(center + bbox_min, center + bbox_max))
+    {
+        g_OccludedObjects += num_parts;
+        return;
+    }
+
+    size_t first_part = g_RenderQueue.size();
+
     float angle = acos(dotproduct(facing_vector, glm::vec4(0.0f, 0.0f, 1.0f, 0.0f)));
 
     if (facing_vector.x < 0.0)
@@ -1950,9 +3652,7 @@ void Character::draw() {
         // Desenha o torso
         model = model * Matrix_Scale(0.03f, 0.03f, 0.03f)
                       * Matrix_Rotate_Y(angle);
-        glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-        glUniform1i(object_id_uniform, team + 1);
-        DrawVirtualObject("Plane_Plane.003");
+        QueueVirtualObject("Plane_Plane.003", model, team + 1);
 
     if (role == GUARDIAN)
     {
@@ -1962,22 +3662,16 @@ void Character::draw() {
             PushMatrix(model);
                 model = model * Matrix_Translate(-2.0f, 2.0f, 0.0f)
                               * Matrix_Scale(1.5f, 1.5f, 1.5f);
-                glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                glUniform1i(object_id_uniform, team + 1);
-                DrawVirtualObject("hilt");
+                QueueVirtualObject("hilt", model, team + 1);
                 // Lâmina da espada
                 PushMatrix(model);
                     model = model;
-                    glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                    glUniform1i(object_id_uniform, team + 1);
-                    DrawVirtualObject("blade");
+                    QueueVirtualObject("blade", model, team + 1);
                 PopMatrix(model);
                 // Guarda da espada
                 PushMatrix(model);
                     model = model;
-                    glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                    glUniform1i(object_id_uniform, team + 1);
-                    DrawVirtualObject("guard");
+                    QueueVirtualObject("guard", model, team + 1);
                 PopMatrix(model);
             PopMatrix(model);
         }
@@ -1991,22 +3685,16 @@ void Character::draw() {
                               * Matrix_Translate(-1.3f, 2.0f, 0.0f)
                               * Matrix_Rotate_X(M_PI_2)
                               * Matrix_Scale(1.5f, 1.5f, 1.5f);
-                glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                glUniform1i(object_id_uniform, team + 1);
-                DrawVirtualObject("hilt");
+                QueueVirtualObject("hilt", model, team + 1);
                 // Lâmina da espada
                 PushMatrix(model);
                     model = model;
-                    glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                    glUniform1i(object_id_uniform, team + 1);
-                    DrawVirtualObject("blade");
+                    QueueVirtualObject("blade", model, team + 1);
                 PopMatrix(model);
                 // Guarda da espada
                 PushMatrix(model);
                     model = model;
-                    glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                    glUniform1i(object_id_uniform, team + 1);
-                    DrawVirtualObject("guard");
+                    QueueVirtualObject("guard", model, team + 1);
                 PopMatrix(model);
             PopMatrix(model);
         }
@@ -2017,9 +3705,7 @@ void Character::draw() {
                           * Matrix_Translate(2.0f, 6.0f, 1.0f)
                           * Matrix_Scale(0.17f, 0.17f, 0.17f)
                           * Matrix_Rotate_X(-M_PI_2);
-            glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-            glUniform1i(object_id_uniform, team + 1);
-            DrawVirtualObject("Heater_Shield_body.001");
+            QueueVirtualObject("Heater_Shield_body.001", model, team + 1);
         PopMatrix(model);
     }
     else if (role == SPEARMAN)
@@ -2031,15 +3717,11 @@ void Character::draw() {
                 model = model
                               * Matrix_Translate(3.5f, 6.0f, 0.0f)
                               * Matrix_Scale(3.0f, 3.0f, 3.0f);
-                glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                glUniform1i(object_id_uniform, team + 1);
-                DrawVirtualObject("pole");
+                QueueVirtualObject("pole", model, team + 1);
 
                 PushMatrix(model);
                     model = model;
-                    glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                    glUniform1i(object_id_uniform, team + 1);
-                    DrawVirtualObject("arm");
+                    QueueVirtualObject("arm", model, team + 1);
                 PopMatrix(model);
             PopMatrix(model);
         }
@@ -2054,15 +3736,11 @@ void Character::draw() {
                               * Matrix_Translate(6.67f, 5.0f, 4.0f)
                               * Matrix_Rotate_X(M_PI_2)
                               * Matrix_Scale(3.0f, 3.0f, 3.0f);
-                glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                glUniform1i(object_id_uniform, team + 1);
-                DrawVirtualObject("pole");
+                QueueVirtualObject("pole", model, team + 1);
 
                 PushMatrix(model);
                     model = model;
-                    glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                    glUniform1i(object_id_uniform, team + 1);
-                    DrawVirtualObject("arm");
+                    QueueVirtualObject("arm", model, team + 1);
                 PopMatrix(model);
             PopMatrix(model);
         }
@@ -2075,9 +3753,7 @@ void Character::draw() {
                           * Matrix_Rotate_Y(-M_PI_2)
                           * Matrix_Rotate_Z(M_PI_2)
                           * Matrix_Scale(0.05f, 0.05f, 0.05f);
-            glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-            glUniform1i(object_id_uniform, team + 1);
-            DrawVirtualObject("bow");
+            QueueVirtualObject("bow", model, team + 1);
         PopMatrix(model);
 
         PushMatrix(model);
@@ -2086,13 +3762,43 @@ void Character::draw() {
                           * Matrix_Rotate_Y(M_PI_2)
                           * Matrix_Rotate_Z(M_PI_2)
                           * Matrix_Scale(0.06f, 0.06f, 0.06f);
-            glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-            glUniform1i(object_id_uniform, team + 1);
-            DrawVirtualObject("quiver");
+            QueueVirtualObject("quiver", model, team + 1);
         PopMatrix(model);
     }
     PopMatrix(model);
 
+    // Atualizamos a caixa do personagem com a união das caixas das partes
+    // enfileiradas acima. Como o personagem gira em torno do eixo Y, a caixa
+    // é expandida no plano XZ para cobrir qualquer rotação, e nunca encolhe,
+    // para cobrir também as poses das animações de ataque. Com o culling na
+    // GPU as caixas das partes não são computadas, e a caixa é mantida.
+    num_parts = g_RenderQueue.size() - first_part;
+    if (g_GpuCullingEnabled)
+        return;
+    for (size_t i = first_part; i < g_RenderQueue.size(); ++i)
+    {
+        glm::vec3 part_min = g_RenderQueue[i].world_min - center;
+        glm::vec3 part_max = g_RenderQueue[i].world_max - center;
+        float radius = std::max(std::max(std::fabs(part_min.x), std::fabs(part_max.x)),
+                                std::max(std::fabs(part_min.z), std::fabs(part_max.z))) * 1.4143f;
+
+        if (!bbox_valid)
+        {
+            bbox_min = glm::vec3(-radius, part_min.y, -radius);
+            bbox_max = glm::vec3( radius, part_max.y,  radius);
+            bbox_valid = true;
+        }
+        bbox_min = glm::min(bbox_min, glm::vec3(-radius, part_min.y, -radius));
+        bbox_max = glm::max(bbox_max, glm::vec3( radius, part_max.y,  radius));
+    }
+}
+
+// Desenha a flecha disparada pelo arqueiro durante a animação de ataque.
+// Separada de Character::draw() pois a flecha não faz parte da caixa que
+// envolve o personagem.
+void Character::draw_projectile() {
+    glm::mat4 model;
+
     if (isAttacking && role == ARCHER)
     {
         if (get_delta_time() >= 1000)
@@ -2113,120 +3819,50 @@ void Character::draw() {
                * Matrix_Rotate_Z(0)
                * Matrix_Rotate_Y(M_PI_2 + acos(dotproduct(p2,p1)))
                * Matrix_Scale(0.0025f, 0.0025f, 0.0025f);
-        glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-        glUniform1i(object_id_uniform, team + 1);
-        DrawVirtualObject("arrow");
+        QueueVirtualObject("arrow", model, team + 1);
     }
 }
 
-void Character::move()
+// Atualiza o cartão do HUD do personagem "index". O HUD só redesenha o
+// cartão se algo mudou.
+void UpdateHudUnit(int index)
 {
-    if (remaining_movement > 0){
-        glm::vec4 future_place;
-        future_place.x = position.x + camera.speed*facing_vector.x;
-        future_place.y = position.y + camera.speed*facing_vector.y;  // não se mexe para cima ou para baixo
-        future_place.z = position.z + camera.speed*facing_vector.z;
-        future_place.w = 1.0;
-
-        if (scenary.heigth(position) == scenary.heigth(future_place)){
-            position.x += camera.speed*facing_vector.x;
-            position.z += camera.speed*facing_vector.z;
+    static const char* role_names[] = { "", "Lanceiro", "Guardiao", "Arqueiro" };
 
-            remaining_movement -= camera.speed;
-            camera.position.x = position.x;
-            camera.position.z = position.z;
-            lookat_camera.lookat = position;
-            lookat_camera.update_camera();
-        }
-        else if (scenary.heigth(future_place) >= 0 && 4*(scenary.heigth(future_place) - scenary.heigth(position)) < remaining_movement){
-            float diff = abs(scenary.heigth(future_place) - scenary.heigth(position));
-            position.x += camera.speed*facing_vector.x;
-            position.z += camera.speed*facing_vector.z;
-            position.y = scenary.heigth(future_place);
-            remaining_movement -= 4*diff;
-            remaining_movement -= camera.speed;
-            camera.position.x = position.x;
-            camera.position.y = position.y;
-            camera.position.z = position.z;
-        }
-    }
+    const Character& character = characters[index];
+    Hud_SetUnit(index, role_names[character.role], g_TeamDiffuseColors[character.team - 1],
+                character.current_hp, character.max_hp, index == active_character);
 }
 
-void Character::moveFP(glm::vec4 direction)
+// Atualiza os cartões de todos os personagens, depois que a lista mudou
+void UpdateHudUnits()
 {
-    if (remaining_movement > 0){
-        glm::vec4 future_place;
-        future_place.x = position.x + camera.speed*facing_vector.x;
-        future_place.y = position.y + camera.speed*facing_vector.y;  // não se mexe para cima ou para baixo
-        future_place.z = position.z + camera.speed*facing_vector.z;
-        future_place.w = 1.0;
-
-        if (scenary.heigth(position) == scenary.heigth(future_place)){
-            camera.move2D(normalize(direction));
-            position.x = camera.position.x;
-            position.z = camera.position.z;
-
-            remaining_movement -= camera.speed;
-            lookat_camera.lookat = position;
-            lookat_camera.update_camera();
-        }
-    }
+    Hud_SetUnitCount((int)characters.size());
+    for (int i = 0; i < (int)characters.size(); i++)
+        UpdateHudUnit(i);
 }
 
-void Character::attack()
+// A câmera look-at acompanha o personagem ativo
+void FollowActiveCharacter(const glm::vec4& position)
 {
-    glm::vec4 vec;
-    float distance;
-    float angle;
-
-    if (remaining_actions <= 0)
-        return;
-
-    for (int i = 0; i < characters.size(); i++)
-        if (i != active_character && characters[i].team != team){
-            vec = characters[i].position - position;
-            distance = norm(vec);
-            if(distance <= range){
-                vec = glm::vec4(vec.x, 0.0f, vec.z, vec.w);
-                vec = normalize(vec);
-                angle = dotproduct(facing_vector, vec);
-                angle = acos(angle);
-
-                if (angle <= 0.2618){
-                    if (role == ARCHER && characters[i].position.y < position.y)
-                    {
-                        characters[i].take_damage(2*damage, i);
-                        printf("character %d, hp %f | DOUBLE DAMAGE \n", i, characters[i].current_hp);
-                    }
-                    else
-                    {
-                        characters[i].take_damage(damage, i);
-                        printf("character %d, hp %f\n", i, characters[i].current_hp);
-                    }
-                    remaining_actions--;
-                    isAttacking = true;
-                    target = i;
-                    init_time();
-                    break;
-                }
-            }
-
-        }
+    lookat_camera.lookat = position;
+    lookat_camera.update_camera();
 }
 
-void Character::take_damage(float delta, int alvo){
-    current_hp = current_hp - delta;
-    if (current_hp > max_hp)
-        current_hp = max_hp;
-    else if (current_hp <= 0){
-        current_hp = 0;
-        characters.erase(characters.begin() + alvo);
-    }
+void PrintAttackHit(int index, float hp, bool double_damage)
+{
+    if (double_damage)
+        printf("character %d, hp %f | DOUBLE DAMAGE \n", index, hp);
+    else
+        printf("character %d, hp %f\n", index, hp);
 }
 
 void DrawCharacters() {
     for (int i = 0; i < characters.size(); i++)
+    {
         characters[i].draw();
+        characters[i].draw_projectile();
+    }
 }
 
 // set makeprg=cd\ ..\ &&\ make\ run\ >/dev/null
@@ -2234,48 +3870,6 @@ void DrawCharacters() {
 
 // Funções de Classes
 // Camera Livre
-void Free_Camera::init(glm::vec4 pos, glm::vec4 origin)
-{
-    position = pos;//glm::vec4(0.0f, 2.0f, 2.0f, 1.0f);
-    view = origin - position;
-    view = view / norm(view);
-    up = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
-    right = crossproduct(view, up);
-    right = right / norm(right);
-    v = crossproduct(view, right);
-
-    phi = acos((dotproduct(view, up)) / (norm(view)*norm(up)));
-    speed = 0.01f;
-}
-
-void Free_Camera::init_char(glm::vec4 pos, glm::vec4 look)
-{
-    glm::vec4 origin = glm::vec4(look.x, look.y + 0.28, look.z, 1.0);
-    position = glm::vec4(pos.x, pos.y + 0.28, pos.z, 1.0f);
-    view = origin - position;
-    view = view / norm(view);
-    up = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
-    right = crossproduct(view, up);
-    right = right / norm(right);
-    v = crossproduct(view, right);
-
-    phi = acos((dotproduct(view, up)) / (norm(view)*norm(up)));
-    speed = 0.01f;
-}
-
-void Free_Camera::move(glm::vec4 direction)
-{
-    position.x += speed*direction.x;
-    position.y += speed*direction.y;
-    position.z += speed*direction.z;
-}
-
-void Free_Camera::move2D(glm::vec4 direction)
-{
-    position.x += speed*direction.x;
-    position.z += speed*direction.z;
-}
-
 void Free_Camera::rotate(glm::vec4 axis, float angle)
 {
     view = Matrix_Rotate(angle, axis) * view;
@@ -2319,15 +3913,18 @@ void Lookat_Camera::init(){
     lookat = glm::vec4(0.0f,0.0f,0.0f,1.0f);
     view = lookat - position;
     //Parâmetros
-    speed = 0.01f;
+    speed = 0.6f;   // 0.01 por passo, a 60 passos por segundo
     nearplane = -0.1f;
     farplane = -10.0f;
+    save_state();
 }
 
+// Anda um passo da simulação na direção "direction"
 void Lookat_Camera::move(glm::vec4 direction)
 {
-    lookat.x += speed*direction.x;
-    lookat.z += speed*direction.z;
+    float step = speed * (float)Simulation_TickSeconds();
+    lookat.x += step*direction.x;
+    lookat.z += step*direction.z;
 
     update_camera();
 }
@@ -2370,86 +3967,20 @@ void Lookat_Camera::set_farplane(float far_value)
 }
 
 // Scenary Functions
-void Scenary::build(){
-    // Definindo o tamanho do cenário
-    land_size.x = (rand() % 75 + 25) * 0.04; // gera um número entre 25 e 100, depois escala por 0.04 para gerar um float de 1 a 4
-    land_size.z = (rand() % 75 + 25) * 0.04;
-    if ( land_size.z > 1.33*land_size.x )
-        land_size.z = 1.33*land_size.x;
-    else if ( land_size.z <  0.75*land_size.x )
-        land_size.z = 0.75*land_size.x;
-
-    if( land_size.x < 2)
-        land_size.y = land_size.x;
-    else if ( land_size.z < 2)
-        land_size.y = land_size.z;
-    else
-        land_size.y = 2;
-
-    // Definindo a quantidade de planaltos
-    int plateau_qtd = rand() % 4;   // Gera um número aleatório de planalto entre 0 e 4
-    // Laço que define os planaltos
-    for(int i = 0; i < plateau_qtd; i++){
-        Plateau plateau;
-
-        // Define o tamanho
-        if ( rand() % 2 == 0){
-            plateau.scale.x = (rand() % 15 + 10)*0.01*land_size.x;
-            plateau.scale.z = (rand() % 15 + 10)*0.01*land_size.z;
-        }
-        else{
-            plateau.scale.x = (rand() % 5 + 20)*0.01*land_size.x;
-            plateau.scale.z = (rand() % 15 + 10)*0.01*land_size.z;
-        }
-
-        plateau.scale.y = (rand() % 80 + 20)*0.01;
-        if ( plateau.scale.y > plateau.scale.x)
-            plateau.scale.y = plateau.scale.x;
-        if ( plateau.scale.y > plateau.scale.z)
-            plateau.scale.y = plateau.scale.z;
-
-        // Define a posição
-        // De acordo com o valor de i, o planalto é mandado para um determinado quadrante
-        if ( i == 0 ){ // Quadrante negativo
-            plateau.position.x = (plateau.scale.x - land_size.x) * 0.5 * (rand() % 80 + 20) * 0.01;
-            plateau.position.z = (plateau.scale.z - land_size.z) * 0.5 * (rand() % 80 + 20) * 0.01;
-        }
-        else if ( i == 1 ){
-            plateau.position.x = (land_size.x - plateau.scale.x) * 0.5 * (rand() % 80 + 20) * 0.01;
-            plateau.position.z = (plateau.scale.z - land_size.z) * 0.5 * (rand() % 80 + 20) * 0.01;
-        }
-        else if ( i == 2 ){
-            plateau.position.x = (plateau.scale.x - land_size.x) * 0.5 * (rand() % 80 + 20) * 0.01;
-            plateau.position.z = (land_size.z - plateau.scale.z) * 0.5 * (rand() % 80 + 20) * 0.01;
-        }
-        else{
-            plateau.position.x = (land_size.x - plateau.scale.x) * 0.5 * (rand() % 80 + 20) * 0.01;
-            plateau.position.z = (land_size.z - plateau.scale.z) * 0.5 * (rand() % 80 + 20) * 0.01;
-        }
-
-        plateau.position.y = plateau.scale.y * 0.5 * 0.9;
-
-        plateaus.push_back(plateau);
-    }
-
-}
-
 void Scenary::draw(){
     glm::mat4 model = Matrix_Identity(); // Transformação identidade de modelagem
 
     //Desenhamos a terra
     model = Matrix_Translate(0.0f, -land_size.y/2, 0.0f)
           * Matrix_Scale(land_size.x, land_size.y, land_size.z);
-    glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-    glUniform1i(object_id_uniform, LAND);
-    DrawVirtualObject("cube");
+    QueueVirtualObject("cube", model, LAND);
+    if (g_OcclusionCullingEnabled)
+        Occlusion_AddOccluder(model, g_VirtualScene["cube"].bbox_min, g_VirtualScene["cube"].bbox_max);
 
     //Desenhamos a água
     model = Matrix_Translate(0.0f, -land_size.y*1.1f, 0.0f)
           * Matrix_Scale(land_size.x*2, land_size.y*2, land_size.z*2);
-    glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-    glUniform1i(object_id_uniform, WATER);
-    DrawVirtualObject("cube");
+    QueueVirtualObject("cube", model, WATER);
 
     // TODO Desenhamos os planaltos
     for (int i = 0; i < plateaus.size(); i++)
@@ -2460,108 +3991,16 @@ void Scenary::draw(){
               * Matrix_Scale(plateaus[i].scale.x,
                              plateaus[i].scale.y,
                              plateaus[i].scale.z);
-        glUniformMatrix4fv(model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-        glUniform1i(object_id_uniform, LAND);
-        DrawVirtualObject("Box");
-    }
-}
-
-float Scenary::heigth(glm::vec4 dot)
-{
-    float heigth = 0.0;
-    float x_min, x_max, z_min, z_max;
-
-    // Testa se está em cima da terra primeiro
-    x_min = -(land_size.x / 2) + 0.1;
-    x_max = -x_min;
-    z_min = -(land_size.z / 2) + 0.1;
-    z_max = -z_min;
-
-    if (dot.x < x_min)
-        heigth = -1;
-    else if (dot.x > x_max)
-        heigth = -1;
-    else if (dot.z < z_min)
-        heigth = -1;
-    else if (dot.z > z_max)
-        heigth = -1;
-    else
-        heigth = 0;
-    // Se estiver fora da terra, não precisa testar os planaltos
-    if ( heigth == -1)
-        return heigth;
-
-    for(int i = 0; i < plateaus.size(); i++){
-        x_min = (plateaus[i].position.x - plateaus[i].scale.x / 2);
-        x_max = (plateaus[i].position.x + plateaus[i].scale.x / 2);
-        z_min = (plateaus[i].position.z - plateaus[i].scale.z / 2);
-        z_max = (plateaus[i].position.z + plateaus[i].scale.z / 2);
+        QueueVirtualObject("Box", model, LAND);
 
-        if (dot.x > x_min && dot.x < x_max && dot.z > z_min && dot.z < z_max)
-            heigth = plateaus[i].position.y + plateaus[i].scale.y / 2;
-
-    }
-
-    return heigth;
-}
-
-void Character::init_attributes(int type){
-    role = type;
-    switch(type){
-        case SPEARMAN:
-            max_hp = 100;
-            current_hp = max_hp;
-            max_movement = 2;
-            remaining_movement = max_movement;
-            max_actions = 1;
-            remaining_actions = max_actions;
-            range = 0.3;
-            damage = 50;
-            break;
-        case GUARDIAN:
-            max_hp = 200;
-            current_hp = max_hp;
-            max_movement = 1;
-            remaining_movement = max_movement;
-            max_actions = 1;
-            remaining_actions = max_actions;
-            range = 0.2;
-            damage = 35;
-            break;
-        case ARCHER:
-            max_hp = 70;
-            current_hp = max_hp;
-            max_movement = 2.5;
-            remaining_movement = max_movement;
-            max_actions = 1;
-            remaining_actions = max_actions;
-            range = 5;
-            damage = 50;
-            break;
+        // O modelo "Box" possui arestas arredondadas, então utilizamos como
+        // oclusor uma caixa um pouco menor que a sua AABB, que fica
+        // inteiramente dentro do modelo.
+        if (g_OcclusionCullingEnabled)
+            Occlusion_AddOccluder(model, 0.87f*g_VirtualScene["Box"].bbox_min, 0.87f*g_VirtualScene["Box"].bbox_max);
     }
 }
 
-glm::vec4 normalize(glm::vec4 aim_vector)
-{
-    float x = aim_vector.x;
-    float y = aim_vector.y;
-    float z = aim_vector.z;
-    float norm = sqrt(x*x + y*y + z*z);
-
-    return aim_vector / norm;
-}
-
-void PassTurn()
-{
-    characters[active_character].end_turn();
-    active_character++;
-    if (active_character > characters.size() - 1)
-        active_character = 0;
-
-    lookat_camera.lookat = characters[active_character].position;
-    lookat_camera.update_camera();
-}
-
 float attack_anim_melee_angle(float duration)
 {
     float t;
@@ -2576,21 +4015,6 @@ float attack_anim_melee_angle(float duration)
     return angle;
 }
 
-void init_time(void)
-{
-    old_time = (float) glfwGetTime();
-}
-
-float get_delta_time(void)
-{
-    float time;
-    time = (float) glfwGetTime();
-    /* Delta time em milisegundos. */
-    float delta_time = (time - old_time) * 1000.0;
-
-    return delta_time;
-}
-
 glm::vec4 quadratic_bezier(glm::vec4 p1, glm::vec4 p2, glm::vec4 p3, float t)
 {
     glm::vec4 c = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
@@ -0,0 +1,203 @@
+// Funções de "occlusion culling": rasterizamos no CPU, em um Z-buffer de
+// baixa resolução, as caixas dos grandes oclusores do cenário (a terra e os
+// planaltos). Depois testamos a bounding box de cada personagem contra este
+// Z-buffer: se todos os pixels cobertos pela caixa já possuem um oclusor mais
+// próximo da câmera, o personagem está escondido e não precisa ser desenhado.
+//
+// A rasterização é conservadora: um pixel só é marcado como coberto se estiver
+// totalmente dentro do triângulo oclusor, e com a maior profundidade que o
+// triângulo atinge dentro do pixel. Assim, nunca descartamos um objeto que
+// estaria ao menos parcialmente visível.
+#include <cmath>
+#include <algorithm>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Resolução do Z-buffer de oclusão
+#define OCCLUSION_WIDTH  160
+#define OCCLUSION_HEIGHT 96
+
+// Profundidade (NDC z, entre -1 e 1) do oclusor mais próximo em cada pixel.
+float g_OcclusionDepth[OCCLUSION_WIDTH * OCCLUSION_HEIGHT];
+
+// Matriz projection*view do quadro atual
+glm::mat4 g_OcclusionProjectionView;
+
+// Limpa o Z-buffer de oclusão no início de cada quadro.
+void Occlusion_BeginFrame(const glm::mat4& projection_view)
+{
+    g_OcclusionProjectionView = projection_view;
+    std::fill(g_OcclusionDepth, g_OcclusionDepth + OCCLUSION_WIDTH*OCCLUSION_HEIGHT, 1.0f);
+}
+
+// Rasteriza um triângulo já em coordenadas de tela do Z-buffer de oclusão
+// (x,y em pixels, z em NDC).
+static void Occlusion_RasterizeTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+    float area = (b.x - a.x)*(c.y - a.y) - (b.y - a.y)*(c.x - a.x);
+    if (std::fabs(area) < 1e-6f)
+        return;
+
+    // Orientamos o triângulo sempre no mesmo sentido, pois rasterizamos as
+    // duas faces das caixas oclusoras.
+    if (area < 0.0f)
+    {
+        std::swap(b, c);
+        area = -area;
+    }
+
+    int xmin = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+    int xmax = std::min(OCCLUSION_WIDTH - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+    int ymin = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+    int ymax = std::min(OCCLUSION_HEIGHT - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+    if (xmin > xmax || ymin > ymax)
+        return;
+
+    // Funções de aresta E(x,y) = ex*x + ey*y + e0, positivas dentro do triângulo
+    float e0x = a.y - b.y, e0y = b.x - a.x, e00 = a.x*b.y - a.y*b.x;
+    float e1x = b.y - c.y, e1y = c.x - b.x, e10 = b.x*c.y - b.y*c.x;
+    float e2x = c.y - a.y, e2y = a.x - c.x, e20 = c.x*a.y - c.y*a.x;
+
+    // Para que o pixel inteiro (e não só o seu centro) esteja dentro do
+    // triângulo, exigimos que cada função de aresta no centro do pixel seja
+    // maior que a sua variação máxima em meio pixel.
+    float m0 = 0.5f*(std::fabs(e0x) + std::fabs(e0y));
+    float m1 = 0.5f*(std::fabs(e1x) + std::fabs(e1y));
+    float m2 = 0.5f*(std::fabs(e2x) + std::fabs(e2y));
+
+    // Gradiente da profundidade no plano da tela, e sua variação máxima em
+    // meio pixel (usada para escrever a profundidade mais distante do pixel).
+    float dzdx = ((b.z - a.z)*(c.y - a.y) - (c.z - a.z)*(b.y - a.y)) / area;
+    float dzdy = ((c.z - a.z)*(b.x - a.x) - (b.z - a.z)*(c.x - a.x)) / area;
+    float dzmax = 0.5f*(std::fabs(dzdx) + std::fabs(dzdy));
+
+    for (int y = ymin; y <= ymax; ++y)
+    {
+        float py = y + 0.5f;
+        for (int x = xmin; x <= xmax; ++x)
+        {
+            float px = x + 0.5f;
+            if (e0x*px + e0y*py + e00 < m0 || e1x*px + e1y*py + e10 < m1 || e2x*px + e2y*py + e20 < m2)
+                continue;
+
+            float z = a.z + dzdx*(px - a.x) + dzdy*(py - a.y) + dzmax;
+            float& depth = g_OcclusionDepth[y*OCCLUSION_WIDTH + x];
+            if (z < depth)
+                depth = z;
+        }
+    }
+}
+
+// Converte um ponto de coordenadas de recorte (clip space, w > 0) para
+// coordenadas de tela do Z-buffer de oclusão.
+static glm::vec3 Occlusion_ToScreen(glm::vec4 p)
+{
+    return glm::vec3((p.x/p.w*0.5f + 0.5f) * OCCLUSION_WIDTH,
+                     (p.y/p.w*0.5f + 0.5f) * OCCLUSION_HEIGHT,
+                     p.z/p.w);
+}
+
+// Rasteriza um triângulo em coordenadas de recorte, recortando-o antes
+// contra o near plane (z >= -w), onde a divisão por w não é válida.
+static void Occlusion_ClipAndRasterize(glm::vec4 a, glm::vec4 b, glm::vec4 c)
+{
+    glm::vec4 in[3] = { a, b, c };
+    glm::vec4 out[4];
+    int count = 0;
+
+    // Algoritmo de Sutherland-Hodgman para um único plano
+    for (int i = 0; i < 3; ++i)
+    {
+        const glm::vec4& p = in[i];
+        const glm::vec4& q = in[(i + 1) % 3];
+        float dp = p.z + p.w;
+        float dq = q.z + q.w;
+
+        if (dp >= 0.0f)
+            out[count++] = p;
+        if ((dp >= 0.0f) != (dq >= 0.0f))
+            out[count++] = p + (q - p) * (dp / (dp - dq));
+    }
+
+    if (count < 3)
+        return;
+
+    glm::vec3 s0 = Occlusion_ToScreen(out[0]);
+    for (int i = 1; i + 1 < count; ++i)
+        Occlusion_RasterizeTriangle(s0, Occlusion_ToScreen(out[i]), Occlusion_ToScreen(out[i + 1]));
+}
+
+// Rasteriza no Z-buffer de oclusão a caixa (bbox_min, bbox_max), definida
+// em coordenadas locais do modelo, transformada pela matriz "model".
+void Occlusion_AddOccluder(const glm::mat4& model, glm::vec3 bbox_min, glm::vec3 bbox_max)
+{
+    glm::mat4 M = g_OcclusionProjectionView * model;
+
+    glm::vec4 corners[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec4 p((i & 1) ? bbox_max.x : bbox_min.x,
+                    (i & 2) ? bbox_max.y : bbox_min.y,
+                    (i & 4) ? bbox_max.z : bbox_min.z,
+                    1.0f);
+        corners[i] = M * p;
+    }
+
+    // As 6 faces da caixa, cada uma dividida em 2 triângulos.
+    static const int faces[6][4] = {
+        {0, 1, 3, 2}, {4, 6, 7, 5}, // z = min, z = max
+        {0, 4, 5, 1}, {2, 3, 7, 6}, // y = min, y = max
+        {0, 2, 6, 4}, {1, 5, 7, 3}  // x = min, x = max
+    };
+
+    for (int f = 0; f < 6; ++f)
+    {
+        Occlusion_ClipAndRasterize(corners[faces[f][0]], corners[faces[f][1]], corners[faces[f][2]]);
+        Occlusion_ClipAndRasterize(corners[faces[f][0]], corners[faces[f][2]], corners[faces[f][3]]);
+    }
+}
+
+// Testa se uma caixa em coordenadas globais está visível, isto é, se algum
+// pixel coberto por ela não está escondido atrás de um oclusor.
+bool Occlusion_TestBox(glm::vec3 world_min, glm::vec3 world_max)
+{
+    float xmin = 1e30f, xmax = -1e30f;
+    float ymin = 1e30f, ymax = -1e30f;
+    float zmin = 1e30f;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec4 p((i & 1) ? world_max.x : world_min.x,
+                    (i & 2) ? world_max.y : world_min.y,
+                    (i & 4) ? world_max.z : world_min.z,
+                    1.0f);
+        glm::vec4 q = g_OcclusionProjectionView * p;
+
+        // Caixa cruzando o near plane: consideramos visível.
+        if (q.z < -q.w || q.w <= 0.0f)
+            return true;
+
+        glm::vec3 s = Occlusion_ToScreen(q);
+        xmin = std::min(xmin, s.x); xmax = std::max(xmax, s.x);
+        ymin = std::min(ymin, s.y); ymax = std::max(ymax, s.y);
+        zmin = std::min(zmin, s.z);
+    }
+
+    int x0 = std::max(0, (int)std::floor(xmin));
+    int x1 = std::min(OCCLUSION_WIDTH - 1, (int)std::floor(xmax));
+    int y0 = std::max(0, (int)std::floor(ymin));
+    int y1 = std::min(OCCLUSION_HEIGHT - 1, (int)std::floor(ymax));
+
+    // Fora da tela: deixamos a decisão para o frustum culling.
+    if (x0 > x1 || y0 > y1)
+        return true;
+
+    for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x)
+            if (g_OcclusionDepth[y*OCCLUSION_WIDTH + x] >= zmin)
+                return true;
+
+    return false;
+}
@@ -0,0 +1,271 @@
+// Busca de caminhos A* sobre a grade de navegação. Veja "pathfinding.h".
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#include "pathfinding.h"
+#include "simulation.h"
+
+// Grade de navegação: altura do centro de cada célula (negativa: água), em
+// ordem de linhas (z) e colunas (x)
+static std::vector<float> pathfinding_heights;
+static int pathfinding_columns = 0;
+static int pathfinding_rows = 0;
+static float pathfinding_cell_size = PATHFINDING_CELL_SIZE;
+static float pathfinding_x_min = 0.0f;
+static float pathfinding_z_min = 0.0f;
+
+// Nós da busca, um por célula. "pathfinding_search" diz em qual busca o nó
+// foi visto pela última vez; nós de buscas anteriores valem como não
+// visitados, o que evita limpar a grade a cada busca.
+static std::vector<float> pathfinding_cost;         // Custo "g" desde o início
+static std::vector<float> pathfinding_estimate;     // Custo "f" = g + heurística
+static std::vector<int> pathfinding_parent;
+static std::vector<int> pathfinding_heap_index;     // Posição na lista aberta, ou -1 se fechado
+static std::vector<unsigned int> pathfinding_search;
+static unsigned int pathfinding_current_search = 0;
+
+// Lista aberta: heap binário de nós, pelo menor "f"
+static std::vector<int> pathfinding_heap;
+
+// Custo de subir ou descer, por unidade de altura (veja Character::move())
+#define PATHFINDING_CLIMB_COST 4.0f
+
+void Pathfinding_Build(Scenary& scenary, float cell_size)
+{
+    if (cell_size <= 0.0f)
+    {
+        fprintf(stderr, "ERROR: tamanho de celula da grade de navegacao invalido (%f).\n", cell_size);
+        cell_size = PATHFINDING_CELL_SIZE;
+    }
+    pathfinding_cell_size = cell_size;
+
+    // A grade cobre a terra, com as mesmas bordas de Scenary::heigth()
+    pathfinding_x_min = -(scenary.land_size.x / 2) + 0.1;
+    pathfinding_z_min = -(scenary.land_size.z / 2) + 0.1;
+    pathfinding_columns = std::max(1, (int)((-2 * pathfinding_x_min) / cell_size));
+    pathfinding_rows = std::max(1, (int)((-2 * pathfinding_z_min) / cell_size));
+    int count = pathfinding_columns * pathfinding_rows;
+
+    // Alturas dos centros das células, de uma vez só
+    std::vector<float> x(count), z(count);
+    for (int row = 0; row < pathfinding_rows; row++)
+    {
+        for (int column = 0; column < pathfinding_columns; column++)
+        {
+            x[row * pathfinding_columns + column] = pathfinding_x_min + (column + 0.5f) * cell_size;
+            z[row * pathfinding_columns + column] = pathfinding_z_min + (row + 0.5f) * cell_size;
+        }
+    }
+    pathfinding_heights.resize(count);
+    scenary.heigths(x.data(), z.data(), pathfinding_heights.data(), count);
+
+    pathfinding_cost.resize(count);
+    pathfinding_estimate.resize(count);
+    pathfinding_parent.resize(count);
+    pathfinding_heap_index.resize(count);
+    pathfinding_search.assign(count, 0);
+    pathfinding_current_search = 0;
+    pathfinding_heap.clear();
+    pathfinding_heap.reserve(count);
+}
+
+static int Pathfinding_Cell(glm::vec4 point)
+{
+    int column = (int)floor((point.x - pathfinding_x_min) / pathfinding_cell_size);
+    int row = (int)floor((point.z - pathfinding_z_min) / pathfinding_cell_size);
+    column = std::min(std::max(column, 0), pathfinding_columns - 1);
+    row = std::min(std::max(row, 0), pathfinding_rows - 1);
+    return row * pathfinding_columns + column;
+}
+
+static glm::vec4 Pathfinding_CellCenter(int cell)
+{
+    int row = cell / pathfinding_columns;
+    int column = cell % pathfinding_columns;
+    return glm::vec4(pathfinding_x_min + (column + 0.5f) * pathfinding_cell_size,
+                     pathfinding_heights[cell],
+                     pathfinding_z_min + (row + 0.5f) * pathfinding_cell_size,
+                     1.0f);
+}
+
+// Distância "octile" (8 direções) entre as células, que nunca é maior que o
+// custo real, pois subir ou descer só aumenta o custo
+static float Pathfinding_Heuristic(int cell, int goal)
+{
+    int dx = std::abs(cell % pathfinding_columns - goal % pathfinding_columns);
+    int dz = std::abs(cell / pathfinding_columns - goal / pathfinding_columns);
+    int diagonal = std::min(dx, dz);
+    int straight = std::max(dx, dz) - diagonal;
+    return (straight + 1.41421356f * diagonal) * pathfinding_cell_size;
+}
+
+static bool Pathfinding_HeapLess(int a, int b)
+{
+    return pathfinding_estimate[pathfinding_heap[a]] < pathfinding_estimate[pathfinding_heap[b]];
+}
+
+static void Pathfinding_HeapSwap(int a, int b)
+{
+    std::swap(pathfinding_heap[a], pathfinding_heap[b]);
+    pathfinding_heap_index[pathfinding_heap[a]] = a;
+    pathfinding_heap_index[pathfinding_heap[b]] = b;
+}
+
+static void Pathfinding_HeapUp(int i)
+{
+    while (i > 0 && Pathfinding_HeapLess(i, (i - 1) / 2))
+    {
+        Pathfinding_HeapSwap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void Pathfinding_HeapDown(int i)
+{
+    int size = (int)pathfinding_heap.size();
+    for (;;)
+    {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = 2 * i + 2;
+        if (left < size && Pathfinding_HeapLess(left, smallest))
+            smallest = left;
+        if (right < size && Pathfinding_HeapLess(right, smallest))
+            smallest = right;
+        if (smallest == i)
+            return;
+        Pathfinding_HeapSwap(i, smallest);
+        i = smallest;
+    }
+}
+
+static int Pathfinding_HeapPop()
+{
+    int node = pathfinding_heap[0];
+    Pathfinding_HeapSwap(0, (int)pathfinding_heap.size() - 1);
+    pathfinding_heap.pop_back();
+    if (!pathfinding_heap.empty())
+        Pathfinding_HeapDown(0);
+    pathfinding_heap_index[node] = -1;
+    return node;
+}
+
+bool Pathfinding_FindPath(glm::vec4 start, glm::vec4 goal, float max_cost, std::vector<glm::vec4>& path)
+{
+    path.clear();
+    if (pathfinding_heights.empty())
+        return false;
+
+    int start_cell = Pathfinding_Cell(start);
+    int goal_cell = Pathfinding_Cell(goal);
+    if (pathfinding_heights[start_cell] < 0.0f)
+        return false;
+
+    // Nova busca: todos os nós voltam a ser não visitados
+    if (++pathfinding_current_search == 0)
+    {
+        std::fill(pathfinding_search.begin(), pathfinding_search.end(), 0);
+        pathfinding_current_search = 1;
+    }
+    pathfinding_heap.clear();
+
+    // O custo começa com a distância até o centro da célula inicial, que
+    // também será andada
+    glm::vec4 start_center = Pathfinding_CellCenter(start_cell);
+    float start_cost = sqrt((start_center.x - start.x)*(start_center.x - start.x) + (start_center.z - start.z)*(start_center.z - start.z));
+
+    pathfinding_search[start_cell] = pathfinding_current_search;
+    pathfinding_cost[start_cell] = start_cost;
+    pathfinding_estimate[start_cell] = start_cost + Pathfinding_Heuristic(start_cell, goal_cell);
+    pathfinding_parent[start_cell] = -1;
+    pathfinding_heap.push_back(start_cell);
+    pathfinding_heap_index[start_cell] = 0;
+
+    // Nó alcançado mais próximo do objetivo, caso não seja possível chegar
+    int best = start_cell;
+    float best_distance = Pathfinding_Heuristic(start_cell, goal_cell);
+
+    static const int offsets[8][2] = { {1,0}, {-1,0}, {0,1}, {0,-1}, {1,1}, {1,-1}, {-1,1}, {-1,-1} };
+
+    while (!pathfinding_heap.empty())
+    {
+        int node = Pathfinding_HeapPop();
+        if (node == goal_cell)
+        {
+            best = node;
+            break;
+        }
+
+        float distance = pathfinding_estimate[node] - pathfinding_cost[node];
+        if (distance < best_distance)
+        {
+            best = node;
+            best_distance = distance;
+        }
+
+        int column = node % pathfinding_columns;
+        int row = node / pathfinding_columns;
+        float heigth = pathfinding_heights[node];
+
+        for (int k = 0; k < 8; k++)
+        {
+            int nc = column + offsets[k][0];
+            int nr = row + offsets[k][1];
+            if (nc < 0 || nr < 0 || nc >= pathfinding_columns || nr >= pathfinding_rows)
+                continue;
+            int next = nr * pathfinding_columns + nc;
+            float next_heigth = pathfinding_heights[next];
+            if (next_heigth < 0.0f)
+                continue;
+
+            float step = pathfinding_cell_size;
+            if (k >= 4)
+            {
+                // Diagonais somente em terreno plano, para não cortar o
+                // canto de um planalto ou da água
+                if (pathfinding_heights[row * pathfinding_columns + nc] != heigth ||
+                    pathfinding_heights[nr * pathfinding_columns + column] != heigth ||
+                    next_heigth != heigth)
+                    continue;
+                step *= 1.41421356f;
+            }
+
+            float cost = pathfinding_cost[node] + step + PATHFINDING_CLIMB_COST * std::abs(next_heigth - heigth);
+            if (cost > max_cost)
+                continue;
+
+            if (pathfinding_search[next] != pathfinding_current_search)
+            {
+                pathfinding_search[next] = pathfinding_current_search;
+                pathfinding_cost[next] = cost;
+                pathfinding_estimate[next] = cost + Pathfinding_Heuristic(next, goal_cell);
+                pathfinding_parent[next] = node;
+                pathfinding_heap.push_back(next);
+                pathfinding_heap_index[next] = (int)pathfinding_heap.size() - 1;
+                Pathfinding_HeapUp(pathfinding_heap_index[next]);
+            }
+            else if (cost < pathfinding_cost[next] && pathfinding_heap_index[next] >= 0)
+            {
+                pathfinding_estimate[next] -= pathfinding_cost[next] - cost;
+                pathfinding_cost[next] = cost;
+                pathfinding_parent[next] = node;
+                Pathfinding_HeapUp(pathfinding_heap_index[next]);
+            }
+        }
+    }
+
+    // Caminho de volta, do nó final até o início (sem a célula inicial)
+    for (int node = best; node != start_cell; node = pathfinding_parent[node])
+        path.push_back(Pathfinding_CellCenter(node));
+    std::reverse(path.begin(), path.end());
+
+    // Terminamos exatamente no objetivo, se ele está na última célula
+    bool reached = best == goal_cell;
+    if (reached && !path.empty())
+        path.back() = glm::vec4(goal.x, path.back().y, goal.z, 1.0f);
+    else if (reached)
+        path.push_back(glm::vec4(goal.x, pathfinding_heights[goal_cell], goal.z, 1.0f));
+    return reached;
+}
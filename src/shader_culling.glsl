@@ -0,0 +1,79 @@
+#version 430 core
+
+// Compute shader que faz o view-frustum culling de todos os objetos do quadro
+// na GPU. Cada invocação testa a AABB de um objeto contra os planos do
+// frustum e escreve o comando de desenho indireto correspondente, que será
+// consumido por glMultiDrawElementsIndirect(). Veja "gpuculling.cpp".
+layout (local_size_x = 64) in;
+
+// Dados de cada objeto, preenchidos pelo CPU. Mesmo layout de
+// "shader_vertex.glsl" (com INDIRECT_DRAW) e da estrutura GpuDrawInstance.
+struct DrawInstance
+{
+    mat4  model;    // Matriz de modelagem
+    mat4  normal_matrix; // Inversa da transposta de "model"
+    vec4  bbox_min; // AABB em coordenadas locais do modelo
+    vec4  bbox_max;
+    ivec4 params;   // (object_id, primeiro índice, número de índices, -)
+};
+
+// Mesmo layout de DrawElementsIndirectCommand da especificação de OpenGL.
+struct DrawCommand
+{
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int  base_vertex;
+    uint base_instance;
+};
+
+layout (std430, binding = 0) readonly buffer DrawInstances
+{
+    DrawInstance instances[];
+};
+
+layout (std430, binding = 1) writeonly buffer DrawCommands
+{
+    DrawCommand commands[];
+};
+
+// Planos do frustum (a,b,c,d), com a*x + b*y + c*z + d >= 0 no interior.
+uniform vec4 frustum_planes[6];
+uniform uint num_instances;
+uniform bool culling_enabled;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= num_instances)
+        return;
+
+    DrawInstance instance = instances[i];
+
+    // AABB em coordenadas globais: o centro é transformado pela matriz, e a
+    // meia-extensão pelo valor absoluto da parte linear da matriz.
+    vec3 c = 0.5 * (instance.bbox_min.xyz + instance.bbox_max.xyz);
+    vec3 e = 0.5 * (instance.bbox_max.xyz - instance.bbox_min.xyz);
+    vec3 center = (instance.model * vec4(c, 1.0)).xyz;
+    mat3 m = mat3(instance.model);
+    vec3 extent = abs(m[0])*e.x + abs(m[1])*e.y + abs(m[2])*e.z;
+
+    bool visible = true;
+    if (culling_enabled)
+    {
+        for (int p = 0; p < 6; ++p)
+        {
+            vec4 plane = frustum_planes[p];
+            if (dot(plane.xyz, center) + plane.w + dot(abs(plane.xyz), extent) < 0.0)
+                visible = false;
+        }
+    }
+
+    // Objetos descartados continuam na lista, mas com zero instâncias. O
+    // "base_instance" é usado pelo vertex shader para encontrar o objeto.
+    commands[i].count          = uint(instance.params.z);
+    commands[i].instance_count = visible ? 1u : 0u;
+    commands[i].first_index    = uint(instance.params.y);
+    commands[i].base_vertex    = 0;
+    commands[i].base_instance  = i;
+}
@@ -0,0 +1,106 @@
+#version 330 core
+
+// Passo final do caminho "deferred" (veja "deferred.cpp"): ilumina cada
+// pixel do G-buffer com o sol, como em "shader_fragment.glsl", soma a luz
+// acumulada das luzes pontuais e spots, e aplica a mesma correção gamma de
+// cada material do caminho "forward".
+in vec2 texcoords;
+
+uniform sampler2D gbuffer_albedo;
+uniform sampler2D gbuffer_normal;
+uniform sampler2D gbuffer_material;
+uniform sampler2D gbuffer_depth;
+uniform sampler2D light_buffer;
+
+uniform mat4 inverse_projection_view;
+uniform vec4 camera_position;
+
+// Multiplica a intensidade do sol (menor no modo noturno)
+uniform float sun_intensity;
+
+// Mesmos identificadores de "shader_fragment.glsl"
+#define LAND        0
+#define WATER       1
+#define CHAR_TEAM_1 2
+#define CHAR_TEAM_2 3
+
+out vec4 color;
+
+// Sombras do sol, como em "shader_fragment.glsl". Veja "shadows.cpp".
+#define SHADOW_CASCADES 3
+layout (std140) uniform ShadowParams
+{
+    mat4 shadow_matrices[SHADOW_CASCADES]; // Coordenadas globais -> [0,1]^3 de cada cascata
+    vec4 shadow_texel_sizes;               // Tamanho de um texel de cada cascata
+    vec4 shadow_settings;                  // (sombras ativas, bias de profundidade)
+};
+uniform sampler2DArrayShadow shadow_map;
+
+// Fração da luz do sol que chega ao ponto "p" (0 na sombra, 1 iluminado)
+float ShadowFactor(vec4 p, vec4 n)
+{
+    if (shadow_settings.x == 0.0)
+        return 1.0;
+
+    for (int i = 0; i < SHADOW_CASCADES; ++i)
+    {
+        vec3 c = (shadow_matrices[i] * (p + 1.5 * shadow_texel_sizes[i] * n)).xyz;
+        if (all(greaterThan(c.xy, vec2(0.01))) && all(lessThan(c.xy, vec2(0.99))) && c.z < 1.0)
+            return texture(shadow_map, vec4(c.xy, float(i), c.z - shadow_settings.y));
+    }
+    return 1.0;
+}
+
+void main()
+{
+    vec4 albedo = texture(gbuffer_albedo, texcoords);
+    if (albedo.a == 0.0) // Fundo: mantemos a cor com que a tela foi limpa
+        discard;
+
+    int object_id = int(albedo.a * 255.0 + 0.5) - 1;
+    float depth = texture(gbuffer_depth, texcoords).r;
+
+    // Escrevemos a profundidade do G-buffer, para que o que for desenhado
+    // depois deste passo (ex: texto) seja combinado corretamente com a cena.
+    gl_FragDepth = depth;
+
+    vec4 p = inverse_projection_view * vec4(2.0 * vec3(texcoords, depth) - 1.0, 1.0);
+    p /= p.w;
+
+    vec4 normal_q = texture(gbuffer_normal, texcoords);
+    vec4 n = vec4(normalize(normal_q.xyz), 0.0);
+    float q = normal_q.w;
+    vec4 material = texture(gbuffer_material, texcoords);
+
+    vec4 Kd = vec4(albedo.rgb, 1.0);
+    vec4 Ks = vec4(material.aaa, 1.0);
+    vec4 Ka = vec4(material.rgb, 1.0);
+
+    // Sol e luz ambiente, com os mesmos valores de "shader_fragment.glsl"
+    vec4 v = normalize(camera_position - p);
+    vec4 l = normalize(vec4(4.0f, 4.0f, 3.5f, 0.0f));
+    vec4 h = normalize(v + l);
+    float sun = sun_intensity * ShadowFactor(p, n);
+    vec4 I = sun * vec4(1.0,1.0,0.8,1.0);
+    vec4 Ia = vec4(0.1,0.1,0.1,1.0);
+
+    vec4 lambert_diffuse_term = Kd*I*max(0,dot(n,l));
+    vec4 ambient_term = Ka*Ia;
+    vec4 phong_specular_term  = Ks*I*max(0,pow(dot(n,h),q));
+
+    vec4 lights = vec4(texture(light_buffer, texcoords).rgb, 0.0);
+
+    if (object_id == LAND)
+    {
+        float lambert0 = sun * max(0,dot(n,l));
+        color = pow(Kd * (lambert0 + 0.01) + lights, vec4(1.0,1.0,1.0,1.0)/4.2);
+    }
+    else
+    {
+        color = lambert_diffuse_term + ambient_term + phong_specular_term + lights;
+        color = pow(color, vec4(1.0,1.0,1.0,1.0)/2.2);
+        if (object_id == WATER)
+            color = pow(color, vec4(1.0,1.0,1.0,1.0)/1.2);
+    }
+    color.a = 1.0;
+}
@@ -0,0 +1,71 @@
+#version 330 core
+
+// Fragment shader dos volumes de luz do caminho "deferred": ilumina, com uma
+// luz pontual ou spot, a superfície guardada no G-buffer no pixel atual. O
+// resultado é somado (blending aditivo) ao buffer de iluminação, e combinado
+// com a luz do sol por "shader_deferred_composite_fragment.glsl".
+flat in vec4 position_radius;
+flat in vec4 color;
+flat in vec4 spot_direction;
+
+// G-buffer. Veja as saídas com GBUFFER em "shader_fragment.glsl".
+uniform sampler2D gbuffer_albedo;
+uniform sampler2D gbuffer_normal;
+uniform sampler2D gbuffer_material;
+uniform sampler2D gbuffer_depth;
+
+// Inversa de projection * view, computada no CPU, para reconstruir a posição
+// global de cada pixel a partir da profundidade.
+uniform mat4 inverse_projection_view;
+uniform vec4 camera_position;
+uniform vec2 screen_size;
+
+out vec4 light;
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / screen_size;
+
+    float depth = texture(gbuffer_depth, uv).r;
+    vec4 albedo = texture(gbuffer_albedo, uv);
+    if (albedo.a == 0.0) // Fundo
+        discard;
+
+    // Posição global do ponto visível neste pixel
+    vec4 p_ndc = vec4(2.0 * vec3(uv, depth) - 1.0, 1.0);
+    vec4 p = inverse_projection_view * p_ndc;
+    p /= p.w;
+
+    vec4 l = vec4(position_radius.xyz, 1.0) - p;
+    float d = length(l);
+    float radius = position_radius.w;
+    if (d >= radius)
+        discard;
+    l /= d;
+
+    // Atenuação com a distância, que chega a zero no raio de alcance
+    float falloff = 1.0 - (d*d*d*d)/(radius*radius*radius*radius);
+    float attenuation = falloff * falloff / (1.0 + 25.0 * d * d);
+
+    // Cone do spot, com borda suave
+    float cos_cutoff = spot_direction.w;
+    if (cos_cutoff > -1.0)
+    {
+        float cos_angle = dot(-l.xyz, spot_direction.xyz);
+        attenuation *= smoothstep(cos_cutoff, mix(cos_cutoff, 1.0, 0.2), cos_angle);
+    }
+
+    vec4 normal_q = texture(gbuffer_normal, uv);
+    vec4 n = vec4(normalize(normal_q.xyz), 0.0);
+    float q = normal_q.w;
+    vec4 Kd = vec4(albedo.rgb, 1.0);
+    float Ks = texture(gbuffer_material, uv).a;
+
+    // Mesmo modelo de Blinn-Phong de "shader_fragment.glsl"
+    vec4 v = normalize(camera_position - p);
+    vec4 h = normalize(v + l);
+    vec4 lambert_diffuse_term = Kd * max(0.0, dot(n, l));
+    vec4 phong_specular_term  = vec4(Ks) * pow(max(0.0, dot(n, h)), q);
+
+    light = vec4((lambert_diffuse_term + phong_specular_term).rgb * color.rgb * attenuation, 1.0);
+}
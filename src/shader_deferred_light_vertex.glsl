@@ -0,0 +1,27 @@
+#version 330 core
+
+// Vertex shader dos volumes de luz do caminho "deferred" (veja
+// "deferred.cpp"). Cada instância é uma luz, desenhada como um cubo que
+// envolve a esfera de alcance da luz. Os atributos por instância têm o
+// layout da estrutura SceneLight de "lights.h".
+layout (location = 0) in vec4 model_coefficients; // Vértice do cubo [-1,1]^3
+layout (location = 1) in vec4 light_position_radius;
+layout (location = 2) in vec4 light_color;
+layout (location = 3) in vec4 light_spot_direction;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+flat out vec4 position_radius;
+flat out vec4 color;
+flat out vec4 spot_direction;
+
+void main()
+{
+    vec3 p = light_position_radius.xyz + light_position_radius.w * model_coefficients.xyz;
+    gl_Position = projection * view * vec4(p, 1.0);
+
+    position_radius = light_position_radius;
+    color           = light_color;
+    spot_direction  = light_spot_direction;
+}
@@ -18,17 +18,57 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+#ifndef LEGACY_MATRIX_INVERSES
+// Posição da câmera em coordenadas globais, computada uma vez por quadro no
+// CPU (ao invés de inverse(view) em todos os fragmentos).
+uniform vec4 camera_position;
+#endif
+
 
 // Identificador que define qual objeto está sendo desenhado no momento
 #define LAND        0
 #define WATER       1
 #define CHAR_TEAM_1 2
 #define CHAR_TEAM_2 3
+
+// Este shader é compilado em várias permutações (veja GetShaderProgram() em
+// "main.cpp"), cada uma com um dos #define abaixo, de forma que cada programa
+// contenha somente o código do material que desenha. Sem nenhum deles, temos
+// o "uber-shader" que escolhe o material pelo object_id, utilizado pelo
+// desenho indireto (onde todos os objetos são desenhados por um só programa).
+//
+//     MATERIAL_LAND      - terra e planaltos
+//     MATERIAL_WATER     - água
+//     MATERIAL_CHARACTER - personagens (cor do time vinda de team_Kd/team_Ka)
+//
+// Com GBUFFER, o shader não calcula a iluminação: as propriedades da
+// superfície são escritas no G-buffer do caminho de renderização "deferred",
+// e iluminadas depois. Veja "deferred.cpp". Com CLUSTERED_LIGHTING, além do
+// sol, o fragmento é iluminado pelas luzes pontuais e spots do seu cluster.
+// Veja "clustered.cpp".
+#if !defined(MATERIAL_LAND) && !defined(MATERIAL_WATER) && !defined(MATERIAL_CHARACTER)
+#define MATERIAL_ALL
+#define MATERIAL_LAND
+#define MATERIAL_WATER
+#define MATERIAL_CHARACTER
+#endif
+
+#ifdef INDIRECT_DRAW
+// Com desenho indireto, estes valores vêm do vertex shader por objeto, ao
+// invés de variáveis "uniform". Veja "shader_vertex.glsl".
+flat in int  instance_object_id;
+flat in vec4 instance_bbox_min;
+flat in vec4 instance_bbox_max;
+#define object_id instance_object_id
+#define bbox_min  instance_bbox_min
+#define bbox_max  instance_bbox_max
+#else
 uniform int object_id;
 
 // Parâmetros da axis-aligned bounding box (AABB) do modelo
 uniform vec4 bbox_min;
 uniform vec4 bbox_max;
+#endif
 
 // Variáveis para acesso das imagens de textura
 uniform sampler2D TextureImage0;
@@ -38,20 +78,226 @@ uniform sampler2D TextureImage3;
 uniform sampler2D TextureImage4;
 uniform sampler2D TextureImage5;
 
+// Cores de cada time, indexadas por object_id - CHAR_TEAM_1
+uniform vec4 team_Kd[2];
+uniform vec4 team_Ka[2];
+
 // Constantes
 #define M_PI   3.14159265358979323846
 #define M_PI_2 1.57079632679489661923
 
+// Opacidade da água
+#define WATER_ALPHA 0.75
+
+#ifdef GBUFFER
+// Saídas do G-buffer: refletância difusa e object_id, normal e expoente
+// especular, refletância ambiente e especular. A profundidade é o próprio
+// Z-buffer.
+layout (location = 0) out vec4 color;
+layout (location = 1) out vec4 gbuffer_normal;
+layout (location = 2) out vec4 gbuffer_material;
+#else
 // O valor de saída ("out") de um Fragment Shader é a cor final do fragmento.
 out vec4 color;
+#endif
 vec4 color0;
 
+// Sombras do sol ("cascaded shadow maps"), com o layout de ShadowParams em
+// "shadows.cpp".
+#define SHADOW_CASCADES 3
+layout (std140) uniform ShadowParams
+{
+    mat4 shadow_matrices[SHADOW_CASCADES]; // Coordenadas globais -> [0,1]^3 de cada cascata
+    vec4 shadow_texel_sizes;               // Tamanho de um texel de cada cascata
+    vec4 shadow_settings;                  // (sombras ativas, bias de profundidade)
+};
+uniform sampler2DArrayShadow shadow_map;
+
+// Fração da luz do sol que chega ao ponto "p" com normal "n": 0 na sombra, 1
+// iluminado. Utilizamos a primeira (mais detalhada) cascata que contém o
+// ponto. O ponto é deslocado na direção da normal ("normal offset"), em
+// proporção ao tamanho dos texels, para evitar que superfícies projetem
+// sombra em si mesmas.
+float ShadowFactor(vec4 p, vec4 n)
+{
+    if (shadow_settings.x == 0.0)
+        return 1.0;
+
+    for (int i = 0; i < SHADOW_CASCADES; ++i)
+    {
+        vec3 c = (shadow_matrices[i] * (p + 1.5 * shadow_texel_sizes[i] * n)).xyz;
+        if (all(greaterThan(c.xy, vec2(0.01))) && all(lessThan(c.xy, vec2(0.99))) && c.z < 1.0)
+            return texture(shadow_map, vec4(c.xy, float(i), c.z - shadow_settings.y));
+    }
+    return 1.0;
+}
+
+#ifdef CLUSTERED_LIGHTING
+// Parâmetros da grade de clusters, com o layout de ClusterParams em
+// "clustered.cpp".
+layout (std140) uniform ClusterParams
+{
+    ivec4 cluster_grid;   // Número de clusters em X, Y e Z
+    vec4  cluster_depth;  // (profundidade do near plane, Z / log(far / near))
+    vec4  cluster_screen; // (largura, altura, intensidade do sol)
+};
+
+// Intervalo (primeiro índice, número de luzes) de cada cluster em
+// cluster_indices, e os dados de cada luz (três texels, como em SceneLight).
+uniform usamplerBuffer cluster_ranges;
+uniform usamplerBuffer cluster_indices;
+uniform samplerBuffer  cluster_lights;
+
+// Soma da iluminação das luzes do cluster do fragmento, com o mesmo modelo
+// de "shader_deferred_light_fragment.glsl".
+vec4 ClusteredLighting(vec4 p, vec4 n, vec4 v, vec4 Kd, vec4 Ks, float q)
+{
+    // Cluster que contém o fragmento. As fatias em Z crescem exponencialmente
+    // com a profundidade.
+    float depth = -(view * p).z;
+    ivec3 cell;
+    cell.xy = ivec2(gl_FragCoord.xy / cluster_screen.xy * vec2(cluster_grid.xy));
+    cell.z  = int(log(max(depth, cluster_depth.x) / cluster_depth.x) * cluster_depth.y);
+    cell = clamp(cell, ivec3(0), cluster_grid.xyz - 1);
+    int cluster = (cell.z * cluster_grid.y + cell.y) * cluster_grid.x + cell.x;
+    uvec2 range = texelFetch(cluster_ranges, cluster).xy;
+
+    vec3 lights = vec3(0.0);
+    for (uint i = 0u; i < range.y; ++i)
+    {
+        int light = int(texelFetch(cluster_indices, int(range.x + i)).r);
+        vec4 position_radius = texelFetch(cluster_lights, 3*light + 0);
+        vec4 light_color     = texelFetch(cluster_lights, 3*light + 1);
+        vec4 spot_direction  = texelFetch(cluster_lights, 3*light + 2);
+
+        vec4 l = vec4(position_radius.xyz, 1.0) - p;
+        float d = length(l);
+        float radius = position_radius.w;
+        if (d >= radius)
+            continue;
+        l /= d;
+
+        float falloff = 1.0 - (d*d*d*d)/(radius*radius*radius*radius);
+        float attenuation = falloff * falloff / (1.0 + 25.0 * d * d);
+
+        float cos_cutoff = spot_direction.w;
+        if (cos_cutoff > -1.0)
+        {
+            float cos_angle = dot(-l.xyz, spot_direction.xyz);
+            attenuation *= smoothstep(cos_cutoff, mix(cos_cutoff, 1.0, 0.2), cos_angle);
+        }
+
+        vec4 h = normalize(v + l);
+        vec4 lambert_diffuse_term = Kd * max(0.0, dot(n, l));
+        vec4 phong_specular_term  = Ks * pow(max(0.0, dot(n, h)), q);
+        lights += (lambert_diffuse_term + phong_specular_term).rgb * light_color.rgb * attenuation;
+    }
+
+    return vec4(lights, 0.0);
+}
+#endif
+
+#ifdef MATERIAL_LAND
+// Material da terra, com as texturas projetadas nos três planos do modelo
+// ("triplanar mapping"): grama (TextureImage2) no plano XZ, e terra
+// (TextureImage4) nos planos YZ e XY. As três projeções são misturadas com
+// pesos dados pela normal, de forma que não precisamos descobrir, com
+// funções trigonométricas, em qual face do cubo está o fragmento. A terra
+// não é rotacionada, então a normal global tem os mesmos eixos do modelo.
+void ShadeLand(vec4 n, out vec4 Kd, out vec4 Ks, out vec4 Ka, out float q)
+{
+    // Coordenadas de textura de cada projeção. As laterais usam a posição
+    // normalizada pela AABB, e o topo a posição no modelo (repetindo a
+    // textura de grama).
+    vec3 size = (bbox_max - bbox_min).xyz;
+    vec3 p_box = (position_model - bbox_min).xyz / size;
+    vec2 uv_top = position_model.xz;
+    vec2 uv_x   = p_box.yz;
+    vec2 uv_z   = p_box.xy;
+
+    // Pesos de cada projeção: |n|^4, com as componentes pequenas zeradas, e
+    // normalizados. A potência alta deixa a transição entre as faces estreita,
+    // como na antiga escolha de uma textura por face.
+    vec3 w = n.xyz * n.xyz;
+    w = max(w * w - 0.01, 0.0);
+    w /= (w.x + w.y + w.z);
+
+    // Nas faces planas a maioria dos pesos é zero, e só amostramos as
+    // texturas necessárias. As derivadas são computadas fora dos "if", pois
+    // não são definidas dentro de controle de fluxo não uniforme.
+    vec2 dx_top = dFdx(uv_top), dy_top = dFdy(uv_top);
+    vec2 dx_x   = dFdx(uv_x),   dy_x   = dFdy(uv_x);
+    vec2 dx_z   = dFdx(uv_z),   dy_z   = dFdy(uv_z);
+
+    Kd = vec4(0.0);
+    if (w.y > 0.0)
+        Kd += w.y * textureGrad(TextureImage2, uv_top, dx_top, dy_top);
+    if (w.x > 0.0)
+        Kd += w.x * textureGrad(TextureImage4, uv_x, dx_x, dy_x);
+    if (w.z > 0.0)
+        Kd += w.z * textureGrad(TextureImage4, uv_z, dx_z, dy_z);
+
+    Ks = vec4(1.0, 1.0, 1.0, 1.0);
+    Ka = vec4(0.0, 0.5, 0.0, 1.0);
+    q = 64.0;
+}
+#endif
+
+#ifdef MATERIAL_WATER
+// Material da água: a face de cima usa um mapa de normais.
+void ShadeWater(inout vec4 n, out vec4 Kd, out vec4 Ks, out vec4 Ka, out float q)
+{
+    float U = 0.0;
+    float V = 0.0;
+
+    // Vetor p partindo do centro até o ponto
+    vec4 p_model = position_model - vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // Determinando a face
+    // Top: o ângulo entre o eixo y e as projeções de p_model nos planos XY
+    // e YZ é no máximo 45 graus, isto é, y >= |x| e y >= |z|. Comparamos
+    // diretamente as coordenadas, sem normalizar vetores nem usar acos().
+    if (p_model.y >= abs(p_model.x) && p_model.y >= abs(p_model.z))
+    {
+        U = position_model.x;
+        V = position_model.z;
+        // Calculando normais
+        Kd = texture(TextureImage3, vec2(U,V)).rgba;
+        n.x = (Kd.x);
+        n.y = (Kd.z);
+        n.z = (Kd.y);
+        n.w = 0.0f;
+        n = normalize(n);
+    }
+
+    //Kd = texture(TextureImage1, vec2(U,V)).rgba;
+    Kd = vec4(0.01f, 0.45f, 0.87f, 0.01f);
+    //Kd = vec4(Kd.x, Kd.z, Kd.y, 1.0f);
+    Ks = vec4(0.5, 0.5, 0.5, 1.0f);
+    Ka = vec4(0.05, 0.45, 0.8, 1.0);
+    q = 1024.0;
+}
+#endif
+
+#ifdef MATERIAL_CHARACTER
+// Material dos personagens, com a cor do time.
+void ShadeCharacter(int team, out vec4 Kd, out vec4 Ks, out vec4 Ka, out float q)
+{
+    Kd = team_Kd[team];
+    Ks = vec4(0.5,0.5,0.5,1.0);
+    Ka = team_Ka[team];
+    q = 128.0;
+}
+#endif
+
 void main()
 {
+#ifdef LEGACY_MATRIX_INVERSES
     // Obtemos a posição da câmera utilizando a inversa da matriz que define o
     // sistema de coordenadas da câmera.
     vec4 origin = vec4(0.0, 0.0, 0.0, 1.0);
     vec4 camera_position = inverse(view) * origin;
+#endif
 
     // O fragmento atual é coberto por um ponto que percente à superfície de um
     // dos objetos virtuais da cena. Este ponto, p, possui uma posição no
@@ -82,154 +328,13 @@ void main()
     vec4 Ka; // Refletância ambiente
     float q; // Expoente especular para o modelo de iluminação de Phong
 
-    float U = 0.0;
-    float V = 0.0;
-
+#if defined(MATERIAL_ALL)
     if ( object_id == LAND )
-    {
-        // limites
-        float minx = bbox_min.x;
-        float maxx = bbox_max.x;
-
-        float miny = bbox_min.y;
-        float maxy = bbox_max.y;
-
-        float minz = bbox_min.z;
-        float maxz = bbox_max.z;
-
-        vec4 bbox_center = (bbox_min + bbox_max) / 2.0;
-
-        float theta;
-        float phi;
-        float phi2;
-
-        // Vetor p partindo do centro até o ponto
-        vec4 p_model = position_model - vec4(0.0f, 0.0f, 0.0f, 1.0f);
-        p_model = normalize(p_model);
-        // Vetor unitário do eixo y
-        vec4 up = vec4(0.0f, 1.0f, 0.0f, 0.0f);
-        // Vetor unitário eixo x
-        vec4 vecX = vec4(1.0f, 0.0f, 0.0f, 0.0f);
-        // Projeção do vetor p_model no plano xz
-        vec4 p_modelXZ = vec4(p_model.x, 0.0f, p_model.z, p_model.w);
-        p_modelXZ = normalize(p_modelXZ);
-        // Projeção do vetor p_model no plano xy
-        vec4 p_modelXY = vec4(p_model.x, p_model.y, 0.0f, p_model.w);
-        p_modelXY = normalize(p_modelXY);
-        // Projeção do vetor p_model no plano yz
-        vec4 p_modelYZ = vec4(0.0f, p_model.y, p_model.z, p_model.w);
-        p_modelYZ = normalize(p_modelYZ);
-        // Ângulos
-        phi = dot(p_modelXY, up);
-        phi = acos(phi);
-        phi2 = dot(p_modelYZ, up);
-        phi2 = acos(phi2);
-        theta = dot(p_modelXZ, vecX);
-        theta = acos(theta);
-        // Determinando a face
-        // Top
-        if (phi <= M_PI / 4 && phi2 <= M_PI / 4)
-        {
-            /*U = (position_model.x - minx)/(maxx - minx);
-            V = (position_model.z - minz)/(maxz - minz);*/
-            U = position_model.x;
-            V = position_model.z;
-            Kd = texture(TextureImage2, vec2(U,V)).rgba;
-        }
-        // Front
-        else if (theta <= M_PI / 4)
-        {
-            U = (position_model.y - miny)/(maxy - miny);
-            V = (position_model.z - minz)/(maxz - minz);
-            Kd = texture(TextureImage4, vec2(U,V)).rgba;
-        }
-        // Sides
-        else if (theta > M_PI / 4 && theta <= 3 * M_PI / 4)
-        {
-            U = (position_model.x - minx)/(maxx - minx);
-            V = (position_model.y - miny)/(maxy - miny);
-            Kd = texture(TextureImage4, vec2(U,V)).rgba;
-        }
-        // Back
-        else if (theta > 3 * M_PI / 4 && theta <= M_PI)
-        {
-            U = (position_model.y - miny)/(maxy - miny);
-            V = (position_model.z - minz)/(maxz - minz);
-            Kd = texture(TextureImage4, vec2(U,V)).rgba;
-        }
-        else
-        {
-            U = (theta + M_PI) / (2*M_PI);
-            V = (phi + M_PI_2) / M_PI;
-            Kd = texture(TextureImage2, vec2(U,V)).rgba;
-        }
-        Ks = vec4(1.0, 1.0, 1.0, 1.0);
-        Ka = vec4(0.0, 0.5, 0.0, 1.0);
-        q = 64.0;
-    }
+        ShadeLand(n, Kd, Ks, Ka, q);
     else if ( object_id == WATER )
-    {
-        float phi;
-        float phi2;
-
-        // Vetor p partindo do centro até o ponto
-        vec4 p_model = position_model - vec4(0.0f, 0.0f, 0.0f, 1.0f);
-        p_model = normalize(p_model);
-        // Vetor unitário do eixo y
-        vec4 up = vec4(0.0f, 1.0f, 0.0f, 0.0f);
-        // Vetor unitário eixo x
-        vec4 vecX = vec4(1.0f, 0.0f, 0.0f, 0.0f);
-        // Projeção do vetor p_model no plano xz
-        vec4 p_modelXZ = vec4(p_model.x, 0.0f, p_model.z, p_model.w);
-        p_modelXZ = normalize(p_modelXZ);
-        // Projeção do vetor p_model no plano xy
-        vec4 p_modelXY = vec4(p_model.x, p_model.y, 0.0f, p_model.w);
-        p_modelXY = normalize(p_modelXY);
-        // Projeção do vetor p_model no plano yz
-        vec4 p_modelYZ = vec4(0.0f, p_model.y, p_model.z, p_model.w);
-        p_modelYZ = normalize(p_modelYZ);
-        // Ângulos
-        phi = dot(p_modelXY, up);
-        phi = acos(phi);
-        phi2 = dot(p_modelYZ, up);
-        phi2 = acos(phi2);
-
-        // Determinando a face
-        // Top
-        if (phi <= M_PI / 4 && phi2 <= M_PI / 4)
-        {
-            U = position_model.x;
-            V = position_model.z;
-            // Calculando normais
-            Kd = texture(TextureImage3, vec2(U,V)).rgba;
-            n.x = (Kd.x);
-            n.y = (Kd.z);
-            n.z = (Kd.y);
-            n.w = 0.0f;
-            n = normalize(n);
-        }
-
-        //Kd = texture(TextureImage1, vec2(U,V)).rgba;
-        Kd = vec4(0.01f, 0.45f, 0.87f, 0.01f);
-        //Kd = vec4(Kd.x, Kd.z, Kd.y, 1.0f);
-        Ks = vec4(0.5, 0.5, 0.5, 1.0f);
-        Ka = vec4(0.05, 0.45, 0.8, 1.0);
-        q = 1024.0;
-    }
-    else if ( object_id == CHAR_TEAM_1)
-    {
-        Kd = vec4(1.0,0.01,0.01,1.0);
-        Ks = vec4(0.5,0.5,0.5,1.0);
-        Ka = vec4(0.9,0.1,0.1,1.0);
-        q = 128.0;
-    }
-    else if ( object_id == CHAR_TEAM_2)
-    {
-        Kd = vec4(0.01,0.2,1.0,1.0);
-        Ks = vec4(0.5,0.5,0.5,1.0);
-        Ka = vec4(0.2,0.2,1.0,1.0);
-        q = 128.0;
-    }
+        ShadeWater(n, Kd, Ks, Ka, q);
+    else if ( object_id == CHAR_TEAM_1 || object_id == CHAR_TEAM_2 )
+        ShadeCharacter(object_id - CHAR_TEAM_1, Kd, Ks, Ka, q);
     else // Objeto desconhecido = preto
     {
         Kd = vec4(0.0,0.0,0.0,1.0);
@@ -237,8 +342,37 @@ void main()
         Ka = vec4(0.0,0.0,0.0,1.0);
         q = 20.0;
     }
-
-    vec4 I = vec4(1.0,1.0,0.8,1.0); // Espectro da fonte de iluminação
+#elif defined(MATERIAL_LAND)
+    ShadeLand(n, Kd, Ks, Ka, q);
+#elif defined(MATERIAL_WATER)
+    ShadeWater(n, Kd, Ks, Ka, q);
+#elif defined(MATERIAL_CHARACTER)
+    ShadeCharacter(object_id - CHAR_TEAM_1, Kd, Ks, Ka, q);
+#endif
+
+#ifdef GBUFFER
+    // O object_id é guardado como (object_id + 1) / 255, para que o valor 0
+    // (cor com que o G-buffer é limpo) indique fundo. Todos os materiais
+    // têm Ks cinza, e por isso guardamos somente um canal.
+    color            = vec4(Kd.rgb, float(object_id + 1) / 255.0);
+    gbuffer_normal   = vec4(n.xyz, q);
+    gbuffer_material = vec4(Ka.rgb, Ks.r);
+    return;
+#endif
+
+#ifdef CLUSTERED_LIGHTING
+    // Intensidade do sol (mais fraco no modo noturno) e luzes do cluster
+    float sun = cluster_screen.z;
+    vec4 point_lights = ClusteredLighting(p, n, v, Kd, Ks, q);
+#else
+    float sun = 1.0;
+    vec4 point_lights = vec4(0.0);
+#endif
+
+    // Sombras projetadas pelo sol. Veja "shadows.cpp".
+    sun *= ShadowFactor(p, n);
+
+    vec4 I = sun * vec4(1.0,1.0,0.8,1.0); // Espectro da fonte de iluminação
 
     // Espectro da luz ambiente
     vec4 Ia = vec4(0.1,0.1,0.1,1.0);
@@ -254,25 +388,37 @@ void main()
 
     float lambert0 = max(0,dot(n,l));
 
-    color0 = Kd * (lambert0 + 0.01);
+    color0 = Kd * (sun * lambert0 + 0.01) + point_lights;
 
     // Cor final do fragmento calculada com uma combinação dos termos difuso,
     // especular, e ambiente. Veja slide 133 do documento "Aula_17_e_18_Modelos_de_Iluminacao.pdf".
-    color = lambert_diffuse_term + ambient_term + phong_specular_term;
+    color = lambert_diffuse_term + ambient_term + phong_specular_term + point_lights;
 
     // Cor final com correção gamma, considerando monitor sRGB.
     // Veja https://en.wikipedia.org/w/index.php?title=Gamma_correction&oldid=751281772#Windows.2C_Mac.2C_sRGB_and_TV.2Fvideo_standard_gammas
     color = pow(color, vec4(1.0,1.0,1.0,1.0)/2.2);
 
+#if defined(MATERIAL_ALL)
     if(object_id == LAND)
          color = pow(color0, vec4(1.0,1.0,1.0,1.0)/4.2);
 
     else if(object_id == WATER)
-    {
          color = pow(color, vec4(1.0,1.0,1.0,1.0)/1.2);
-         color.a = 0.1;
-    }
-    color.a = 0.1;
+#elif defined(MATERIAL_LAND)
+    color = pow(color0, vec4(1.0,1.0,1.0,1.0)/4.2);
+#elif defined(MATERIAL_WATER)
+    color = pow(color, vec4(1.0,1.0,1.0,1.0)/1.2);
+#endif
+
+    // Somente a água é transparente, e é desenhada com blending depois dos
+    // objetos opacos. Veja DrawRenderQueue() em "main.cpp".
+    color.a = 1.0;
+#if defined(MATERIAL_ALL)
+    if (object_id == WATER)
+        color.a = WATER_ALPHA;
+#elif defined(MATERIAL_WATER)
+    color.a = WATER_ALPHA;
+#endif
 
 }
 
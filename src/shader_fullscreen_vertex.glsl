@@ -0,0 +1,15 @@
+#version 330 core
+
+// Vertex shader que desenha um triângulo cobrindo a tela inteira, sem
+// nenhum atributo de vértice: as posições são geradas a partir de
+// gl_VertexID. Utilizado pelos passos de tela cheia de "deferred.cpp" e
+// pela ampliação de "dynamicresolution.cpp".
+out vec2 texcoords;
+
+void main()
+{
+    // Vértices (-1,-1), (3,-1) e (-1,3) em NDC
+    vec2 p = vec2((gl_VertexID == 1) ? 3.0 : -1.0, (gl_VertexID == 2) ? 3.0 : -1.0);
+    texcoords = 0.5 * p + 0.5;
+    gl_Position = vec4(p, 0.0, 1.0);
+}
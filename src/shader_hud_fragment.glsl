@@ -0,0 +1,15 @@
+#version 330 core
+
+// Composição do HUD retido (veja "hud.cpp") sobre a cena. A textura tem a
+// resolução da janela e cores com alfa pré-multiplicado; o blending é
+// glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA).
+in vec2 texcoords;
+
+uniform sampler2D hud;
+
+out vec4 color;
+
+void main()
+{
+    color = texture(hud, texcoords);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+// Visualização do overdraw (tecla X, veja "depthprepass.cpp"): cada
+// fragmento que passa no teste de profundidade soma esta cor ao pixel, com
+// glBlendFunc(GL_ONE, GL_ONE), sobre um fundo preto. Um fragmento por pixel
+// resulta em vermelho escuro, quatro em vermelho, oito em laranja, e
+// dezesseis ou mais em branco.
+out vec4 color;
+
+void main()
+{
+    color = vec4(0.25, 0.125, 0.0625, 1.0);
+}
@@ -0,0 +1,8 @@
+#version 330 core
+
+// Fragment shader dos shadow maps e do "depth pre-pass" (veja
+// DrawRenderQueue() em "main.cpp"): nenhuma cor é escrita, somente a
+// profundidade, pelo próprio Z-buffer.
+void main()
+{
+}
@@ -0,0 +1,14 @@
+#version 330 core
+
+// Vertex shader dos shadow maps (veja "shadows.cpp"): somente a posição de
+// cada vértice, projetada na direção do sol. Utiliza o mesmo VAO dos
+// objetos de "shader_vertex.glsl".
+layout (location = 0) in vec4 model_coefficients;
+
+uniform mat4 model;
+uniform mat4 light_projection_view;
+
+void main()
+{
+    gl_Position = light_projection_view * model * model_coefficients;
+}
@@ -0,0 +1,38 @@
+#version 330 core
+
+// Ampliação da cena desenhada com resolução reduzida (veja
+// "dynamicresolution.cpp") para a janela. A imagem é amostrada com filtro
+// bilinear, e então realçada ("sharpening"): somamos a diferença entre o
+// pixel e a média dos seus quatro vizinhos, e limitamos o resultado às cores
+// da vizinhança, para não criar halos em torno das bordas.
+in vec2 texcoords;
+
+uniform sampler2D source;
+uniform vec2 source_scale; // Fração da textura ocupada pela cena
+uniform vec2 source_max;   // Maior coordenada de textura dentro da cena
+uniform vec2 texel_size;   // Tamanho de um texel da textura
+uniform float sharpness;   // 0: somente bilinear
+
+out vec4 color;
+
+vec3 Sample(vec2 uv)
+{
+    return texture(source, min(uv, source_max)).rgb;
+}
+
+void main()
+{
+    vec2 uv = texcoords * source_scale;
+
+    vec3 c = Sample(uv);
+    vec3 n = Sample(uv + vec2(0.0, texel_size.y));
+    vec3 s = Sample(uv - vec2(0.0, texel_size.y));
+    vec3 e = Sample(uv + vec2(texel_size.x, 0.0));
+    vec3 w = Sample(uv - vec2(texel_size.x, 0.0));
+
+    vec3 neighbourhood_min = min(c, min(min(n, s), min(e, w)));
+    vec3 neighbourhood_max = max(c, max(max(n, s), max(e, w)));
+
+    vec3 sharpened = c + sharpness * (c - 0.25 * (n + s + e + w));
+    color = vec4(clamp(sharpened, neighbourhood_min, neighbourhood_max), 1.0);
+}
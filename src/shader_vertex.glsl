@@ -7,10 +7,40 @@ layout (location = 1) in vec4 normal_coefficients;
 layout (location = 2) in vec2 texture_coefficients;
 
 // Matrizes computadas no cdigo C++ e enviadas para a GPU
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+#ifdef INDIRECT_DRAW
+// Quando desenhamos com glMultiDrawElementsIndirect() (veja "gpuculling.cpp"),
+// a matriz de modelagem e os demais dados de cada objeto so lidos de um
+// shader storage buffer, indexado pelo atributo "draw_id" (que avana uma vez
+// por instncia, a partir do "base_instance" de cada comando de desenho).
+struct DrawInstance
+{
+    mat4  model;
+    mat4  normal_matrix;
+    vec4  bbox_min;
+    vec4  bbox_max;
+    ivec4 params;   // (object_id, primeiro ndice, nmero de ndices, -)
+};
+
+layout (std430, binding = 0) readonly buffer DrawInstances
+{
+    DrawInstance instances[];
+};
+
+layout (location = 3) in int draw_id;
+
+flat out int  instance_object_id;
+flat out vec4 instance_bbox_min;
+flat out vec4 instance_bbox_max;
+#else
+uniform mat4 model;
+
+// Inversa da transposta de "model", computada uma vez por objeto no CPU.
+uniform mat4 normal_matrix;
+#endif
+
 // Atributos de vrtice que sero gerados como sada ("out") pelo Vertex Shader.
 // ** Estes sero interpolados pelo rasterizador! ** gerando, assim, valores
 // para cada fragmento, os quais sero recebidos como entrada pelo Fragment
@@ -20,8 +50,22 @@ out vec4 position_model;
 out vec4 normal;
 out vec2 texcoords;
 
+// O "depth pre-pass" (DEPTH_PREPASS, veja DrawRenderQueue() em "main.cpp")
+// escreve a profundidade com este mesmo shader, e a cor  desenhada depois
+// com glDepthFunc(GL_EQUAL): "invariant" garante que as duas passadas
+// computem exatamente a mesma profundidade para cada vrtice.
+invariant gl_Position;
+
 void main()
 {
+#ifdef INDIRECT_DRAW
+    mat4 model = instances[draw_id].model;
+    mat4 normal_matrix = instances[draw_id].normal_matrix;
+    instance_object_id = instances[draw_id].params.x;
+    instance_bbox_min  = instances[draw_id].bbox_min;
+    instance_bbox_max  = instances[draw_id].bbox_max;
+#endif
+
     // A varivel gl_Position define a posio final de cada vrtice
     // OBRIGATORIAMENTE em "normalized device coordinates" (NDC), onde cada
     // coeficiente estar entre -1 e 1 aps diviso por w.
@@ -36,6 +80,11 @@ void main()
 
     gl_Position = projection * view * model * model_coefficients;
 
+#ifdef DEPTH_PREPASS
+    // Somente a profundidade ser escrita: no precisamos dos demais atributos.
+    return;
+#endif
+
     // Como as variveis acima  (tipo vec4) so vetores com 4 coeficientes,
     // tambm  possvel acessar e modificar cada coeficiente de maneira
     // independente. Esses so indexados pelos nomes x, y, z, e w (nessa
@@ -58,7 +107,14 @@ void main()
 
     // Normal do vrtice atual no sistema de coordenadas global (World).
     // Veja slide 107 do documento "Aula_07_Transformacoes_Geometricas_3D.pdf".
+    // A matriz inverse(transpose(model))  a mesma para todos os vrtices do
+    // objeto, e por isso  computada no CPU. LEGACY_MATRIX_INVERSES mantm o
+    // clculo antigo, por vrtice, para comparao no modo de benchmark.
+#ifdef LEGACY_MATRIX_INVERSES
     normal = inverse(transpose(model)) * normal_coefficients;
+#else
+    normal = normal_matrix * normal_coefficients;
+#endif
     normal.w = 0.0;
 
     texcoords = texture_coefficients;
@@ -0,0 +1,263 @@
+// Cache em disco de programas de GPU já linkados. Com OpenGL 4.1 (ou a
+// extensão ARB_get_program_binary), o driver pode nos entregar um programa
+// linkado em um formato binário próprio (glGetProgramBinary), que pode ser
+// carregado em uma próxima execução (glProgramBinary) sem compilar os shaders.
+//
+// Cada programa é guardado em um arquivo cujo nome é um hash do código dos
+// seus shaders (incluindo os #define das permutações) e das strings de
+// vendor, renderer e versão de OpenGL. Qualquer mudança em um destes gera um
+// hash diferente; e se o driver recusar o binário (ex: driver atualizado sem
+// mudar a string de versão), o programa é simplesmente compilado de novo.
+//
+// O arquivo de índice guarda o hash do driver e os arquivos do cache, do
+// mais antigo para o mais novo. Se o driver muda, todos os arquivos são
+// removidos; e no máximo SHADERCACHE_MAX_FILES são mantidos, removendo os
+// mais antigos, para que a pasta não cresça sem limite ao editar os shaders.
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "glextensions.h"
+
+// Pasta do cache, relativa à pasta do executável (ex: "bin/Linux/")
+#define SHADERCACHE_DIRECTORY "shadercache"
+
+// Índice dos arquivos do cache, na mesma pasta
+#define SHADERCACHE_INDEX SHADERCACHE_DIRECTORY "/index.txt"
+
+// Número máximo de programas no cache. Cada execução utiliza algumas dezenas
+// (as permutações de cada caminho de renderização).
+#define SHADERCACHE_MAX_FILES 256
+
+// Identifica os arquivos do cache ("SWPB")
+#define SHADERCACHE_MAGIC 0x42505753u
+
+// Cabeçalho de cada arquivo do cache, seguido de "length" bytes do binário.
+struct ShaderCacheHeader
+{
+    unsigned int       magic;
+    unsigned int       key_length; // Tamanho da chave, para detectar colisões do hash
+    unsigned long long key_hash;
+    GLenum             format;     // Formato retornado por glGetProgramBinary()
+    GLint              length;
+};
+
+bool g_ShaderCacheEnabled = false;
+
+// Vendor, renderer e versão de OpenGL, que fazem parte da chave de todos os
+// programas: um binário só é válido para o mesmo driver e GPU.
+std::string g_ShaderCacheDevice;
+
+// Hashes dos arquivos do cache, do mais antigo para o mais novo. Veja
+// ShaderCache_WriteIndex().
+static std::vector<unsigned long long> shadercache_index;
+
+// Hash FNV-1a de 64 bits
+static unsigned long long ShaderCache_Hash(const std::string& key)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < key.size(); ++i)
+    {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::string ShaderCache_Filename(unsigned long long key_hash)
+{
+    char filename[64];
+    snprintf(filename, 64, SHADERCACHE_DIRECTORY "/%016llx.bin", key_hash);
+    return filename;
+}
+
+// Grava o índice: o hash do driver na primeira linha, e depois o hash de
+// cada arquivo do cache, um por linha.
+static void ShaderCache_WriteIndex()
+{
+    FILE* file = fopen(SHADERCACHE_INDEX, "w");
+    if ( file == NULL )
+        return;
+
+    fprintf(file, "%016llx\n", ShaderCache_Hash(g_ShaderCacheDevice));
+    for (size_t i = 0; i < shadercache_index.size(); ++i)
+        fprintf(file, "%016llx\n", shadercache_index[i]);
+    fclose(file);
+}
+
+// Lê o índice. Se ele é de outro driver (ou não existe), os arquivos que ele
+// lista são removidos, pois nunca mais seriam utilizados.
+static void ShaderCache_ReadIndex()
+{
+    shadercache_index.clear();
+
+    unsigned long long device_hash = 0;
+    FILE* file = fopen(SHADERCACHE_INDEX, "r");
+    if ( file != NULL )
+    {
+        unsigned long long key_hash;
+        if ( fscanf(file, "%llx", &device_hash) != 1 )
+            device_hash = 0;
+        while ( fscanf(file, "%llx", &key_hash) == 1 )
+            shadercache_index.push_back(key_hash);
+        fclose(file);
+    }
+
+    if ( device_hash != ShaderCache_Hash(g_ShaderCacheDevice) )
+    {
+        for (size_t i = 0; i < shadercache_index.size(); ++i)
+            remove(ShaderCache_Filename(shadercache_index[i]).c_str());
+        shadercache_index.clear();
+        ShaderCache_WriteIndex();
+    }
+}
+
+// Inicializa o cache. Deve ser chamada após GLExtensions_Load(), e antes de
+// qualquer programa de GPU ser criado.
+void ShaderCache_Init()
+{
+    g_ShaderCacheEnabled = false;
+    if ( !GLEXT_ARB_get_program_binary )
+        return;
+
+    // Alguns drivers suportam a extensão, mas nenhum formato binário.
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    if ( num_formats == 0 )
+        return;
+
+    g_ShaderCacheDevice  = (const char*)glGetString(GL_VENDOR);
+    g_ShaderCacheDevice += "\n";
+    g_ShaderCacheDevice += (const char*)glGetString(GL_RENDERER);
+    g_ShaderCacheDevice += "\n";
+    g_ShaderCacheDevice += (const char*)glGetString(GL_VERSION);
+    g_ShaderCacheDevice += "\n";
+
+    // Criamos a pasta do cache, caso ela ainda não exista.
+#ifdef _WIN32
+    _mkdir(SHADERCACHE_DIRECTORY);
+#else
+    mkdir(SHADERCACHE_DIRECTORY, 0755);
+#endif
+
+    ShaderCache_ReadIndex();
+    g_ShaderCacheEnabled = true;
+}
+
+// Deve ser chamada antes de glLinkProgram(), para que o driver mantenha o
+// binário do programa disponível para ShaderCache_StoreProgram().
+void ShaderCache_SetRetrievable(GLuint program_id)
+{
+    if ( g_ShaderCacheEnabled )
+        glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+// Procura no cache um programa cujos shaders têm o código "sources". Retorna
+// o programa já linkado, ou 0 se ele não está no cache (ou não é válido).
+GLuint ShaderCache_LoadProgram(const std::string& sources)
+{
+    if ( !g_ShaderCacheEnabled )
+        return 0;
+
+    std::string key = g_ShaderCacheDevice + sources;
+    unsigned long long key_hash = ShaderCache_Hash(key);
+
+    FILE* file = fopen(ShaderCache_Filename(key_hash).c_str(), "rb");
+    if ( file == NULL )
+        return 0;
+
+    ShaderCacheHeader header;
+    std::vector<char> binary;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+           && header.magic == SHADERCACHE_MAGIC
+           && header.key_hash == key_hash
+           && header.key_length == key.size()
+           && header.length > 0;
+    if ( ok )
+    {
+        binary.resize(header.length);
+        ok = fread(binary.data(), 1, header.length, file) == (size_t)header.length;
+    }
+    fclose(file);
+
+    if ( !ok )
+        return 0;
+
+    GLuint program_id = glCreateProgram();
+    glProgramBinary(program_id, header.format, binary.data(), header.length);
+
+    GLint linked_ok = GL_FALSE;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &linked_ok);
+    if ( linked_ok == GL_FALSE )
+    {
+        glDeleteProgram(program_id);
+        return 0;
+    }
+
+    return program_id;
+}
+
+// Guarda no cache o binário de um programa já linkado, cujos shaders têm o
+// código "sources".
+void ShaderCache_StoreProgram(GLuint program_id, const std::string& sources)
+{
+    if ( !g_ShaderCacheEnabled )
+        return;
+
+    GLint linked_ok = GL_FALSE;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &linked_ok);
+    if ( linked_ok == GL_FALSE )
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if ( length <= 0 )
+        return;
+
+    std::string key = g_ShaderCacheDevice + sources;
+
+    ShaderCacheHeader header;
+    header.magic      = SHADERCACHE_MAGIC;
+    header.key_length = key.size();
+    header.key_hash   = ShaderCache_Hash(key);
+    header.format     = 0;
+    header.length     = 0;
+
+    std::vector<char> binary(length);
+    glGetProgramBinary(program_id, length, &header.length, &header.format, binary.data());
+    if ( header.length <= 0 )
+        return;
+
+    FILE* file = fopen(ShaderCache_Filename(header.key_hash).c_str(), "wb");
+    if ( file == NULL )
+        return;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+           && fwrite(binary.data(), 1, header.length, file) == (size_t)header.length;
+    fclose(file);
+
+    // Um arquivo incompleto seria apenas recusado na próxima execução, mas
+    // o removemos para não ocupar espaço.
+    if ( !ok )
+    {
+        remove(ShaderCache_Filename(header.key_hash).c_str());
+        return;
+    }
+
+    // O arquivo passa a ser o mais novo do índice; os mais antigos além do
+    // limite são removidos.
+    shadercache_index.erase(std::remove(shadercache_index.begin(), shadercache_index.end(), header.key_hash), shadercache_index.end());
+    shadercache_index.push_back(header.key_hash);
+    while ( shadercache_index.size() > SHADERCACHE_MAX_FILES )
+    {
+        remove(ShaderCache_Filename(shadercache_index.front()).c_str());
+        shadercache_index.erase(shadercache_index.begin());
+    }
+    ShaderCache_WriteIndex();
+}
@@ -0,0 +1,443 @@
+// Sombras do sol com "cascaded shadow maps". O frustum da câmera é dividido
+// em SHADOW_CASCADES fatias de profundidade, e cada fatia tem o seu próprio
+// shadow map (uma camada de uma textura de profundidade 2D array), com uma
+// projeção ortográfica na direção do sol. Fatias próximas à câmera cobrem
+// uma área pequena e têm mais resolução por unidade de área.
+//
+// O terreno e os planaltos (construídos por Scenary::build()) nunca se
+// movem, então são desenhados em uma textura separada ("cache estático")
+// somente quando uma cascata muda de posição, quando a direção do sol muda,
+// ou quando o mapa muda. A cada quadro, copiamos o cache para o shadow map
+// e desenhamos por cima somente os objetos dinâmicos (personagens, armas,
+// projéteis). Para que as cascatas mudem de posição raramente, cada uma
+// cobre uma área um pouco maior que a sua fatia do frustum, e só é
+// reposicionada quando a fatia sai desta área. A posição é alinhada aos
+// texels do shadow map, para que as bordas das sombras não "tremam".
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/common.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// Funções definidas em main.cpp e culling.cpp
+GLuint LoadGpuProgram(const char* vertex_filename, const char* fragment_filename, const char* header);
+void Culling_TransformAABB(const glm::mat4& model, glm::vec3 bbox_min, glm::vec3 bbox_max, glm::vec3& world_min, glm::vec3& world_max);
+
+#define SHADOW_CASCADES 3
+#define SHADOW_MAP_SIZE 1024
+
+// Distância máxima da câmera com sombras. O mapa inteiro (incluindo a
+// água) tem no máximo 8 unidades de largura.
+#define SHADOW_MAX_DISTANCE 10.0f
+
+// Quanto a área de cada cascata é maior que a esfera que envolve a sua
+// fatia do frustum. Quanto maior, menos vezes o cache estático é redesenhado,
+// mas menor a resolução das sombras.
+#define SHADOW_CASCADE_PADDING 1.3f
+
+// Unidade de textura do shadow map e ponto de ligação do uniform block
+// ShadowParams. Veja "clustered.cpp" para as unidades e pontos anteriores.
+#define SHADOW_MAP_UNIT 18
+#define SHADOW_PARAMS_BINDING 1
+
+// Mesmo layout (std140) do uniform block ShadowParams de "shader_fragment.glsl"
+struct ShadowParams
+{
+    GLfloat matrices[SHADOW_CASCADES][16]; // Coordenadas globais -> [0,1]^3 de cada cascata
+    GLfloat texel_sizes[4];                // Tamanho de um texel de cada cascata, em coordenadas globais
+    GLfloat settings[4];                   // (sombras ativas, bias de profundidade, -, -)
+};
+
+// Objeto que projeta sombra, enfileirado por Shadows_AddCaster()
+struct ShadowCaster
+{
+    glm::mat4 model;
+    glm::vec3 bbox_min;
+    glm::vec3 bbox_max;
+    size_t    first_index;
+    int       num_indices;
+
+    bool operator==(const ShadowCaster& other) const
+    {
+        return model == other.model && first_index == other.first_index && num_indices == other.num_indices;
+    }
+};
+
+// Posição de uma cascata no sistema de coordenadas do sol
+struct ShadowCascade
+{
+    glm::vec2 center;      // Centro da área coberta (x,y)
+    float     half_extent; // Metade da largura da área coberta
+    bool      valid;
+    bool      static_dirty; // O cache estático precisa ser redesenhado
+    glm::mat4 projection_view; // Coordenadas globais -> NDC
+};
+
+GLuint shadow_static_texture = 0; // Profundidade dos objetos estáticos, por cascata
+GLuint shadow_texture = 0;        // Shadow map final, amostrado pelos shaders
+GLuint shadow_static_framebuffer = 0;
+GLuint shadow_framebuffer = 0;
+GLuint shadow_params_buffer = 0;  // Uniform buffer com ShadowParams
+GLuint shadow_vertex_array_object_id = 0;
+
+GLuint shadow_program_id = 0;
+GLint  shadow_model_uniform;
+GLint  shadow_projection_view_uniform;
+
+ShadowCascade shadow_cascades[SHADOW_CASCADES];
+
+// Direção do sol e matriz do seu sistema de coordenadas (olhando na direção
+// da luz), e intervalo de profundidade dos objetos estáticos neste sistema.
+glm::vec3 shadow_light_direction(0.0f);
+glm::mat4 shadow_light_view;
+float shadow_light_near = 0.0f;
+float shadow_light_far = 0.0f;
+
+// Objetos do quadro atual, e os objetos estáticos com que o cache foi desenhado
+std::vector<ShadowCaster> g_StaticShadowCasters;
+std::vector<ShadowCaster> g_DynamicShadowCasters;
+std::vector<ShadowCaster> g_CachedStaticShadowCasters;
+
+// Estatísticas do último quadro (mostradas no HUD)
+int g_ShadowStaticCascadesRedrawn = 0;
+int g_ShadowDynamicCastersDrawn = 0;
+
+// Cria uma textura 2D array de profundidade com uma camada por cascata
+static GLuint Shadows_CreateDepthTexture(bool compare)
+{
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture_id);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, SHADOW_CASCADES,
+                 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Com GL_LINEAR e comparação, cada amostra já é a média de 2x2 testes
+    // de profundidade (percentage-closer filtering).
+    GLenum filter = compare ? GL_LINEAR : GL_NEAREST;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+    if (compare)
+    {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+    return texture_id;
+}
+
+// Cria os shadow maps, o uniform buffer e o programa de GPU que desenha a
+// profundidade dos objetos. "vertex_array_object_id" é o VAO compartilhado
+// por todos os objetos de g_VirtualScene.
+void Shadows_Init(GLuint vertex_array_object_id)
+{
+    shadow_vertex_array_object_id = vertex_array_object_id;
+
+    GLint active_texture;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+
+    glActiveTexture(GL_TEXTURE0 + SHADOW_MAP_UNIT);
+    shadow_static_texture = Shadows_CreateDepthTexture(false);
+    shadow_texture = Shadows_CreateDepthTexture(true);
+    glActiveTexture(active_texture);
+
+    glGenFramebuffers(1, &shadow_static_framebuffer);
+    glGenFramebuffers(1, &shadow_framebuffer);
+
+    glGenBuffers(1, &shadow_params_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, shadow_params_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowParams), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW_PARAMS_BINDING, shadow_params_buffer);
+
+    shadow_program_id = LoadGpuProgram("../../src/shader_shadow_vertex.glsl", "../../src/shader_shadow_fragment.glsl", NULL);
+
+    GLint linked_ok = GL_FALSE;
+    glGetProgramiv(shadow_program_id, GL_LINK_STATUS, &linked_ok);
+    if ( linked_ok == GL_FALSE )
+    {
+        fprintf(stderr, "ERROR: sombras desativadas, erro nos shaders.\n");
+        glDeleteProgram(shadow_program_id);
+        shadow_program_id = 0;
+    }
+    shadow_model_uniform           = glGetUniformLocation(shadow_program_id, "model");
+    shadow_projection_view_uniform = glGetUniformLocation(shadow_program_id, "light_projection_view");
+
+    for (int i = 0; i < SHADOW_CASCADES; ++i)
+        shadow_cascades[i].valid = false;
+}
+
+// Associa o shadow map e o uniform block ShadowParams de um programa (se
+// existirem). Chamada por SetupTextureUnits() e pelo caminho "deferred".
+void Shadows_SetupProgram(GLuint program_id)
+{
+    GLuint block_index = glGetUniformBlockIndex(program_id, "ShadowParams");
+    if (block_index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program_id, block_index, SHADOW_PARAMS_BINDING);
+
+    glUniform1i(glGetUniformLocation(program_id, "shadow_map"), SHADOW_MAP_UNIT);
+}
+
+// Enfileira um objeto que projeta sombra no quadro atual. Objetos estáticos
+// ("is_static") são os que não se movem entre quadros, como o terreno.
+void Shadows_AddCaster(const glm::mat4& model, glm::vec3 bbox_min, glm::vec3 bbox_max, size_t first_index, int num_indices, bool is_static)
+{
+    ShadowCaster caster;
+    caster.model       = model;
+    caster.bbox_min    = bbox_min;
+    caster.bbox_max    = bbox_max;
+    caster.first_index = first_index;
+    caster.num_indices = num_indices;
+
+    if (is_static)
+        g_StaticShadowCasters.push_back(caster);
+    else
+        g_DynamicShadowCasters.push_back(caster);
+}
+
+// Posiciona a cascata "cascade" para cobrir a fatia do frustum da câmera
+// entre as profundidades "depth0" e "depth1". "corners" são os quatro cantos
+// do frustum no near plane seguidos dos quatro no far plane, em coordenadas
+// globais.
+static void Shadows_FitCascade(ShadowCascade& cascade, const glm::vec3 corners[8], float near_depth, float far_depth, float depth0, float depth1)
+{
+    // Cantos da fatia, interpolando as arestas do frustum
+    glm::vec3 slice[8];
+    float t0 = (depth0 - near_depth) / (far_depth - near_depth);
+    float t1 = (depth1 - near_depth) / (far_depth - near_depth);
+    for (int i = 0; i < 4; ++i)
+    {
+        slice[i]     = glm::mix(corners[i], corners[i + 4], t0);
+        slice[i + 4] = glm::mix(corners[i], corners[i + 4], t1);
+    }
+
+    // Esfera que envolve a fatia, no sistema de coordenadas do sol. Uma
+    // esfera não muda de tamanho quando a câmera gira.
+    glm::vec3 center(0.0f);
+    for (int i = 0; i < 8; ++i)
+        center += slice[i];
+    center /= 8.0f;
+
+    float radius = 0.0f;
+    for (int i = 0; i < 8; ++i)
+        radius = std::max(radius, glm::length(slice[i] - center));
+
+    glm::vec2 light_center = glm::vec2(shadow_light_view * glm::vec4(center, 1.0f));
+
+    // Mantemos a posição atual se a esfera ainda está dentro da área da
+    // cascata, e esta não ficou grande demais para a esfera.
+    if (cascade.valid)
+    {
+        glm::vec2 offset = glm::abs(light_center - cascade.center);
+        bool inside = std::max(offset.x, offset.y) + radius <= cascade.half_extent;
+        bool too_loose = radius * SHADOW_CASCADE_PADDING < 0.7f * cascade.half_extent;
+        if (inside && !too_loose)
+            return;
+    }
+
+    // Nova posição, alinhada aos texels do shadow map
+    cascade.half_extent = radius * SHADOW_CASCADE_PADDING;
+    float texel_size = 2.0f * cascade.half_extent / SHADOW_MAP_SIZE;
+    cascade.center = glm::floor(light_center / texel_size) * texel_size;
+    cascade.valid = true;
+    cascade.static_dirty = true;
+}
+
+// Desenha os objetos de "casters" que estão dentro da área da cascata
+static int Shadows_DrawCasters(const ShadowCascade& cascade, const std::vector<ShadowCaster>& casters)
+{
+    int drawn = 0;
+    for (size_t i = 0; i < casters.size(); ++i)
+    {
+        const ShadowCaster& caster = casters[i];
+
+        // AABB do objeto no sistema de coordenadas do sol
+        glm::vec3 light_min, light_max;
+        Culling_TransformAABB(shadow_light_view * caster.model, caster.bbox_min, caster.bbox_max, light_min, light_max);
+        if (light_max.x < cascade.center.x - cascade.half_extent || light_min.x > cascade.center.x + cascade.half_extent ||
+            light_max.y < cascade.center.y - cascade.half_extent || light_min.y > cascade.center.y + cascade.half_extent)
+            continue;
+
+        glUniformMatrix4fv(shadow_model_uniform, 1, GL_FALSE, glm::value_ptr(caster.model));
+        glDrawElements(GL_TRIANGLES, caster.num_indices, GL_UNSIGNED_INT, (void*)(caster.first_index * sizeof(GLuint)));
+        drawn += 1;
+    }
+    return drawn;
+}
+
+// Atualiza as cascatas para a câmera definida por "view" e "projection",
+// redesenha o cache estático das cascatas que mudaram, desenha os objetos
+// dinâmicos enfileirados no quadro, e atualiza ShadowParams.
+// "light_direction" é o sentido do sol (de um ponto para a fonte de luz),
+// que não precisa ser normalizado. Com "enabled"
+// falso, os shaders deixam de amostrar o shadow map. O estado do OpenGL
+// (framebuffer, viewport, programa) é restaurado no final.
+void Shadows_Render(const glm::mat4& view, const glm::mat4& projection, glm::vec3 light_direction, bool enabled)
+{
+    ShadowParams params;
+    memset(&params, 0, sizeof(params));
+
+    g_ShadowStaticCascadesRedrawn = 0;
+    g_ShadowDynamicCastersDrawn = 0;
+
+    if (!enabled || shadow_program_id == 0)
+    {
+        g_StaticShadowCasters.clear();
+        g_DynamicShadowCasters.clear();
+
+        glBindBuffer(GL_UNIFORM_BUFFER, shadow_params_buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowParams), &params, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        return;
+    }
+
+    // O cache estático inteiro é invalidado quando o sol ou o mapa mudam
+    light_direction = glm::normalize(light_direction);
+    bool light_changed = light_direction != shadow_light_direction;
+    bool map_changed = g_StaticShadowCasters != g_CachedStaticShadowCasters;
+    if (light_changed || map_changed)
+    {
+        shadow_light_direction = light_direction;
+        glm::vec3 up = fabsf(light_direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        shadow_light_view = glm::lookAt(glm::vec3(0.0f), -light_direction, up);
+
+        // Intervalo de profundidade que contém todos os objetos estáticos,
+        // com uma margem para os personagens e projéteis acima do terreno.
+        // Objetos dinâmicos fora do intervalo são "achatados" nas bordas
+        // (GL_DEPTH_CLAMP), e continuam projetando sombra.
+        glm::vec3 scene_min(1e30f), scene_max(-1e30f);
+        for (size_t i = 0; i < g_StaticShadowCasters.size(); ++i)
+        {
+            const ShadowCaster& caster = g_StaticShadowCasters[i];
+            glm::vec3 light_min, light_max;
+            Culling_TransformAABB(shadow_light_view * caster.model, caster.bbox_min, caster.bbox_max, light_min, light_max);
+            scene_min = glm::min(scene_min, light_min);
+            scene_max = glm::max(scene_max, light_max);
+        }
+        shadow_light_near = -scene_max.z - 2.0f;
+        shadow_light_far  = -scene_min.z + 0.1f;
+
+        g_CachedStaticShadowCasters = g_StaticShadowCasters;
+        for (int i = 0; i < SHADOW_CASCADES; ++i)
+            shadow_cascades[i].valid = false;
+    }
+
+    // Cantos do frustum da câmera (limitado a SHADOW_MAX_DISTANCE), em
+    // coordenadas globais. Funciona para projeções perspectiva e ortográfica.
+    glm::mat4 inverse_projection_view = glm::inverse(projection * view);
+    glm::mat4 inverse_projection = glm::inverse(projection);
+    glm::vec3 corners[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec4 p = inverse_projection_view * glm::vec4((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f, 1.0f);
+        corners[i] = glm::vec3(p) / p.w;
+    }
+    glm::vec4 near_point = inverse_projection * glm::vec4(0.0f, 0.0f, -1.0f, 1.0f);
+    glm::vec4 far_point  = inverse_projection * glm::vec4(0.0f, 0.0f,  1.0f, 1.0f);
+    float near_depth = std::min(fabsf(near_point.z / near_point.w), fabsf(far_point.z / far_point.w));
+    float far_depth  = std::max(fabsf(near_point.z / near_point.w), fabsf(far_point.z / far_point.w));
+    float shadow_far = std::min(far_depth, SHADOW_MAX_DISTANCE);
+
+    // Divisão do intervalo [near, shadow_far] entre as cascatas: média entre
+    // a divisão uniforme e a logarítmica ("practical split scheme").
+    float split_depths[SHADOW_CASCADES + 1];
+    for (int i = 0; i <= SHADOW_CASCADES; ++i)
+    {
+        float f = (float)i / SHADOW_CASCADES;
+        float uniform_split = near_depth + (shadow_far - near_depth) * f;
+        float log_split = near_depth * powf(shadow_far / near_depth, f);
+        split_depths[i] = glm::mix(uniform_split, log_split, 0.6f);
+    }
+
+    // Estado que será alterado abaixo
+    GLint previous_draw_framebuffer, previous_read_framebuffer, previous_program;
+    GLint previous_viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous_draw_framebuffer);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous_read_framebuffer);
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+    glGetIntegerv(GL_VIEWPORT, previous_viewport);
+    GLboolean previous_cull_face = glIsEnabled(GL_CULL_FACE);
+
+    glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    glDisable(GL_CULL_FACE); // Nem todos os modelos são fechados
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    glUseProgram(shadow_program_id);
+    glBindVertexArray(shadow_vertex_array_object_id);
+
+    for (int i = 0; i < SHADOW_CASCADES; ++i)
+    {
+        ShadowCascade& cascade = shadow_cascades[i];
+        Shadows_FitCascade(cascade, corners, near_depth, far_depth, split_depths[i], split_depths[i + 1]);
+
+        glm::mat4 light_projection = glm::ortho(cascade.center.x - cascade.half_extent, cascade.center.x + cascade.half_extent,
+                                                cascade.center.y - cascade.half_extent, cascade.center.y + cascade.half_extent,
+                                                shadow_light_near, shadow_light_far);
+        cascade.projection_view = light_projection * shadow_light_view;
+        glUniformMatrix4fv(shadow_projection_view_uniform, 1, GL_FALSE, glm::value_ptr(cascade.projection_view));
+
+        // Objetos estáticos, somente quando a cascata mudou
+        if (cascade.static_dirty)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, shadow_static_framebuffer);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow_static_texture, 0, i);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            Shadows_DrawCasters(cascade, g_StaticShadowCasters);
+            cascade.static_dirty = false;
+            g_ShadowStaticCascadesRedrawn += 1;
+        }
+
+        // Cópia do cache estático para o shadow map, e objetos dinâmicos
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, shadow_static_framebuffer);
+        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow_static_texture, 0, i);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow_framebuffer);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow_texture, 0, i);
+        glDrawBuffer(GL_NONE);
+        glBlitFramebuffer(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE,
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        g_ShadowDynamicCastersDrawn += Shadows_DrawCasters(cascade, g_DynamicShadowCasters);
+
+        // Matriz que leva coordenadas globais para [0,1]^3 (coordenadas de
+        // textura e profundidade) do shadow map desta cascata
+        glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+        glm::mat4 shadow_matrix = bias * cascade.projection_view;
+        memcpy(params.matrices[i], glm::value_ptr(shadow_matrix), sizeof(params.matrices[i]));
+        params.texel_sizes[i] = 2.0f * cascade.half_extent / SHADOW_MAP_SIZE;
+    }
+
+    glBindVertexArray(0);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_DEPTH_CLAMP);
+    if (previous_cull_face)
+        glEnable(GL_CULL_FACE);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previous_draw_framebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previous_read_framebuffer);
+    glViewport(previous_viewport[0], previous_viewport[1], previous_viewport[2], previous_viewport[3]);
+    glUseProgram(previous_program);
+
+    params.settings[0] = 1.0f;
+    params.settings[1] = 0.0005f;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, shadow_params_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowParams), &params, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    g_StaticShadowCasters.clear();
+    g_DynamicShadowCasters.clear();
+}
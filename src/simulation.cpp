@@ -0,0 +1,707 @@
+// Estado e regras do jogo, sem OpenGL nem GLFW. Veja "simulation.h".
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include <glm/vec4.hpp>
+
+// Calculamos as alturas em lotes de 4 pontos utilizando instruções SSE2, caso
+// o compilador as suporte. Caso contrário, utilizamos a versão escalar.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCENARY_USE_SSE
+#endif
+
+#include "simulation.h"
+#include "spatialgrid.h"
+
+// Cenário
+Scenary scenary;
+
+// Characters
+std::vector<Character> characters;
+int active_character;
+int target;  // Alvo de um ataque
+
+// Funções avisadas das mudanças de estado
+static SimulationHooks simulation_hooks = { NULL, NULL, NULL, NULL };
+
+// Relógio: "simulation_clock" se definido, senão "simulation_manual_time"
+static SimulationClock simulation_clock = NULL;
+static double simulation_manual_time = 0.0;
+
+// Variável de tempo
+static double old_time = 0.0;
+
+// Passo fixo e tempo acumulado ainda não simulado
+static double simulation_tick_seconds = 1.0 / SIMULATION_TICK_RATE;
+static double simulation_accumulator = 0.0;
+
+// Personagens próximos encontrados por Character::attack()
+static std::vector<int> simulation_nearby;
+
+// Operações de "matrices.h", que não pode ser incluído aqui, pois define
+// funções fora de um header (só "main.cpp" o inclui).
+static float Simulation_Norm(glm::vec4 v)
+{
+    return sqrt( v.x*v.x + v.y*v.y + v.z*v.z );
+}
+
+static glm::vec4 Simulation_CrossProduct(glm::vec4 u, glm::vec4 v)
+{
+    return glm::vec4(
+        u.y*v.z - u.z*v.y,
+        u.z*v.x - u.x*v.z,
+        u.x*v.y - u.y*v.x,
+        0.0f
+    );
+}
+
+static float Simulation_DotProduct(glm::vec4 u, glm::vec4 v)
+{
+    return u.x*v.x + u.y*v.y + u.z*v.z + u.w*v.w;
+}
+
+void Simulation_SetHooks(const SimulationHooks& hooks)
+{
+    simulation_hooks = hooks;
+}
+
+void Simulation_SetClock(SimulationClock clock)
+{
+    simulation_clock = clock;
+}
+
+void Simulation_AdvanceClock(double seconds)
+{
+    simulation_manual_time += seconds;
+}
+
+static double Simulation_Time()
+{
+    return simulation_clock ? simulation_clock() : simulation_manual_time;
+}
+
+void Simulation_SetTickRate(double ticks_per_second)
+{
+    if (ticks_per_second <= 0.0)
+    {
+        fprintf(stderr, "ERROR: taxa de passos da simulacao invalida (%f).\n", ticks_per_second);
+        return;
+    }
+    simulation_tick_seconds = 1.0 / ticks_per_second;
+}
+
+double Simulation_TickSeconds()
+{
+    return simulation_tick_seconds;
+}
+
+int Simulation_AccumulateTime(double seconds)
+{
+    simulation_accumulator += seconds;
+
+    int ticks = (int)(simulation_accumulator / simulation_tick_seconds);
+    if (ticks > SIMULATION_MAX_TICKS)
+    {
+        // Descartamos o tempo que não conseguimos simular
+        ticks = SIMULATION_MAX_TICKS;
+        simulation_accumulator = ticks * simulation_tick_seconds;
+    }
+    simulation_accumulator -= ticks * simulation_tick_seconds;
+    return ticks;
+}
+
+float Simulation_InterpolationFactor()
+{
+    return (float)(simulation_accumulator / simulation_tick_seconds);
+}
+
+void Simulation_SaveState()
+{
+    for (size_t i = 0; i < characters.size(); i++)
+        characters[i].save_state();
+}
+
+void CreateCharacters(glm::vec3 land_size) {
+
+    // Team 1
+    Character spearman_1;
+    spearman_1.init_attributes(SPEARMAN);
+    spearman_1.set_team(1);
+    spearman_1.position = glm::vec4(land_size.x / 4, 0.0f, -land_size.z / 4, 1.0f);
+    spearman_1.position.y = scenary.heigth(spearman_1.position);
+    spearman_1.camera.init_char(spearman_1.position, glm::vec4(spearman_1.position.x, spearman_1.position.y, -spearman_1.position.z, 1.0f));
+    spearman_1.facing_vector = spearman_1.camera.view;
+    spearman_1.save_state();
+    characters.push_back(spearman_1);
+
+    Character guardian_1;
+    guardian_1.init_attributes(GUARDIAN);
+    guardian_1.set_team(1);
+    guardian_1.position = glm::vec4(0.0f, 0.0f, -land_size.z / 4, 1.0f);
+    guardian_1.position.y = scenary.heigth(guardian_1.position);
+    guardian_1.camera.init_char(guardian_1.position, glm::vec4(guardian_1.position.x, guardian_1.position.y, -guardian_1.position.z, 1.0f));
+    guardian_1.facing_vector = guardian_1.camera.view;
+    guardian_1.save_state();
+    characters.push_back(guardian_1);
+
+    Character archer_1;
+    archer_1.init_attributes(ARCHER);
+    archer_1.set_team(1);
+    archer_1.position = glm::vec4(-land_size.x / 4, 0.0f, -land_size.z / 4, 1.0f);
+    archer_1.position.y = scenary.heigth(archer_1.position);
+    archer_1.camera.init_char(archer_1.position, glm::vec4(archer_1.position.x, archer_1.position.y, -archer_1.position.z, 1.0f));
+    archer_1.facing_vector = archer_1.camera.view;
+    archer_1.save_state();
+    characters.push_back(archer_1);
+
+    // Team 2
+    Character spearman_2;
+    spearman_2.init_attributes(SPEARMAN);
+    spearman_2.set_team(2);
+    spearman_2.position = glm::vec4(land_size.x / 4, 0.0f, land_size.z / 4, 1.0f);
+    spearman_2.position.y = scenary.heigth(spearman_2.position);
+    spearman_2.camera.init_char(spearman_2.position, glm::vec4(spearman_2.position.x, spearman_2.position.y, -spearman_2.position.z, 1.0f));
+    spearman_2.facing_vector = spearman_2.camera.view;
+    spearman_2.save_state();
+    characters.push_back(spearman_2);
+
+    Character guardian_2;
+    guardian_2.init_attributes(GUARDIAN);
+    guardian_2.set_team(2);
+    guardian_2.position = glm::vec4(0.0f, 0.0f, land_size.z / 4, 1.0f);
+    guardian_2.position.y = scenary.heigth(guardian_2.position);
+    guardian_2.camera.init_char(guardian_2.position, glm::vec4(guardian_2.position.x, guardian_2.position.y, -guardian_2.position.z, 1.0f));
+    guardian_2.facing_vector = guardian_2.camera.view;
+    guardian_2.save_state();
+    characters.push_back(guardian_2);
+
+    Character archer_2;
+    archer_2.init_attributes(ARCHER);
+    archer_2.set_team(2);
+    archer_2.position = glm::vec4(-land_size.x / 4, 0.0f, land_size.z / 4, 1.0f);
+    archer_2.position.y = scenary.heigth(archer_2.position);
+    archer_2.camera.init_char(archer_2.position, glm::vec4(archer_2.position.x, archer_2.position.y, -archer_2.position.z, 1.0f));
+    archer_2.facing_vector = archer_2.camera.view;
+    archer_2.save_state();
+    characters.push_back(archer_2);
+
+    // Grade para as buscas por proximidade
+    SpatialGrid_Init(land_size);
+    for (int i = 0; i < (int)characters.size(); i++)
+        SpatialGrid_Insert(i, characters[i].position);
+}
+
+// Índice deste personagem em "characters"
+static int Simulation_Index(const Character* character)
+{
+    return (int)(character - characters.data());
+}
+
+// Anda um passo da simulação na direção "facing_vector"
+void Character::move()
+{
+    if (remaining_movement > 0){
+        float step = camera.speed * (float)simulation_tick_seconds;
+        glm::vec4 future_place;
+        future_place.x = position.x + step*facing_vector.x;
+        future_place.y = position.y + step*facing_vector.y;  // não se mexe para cima ou para baixo
+        future_place.z = position.z + step*facing_vector.z;
+        future_place.w = 1.0;
+
+        // Cada altura é calculada uma vez só
+        float heigth = scenary.heigth(position);
+        float future_heigth = scenary.heigth(future_place);
+
+        if (heigth == future_heigth){
+            position.x += step*facing_vector.x;
+            position.z += step*facing_vector.z;
+
+            remaining_movement -= step;
+            camera.position.x = position.x;
+            camera.position.z = position.z;
+            SpatialGrid_Move(Simulation_Index(this), position);
+            if (simulation_hooks.active_unit_moved)
+                simulation_hooks.active_unit_moved(position);
+        }
+        else if (future_heigth >= 0 && 4*(future_heigth - heigth) < remaining_movement){
+            float diff = std::abs(future_heigth - heigth);
+            position.x += step*facing_vector.x;
+            position.z += step*facing_vector.z;
+            position.y = future_heigth;
+            remaining_movement -= 4*diff;
+            remaining_movement -= step;
+            camera.position.x = position.x;
+            camera.position.y = position.y;
+            camera.position.z = position.z;
+            SpatialGrid_Move(Simulation_Index(this), position);
+        }
+    }
+}
+
+void Character::moveFP(glm::vec4 direction)
+{
+    if (remaining_movement > 0){
+        float step = camera.speed * (float)simulation_tick_seconds;
+        glm::vec4 future_place;
+        future_place.x = position.x + step*facing_vector.x;
+        future_place.y = position.y + step*facing_vector.y;  // não se mexe para cima ou para baixo
+        future_place.z = position.z + step*facing_vector.z;
+        future_place.w = 1.0;
+
+        if (scenary.heigth(position) == scenary.heigth(future_place)){
+            camera.move2D(normalize(direction));
+            position.x = camera.position.x;
+            position.z = camera.position.z;
+            SpatialGrid_Move(Simulation_Index(this), position);
+
+            remaining_movement -= step;
+            if (simulation_hooks.active_unit_moved)
+                simulation_hooks.active_unit_moved(position);
+        }
+    }
+}
+
+// Anda um passo ao longo de "path" (veja Pathfinding_FindPath()), a partir
+// do ponto "next", que avança conforme os pontos são alcançados. Retorna
+// falso quando o caminho terminou ou o personagem não pode mais andar.
+bool Character::follow_path(const std::vector<glm::vec4>& path, size_t& next)
+{
+    float step = camera.speed * (float)simulation_tick_seconds;
+    glm::vec4 vec;
+    for (; next < path.size(); next++)
+    {
+        vec = glm::vec4(path[next].x - position.x, 0.0f, path[next].z - position.z, 0.0f);
+        if (vec.x*vec.x + vec.z*vec.z > step*step)
+            break;
+    }
+    if (next >= path.size())
+        return false;
+
+    facing_vector = normalize(vec);
+    camera.view = facing_vector;
+
+    float before = remaining_movement;
+    move();
+    return remaining_movement != before;
+}
+
+// Ataca o primeiro inimigo (menor índice) ao alcance, dentro de um cone de
+// 15 graus em volta de "facing_vector". Os candidatos vêm da grade de
+// "spatialgrid.cpp", em vez de percorrer todos os personagens.
+void Character::attack()
+{
+    if (remaining_actions <= 0)
+        return;
+
+    simulation_nearby.clear();
+    SpatialGrid_QueryCone(position, facing_vector, range, 0.2618f, simulation_nearby);
+
+    int i = -1;
+    for (size_t k = 0; k < simulation_nearby.size(); k++)
+    {
+        int candidate = simulation_nearby[k];
+        if (candidate != active_character && characters[candidate].team != team && (i < 0 || candidate < i))
+            i = candidate;
+    }
+    if (i < 0)
+        return;
+
+    remaining_actions--;
+    isAttacking = true;
+    target = i;
+    init_time();
+
+    // Por último, pois se o alvo morrer, a remoção dele de "characters" pode
+    // mover este personagem
+    bool double_damage = role == ARCHER && characters[i].position.y < position.y;
+    float hp = characters[i].current_hp - (double_damage ? 2*damage : damage);
+    if (simulation_hooks.attack_hit)
+        simulation_hooks.attack_hit(i, hp > 0 ? hp : 0, double_damage);
+    characters[i].take_damage(double_damage ? 2*damage : damage, i);
+}
+
+void Character::take_damage(float delta, int alvo){
+    current_hp = current_hp - delta;
+    if (current_hp > max_hp)
+        current_hp = max_hp;
+    else if (current_hp <= 0){
+        current_hp = 0;
+        characters.erase(characters.begin() + alvo);
+        SpatialGrid_Remove(alvo);
+        // Os personagens depois do alvo mudaram de índice
+        if (alvo < active_character)
+            active_character--;
+        if (simulation_hooks.units_changed)
+            simulation_hooks.units_changed();
+        return;
+    }
+    if (simulation_hooks.unit_changed)
+        simulation_hooks.unit_changed(alvo);
+}
+
+// Funções de Classes
+// Camera Livre
+void Free_Camera::init(glm::vec4 pos, glm::vec4 origin)
+{
+    position = pos;//glm::vec4(0.0f, 2.0f, 2.0f, 1.0f);
+    view = origin - position;
+    view = view / Simulation_Norm(view);
+    up = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+    right = Simulation_CrossProduct(view, up);
+    right = right / Simulation_Norm(right);
+    v = Simulation_CrossProduct(view, right);
+
+    phi = acos((Simulation_DotProduct(view, up)) / (Simulation_Norm(view)*Simulation_Norm(up)));
+    speed = 0.6f;   // 0.01 por passo, a 60 passos por segundo
+    save_state();
+}
+
+void Free_Camera::init_char(glm::vec4 pos, glm::vec4 look)
+{
+    glm::vec4 origin = glm::vec4(look.x, look.y + 0.28, look.z, 1.0);
+    position = glm::vec4(pos.x, pos.y + 0.28, pos.z, 1.0f);
+    view = origin - position;
+    view = view / Simulation_Norm(view);
+    up = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+    right = Simulation_CrossProduct(view, up);
+    right = right / Simulation_Norm(right);
+    v = Simulation_CrossProduct(view, right);
+
+    phi = acos((Simulation_DotProduct(view, up)) / (Simulation_Norm(view)*Simulation_Norm(up)));
+    speed = 0.6f;   // 0.01 por passo, a 60 passos por segundo
+    save_state();
+}
+
+// Anda um passo da simulação na direção "direction"
+void Free_Camera::move(glm::vec4 direction)
+{
+    float step = speed * (float)simulation_tick_seconds;
+    position.x += step*direction.x;
+    position.y += step*direction.y;
+    position.z += step*direction.z;
+}
+
+void Free_Camera::move2D(glm::vec4 direction)
+{
+    float step = speed * (float)simulation_tick_seconds;
+    position.x += step*direction.x;
+    position.z += step*direction.z;
+}
+
+// Scenary Functions
+void Scenary::build(){
+    plateaus.clear();
+
+    // Definindo o tamanho do cenário
+    land_size.x = (rand() % 75 + 25) * 0.04; // gera um número entre 25 e 100, depois escala por 0.04 para gerar um float de 1 a 4
+    land_size.z = (rand() % 75 + 25) * 0.04;
+    if ( land_size.z > 1.33*land_size.x )
+        land_size.z = 1.33*land_size.x;
+    else if ( land_size.z <  0.75*land_size.x )
+        land_size.z = 0.75*land_size.x;
+
+    if( land_size.x < 2)
+        land_size.y = land_size.x;
+    else if ( land_size.z < 2)
+        land_size.y = land_size.z;
+    else
+        land_size.y = 2;
+
+    // Definindo a quantidade de planaltos
+    int plateau_qtd = rand() % 4;   // Gera um número aleatório de planalto entre 0 e 4
+    // Laço que define os planaltos
+    for(int i = 0; i < plateau_qtd; i++){
+        Plateau plateau;
+
+        // Define o tamanho
+        if ( rand() % 2 == 0){
+            plateau.scale.x = (rand() % 15 + 10)*0.01*land_size.x;
+            plateau.scale.z = (rand() % 15 + 10)*0.01*land_size.z;
+        }
+        else{
+            plateau.scale.x = (rand() % 5 + 20)*0.01*land_size.x;
+            plateau.scale.z = (rand() % 15 + 10)*0.01*land_size.z;
+        }
+
+        plateau.scale.y = (rand() % 80 + 20)*0.01;
+        if ( plateau.scale.y > plateau.scale.x)
+            plateau.scale.y = plateau.scale.x;
+        if ( plateau.scale.y > plateau.scale.z)
+            plateau.scale.y = plateau.scale.z;
+
+        // Define a posição
+        // De acordo com o valor de i, o planalto é mandado para um determinado quadrante
+        if ( i == 0 ){ // Quadrante negativo
+            plateau.position.x = (plateau.scale.x - land_size.x) * 0.5 * (rand() % 80 + 20) * 0.01;
+            plateau.position.z = (plateau.scale.z - land_size.z) * 0.5 * (rand() % 80 + 20) * 0.01;
+        }
+        else if ( i == 1 ){
+            plateau.position.x = (land_size.x - plateau.scale.x) * 0.5 * (rand() % 80 + 20) * 0.01;
+            plateau.position.z = (plateau.scale.z - land_size.z) * 0.5 * (rand() % 80 + 20) * 0.01;
+        }
+        else if ( i == 2 ){
+            plateau.position.x = (plateau.scale.x - land_size.x) * 0.5 * (rand() % 80 + 20) * 0.01;
+            plateau.position.z = (land_size.z - plateau.scale.z) * 0.5 * (rand() % 80 + 20) * 0.01;
+        }
+        else{
+            plateau.position.x = (land_size.x - plateau.scale.x) * 0.5 * (rand() % 80 + 20) * 0.01;
+            plateau.position.z = (land_size.z - plateau.scale.z) * 0.5 * (rand() % 80 + 20) * 0.01;
+        }
+
+        plateau.position.y = plateau.scale.y * 0.5 * 0.9;
+
+        plateaus.push_back(plateau);
+    }
+
+    build_height_grid();
+}
+
+// Rasteriza as alturas do terreno em "height_grid". Cada célula guarda a
+// altura que Scenary::heigth() calcularia para qualquer ponto dela, ou
+// SCENARY_HEIGHT_EXACT se a borda de algum planalto passa pela célula. Os
+// planaltos são rasterizados em ordem, cada um somente nas células que cobre:
+// como em Scenary::heigth(), o último planalto que cobre a célula inteira
+// define a altura, e uma borda depois dele a torna exata. As células são
+// testadas com uma pequena margem, para que um ponto que caia na célula
+// vizinha por arredondamento também tenha a altura correta.
+void Scenary::build_height_grid()
+{
+    if (height_cell_size <= 0.0f)
+    {
+        fprintf(stderr, "ERROR: tamanho de celula da grade de alturas invalido (%f).\n", height_cell_size);
+        height_cell_size = SCENARY_HEIGHT_CELL_SIZE;
+    }
+
+    // As mesmas bordas da terra de Scenary::heigth()
+    height_x_min = -(land_size.x / 2) + 0.1;
+    height_x_max = -height_x_min;
+    height_z_min = -(land_size.z / 2) + 0.1;
+    height_z_max = -height_z_min;
+
+    height_columns = std::max(1, (int)ceil((height_x_max - height_x_min) / height_cell_size));
+    height_rows = std::max(1, (int)ceil((height_z_max - height_z_min) / height_cell_size));
+    height_inverse_cell = 1.0f / height_cell_size;
+    height_grid.assign(height_columns * height_rows, 0.0f);
+
+    float margin = 0.01f * height_cell_size;
+    for (size_t i = 0; i < plateaus.size(); i++)
+    {
+        float x_min = (plateaus[i].position.x - plateaus[i].scale.x / 2);
+        float x_max = (plateaus[i].position.x + plateaus[i].scale.x / 2);
+        float z_min = (plateaus[i].position.z - plateaus[i].scale.z / 2);
+        float z_max = (plateaus[i].position.z + plateaus[i].scale.z / 2);
+        float heigth = plateaus[i].position.y + plateaus[i].scale.y / 2;
+
+        // Células que o planalto (com a margem) pode tocar
+        int column_min = std::max(0, (int)floor((x_min - margin - height_x_min) * height_inverse_cell));
+        int column_max = std::min(height_columns - 1, (int)floor((x_max + margin - height_x_min) * height_inverse_cell));
+        int row_min = std::max(0, (int)floor((z_min - margin - height_z_min) * height_inverse_cell));
+        int row_max = std::min(height_rows - 1, (int)floor((z_max + margin - height_z_min) * height_inverse_cell));
+
+        for (int row = row_min; row <= row_max; row++)
+        {
+            float cell_z_min = height_z_min + row * height_cell_size - margin;
+            float cell_z_max = height_z_min + (row + 1) * height_cell_size + margin;
+            for (int column = column_min; column <= column_max; column++)
+            {
+                float cell_x_min = height_x_min + column * height_cell_size - margin;
+                float cell_x_max = height_x_min + (column + 1) * height_cell_size + margin;
+
+                bool inside = cell_x_min > x_min && cell_x_max < x_max && cell_z_min > z_min && cell_z_max < z_max;
+                bool outside = cell_x_max <= x_min || cell_x_min >= x_max || cell_z_max <= z_min || cell_z_min >= z_max;
+                if (inside)
+                    height_grid[row * height_columns + column] = heigth;
+                else if (!outside)
+                    height_grid[row * height_columns + column] = SCENARY_HEIGHT_EXACT;
+            }
+        }
+    }
+}
+
+float Scenary::heigth(glm::vec4 dot)
+{
+    float heigth = 0.0;
+    float x_min, x_max, z_min, z_max;
+
+    // Testa se está em cima da terra primeiro
+    x_min = -(land_size.x / 2) + 0.1;
+    x_max = -x_min;
+    z_min = -(land_size.z / 2) + 0.1;
+    z_max = -z_min;
+
+    if (dot.x < x_min)
+        heigth = -1;
+    else if (dot.x > x_max)
+        heigth = -1;
+    else if (dot.z < z_min)
+        heigth = -1;
+    else if (dot.z > z_max)
+        heigth = -1;
+    else
+        heigth = 0;
+    // Se estiver fora da terra, não precisa testar os planaltos
+    if ( heigth == -1)
+        return heigth;
+
+    // Altura pré-calculada, exceto perto das bordas dos planaltos
+    if (!height_grid.empty())
+    {
+        int column = std::min((int)((dot.x - height_x_min) * height_inverse_cell), height_columns - 1);
+        int row = std::min((int)((dot.z - height_z_min) * height_inverse_cell), height_rows - 1);
+        float cell = height_grid[row * height_columns + column];
+        if (cell != SCENARY_HEIGHT_EXACT)
+            return cell;
+    }
+
+    for(int i = 0; i < plateaus.size(); i++){
+        x_min = (plateaus[i].position.x - plateaus[i].scale.x / 2);
+        x_max = (plateaus[i].position.x + plateaus[i].scale.x / 2);
+        z_min = (plateaus[i].position.z - plateaus[i].scale.z / 2);
+        z_max = (plateaus[i].position.z + plateaus[i].scale.z / 2);
+
+        if (dot.x > x_min && dot.x < x_max && dot.z > z_min && dot.z < z_max)
+            heigth = plateaus[i].position.y + plateaus[i].scale.y / 2;
+
+    }
+
+    return heigth;
+}
+
+// Altura de "count" pontos (x[i], z[i]), em "result". Mesmo resultado de
+// Scenary::heigth() para cada ponto, mas processando 4 pontos por vez.
+void Scenary::heigths(const float* x, const float* z, float* result, int count)
+{
+    int i = 0;
+
+#ifdef SCENARY_USE_SSE
+    if (!height_grid.empty())
+    {
+        const __m128 x_min = _mm_set1_ps(height_x_min);
+        const __m128 x_max = _mm_set1_ps(height_x_max);
+        const __m128 z_min = _mm_set1_ps(height_z_min);
+        const __m128 z_max = _mm_set1_ps(height_z_max);
+        const __m128 inverse_cell = _mm_set1_ps(height_inverse_cell);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 last_column = _mm_set1_ps((float)(height_columns - 1));
+        const __m128 last_row = _mm_set1_ps((float)(height_rows - 1));
+        const __m128i columns = _mm_set1_epi32(height_columns);
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 px = _mm_loadu_ps(&x[i]);
+            __m128 pz = _mm_loadu_ps(&z[i]);
+
+            // Fora da terra
+            __m128 outside = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(px, x_min), _mm_cmpgt_ps(px, x_max)),
+                                       _mm_or_ps(_mm_cmplt_ps(pz, z_min), _mm_cmpgt_ps(pz, z_max)));
+
+            // Células, limitadas à grade (também para os pontos de fora)
+            __m128 column = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(px, x_min), inverse_cell), zero), last_column);
+            __m128 row = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(pz, z_min), inverse_cell), zero), last_row);
+            __m128i row_index = _mm_cvttps_epi32(row);
+            // row*columns: SSE2 só multiplica inteiros de 32 bits aos pares
+            __m128i even = _mm_mul_epu32(row_index, columns);
+            __m128i odd = _mm_mul_epu32(_mm_srli_si128(row_index, 4), columns);
+            __m128i row_offset = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+                                                    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+            __m128i cell = _mm_add_epi32(row_offset, _mm_cvttps_epi32(column));
+
+            int cells[4];
+            _mm_storeu_si128((__m128i*)cells, cell);
+            __m128 heights = _mm_setr_ps(height_grid[cells[0]], height_grid[cells[1]],
+                                         height_grid[cells[2]], height_grid[cells[3]]);
+            heights = _mm_or_ps(_mm_and_ps(outside, _mm_set1_ps(-1.0f)), _mm_andnot_ps(outside, heights));
+            _mm_storeu_ps(&result[i], heights);
+
+            // Pontos perto das bordas dos planaltos
+            for (int k = 0; k < 4; k++)
+                if (result[i + k] == SCENARY_HEIGHT_EXACT)
+                    result[i + k] = heigth(glm::vec4(x[i + k], 0.0f, z[i + k], 1.0f));
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+        result[i] = heigth(glm::vec4(x[i], 0.0f, z[i], 1.0f));
+}
+
+void Character::init_attributes(int type){
+    role = type;
+    switch(type){
+        case SPEARMAN:
+            max_hp = 100;
+            current_hp = max_hp;
+            max_movement = 2;
+            remaining_movement = max_movement;
+            max_actions = 1;
+            remaining_actions = max_actions;
+            range = 0.3;
+            damage = 50;
+            break;
+        case GUARDIAN:
+            max_hp = 200;
+            current_hp = max_hp;
+            max_movement = 1;
+            remaining_movement = max_movement;
+            max_actions = 1;
+            remaining_actions = max_actions;
+            range = 0.2;
+            damage = 35;
+            break;
+        case ARCHER:
+            max_hp = 70;
+            current_hp = max_hp;
+            max_movement = 2.5;
+            remaining_movement = max_movement;
+            max_actions = 1;
+            remaining_actions = max_actions;
+            range = 5;
+            damage = 50;
+            break;
+    }
+}
+
+glm::vec4 normalize(glm::vec4 aim_vector)
+{
+    float x = aim_vector.x;
+    float y = aim_vector.y;
+    float z = aim_vector.z;
+    float norm = sqrt(x*x + y*y + z*z);
+
+    return aim_vector / norm;
+}
+
+void PassTurn()
+{
+    characters[active_character].end_turn();
+    int previous_character = active_character;
+    active_character++;
+    if (active_character > characters.size() - 1)
+        active_character = 0;
+
+    if (simulation_hooks.unit_changed)
+    {
+        simulation_hooks.unit_changed(previous_character);
+        simulation_hooks.unit_changed(active_character);
+    }
+
+    if (simulation_hooks.active_unit_moved)
+        simulation_hooks.active_unit_moved(characters[active_character].position);
+}
+
+void init_time(void)
+{
+    old_time = Simulation_Time();
+}
+
+float get_delta_time(void)
+{
+    /* Delta time em milisegundos. */
+    float delta_time = (float)((Simulation_Time() - old_time) * 1000.0);
+
+    return delta_time;
+}
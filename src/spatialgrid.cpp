@@ -0,0 +1,149 @@
+// Grade uniforme de personagens para buscas por proximidade. Veja
+// "spatialgrid.h".
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#include "spatialgrid.h"
+#include "simulation.h"
+
+// Células, em ordem de linhas (z) e colunas (x), com os índices dos
+// personagens
+static std::vector< std::vector<int> > spatialgrid_cells;
+static int spatialgrid_columns = 0;
+static int spatialgrid_rows = 0;
+static float spatialgrid_cell_size = SPATIALGRID_CELL_SIZE;
+static glm::vec3 spatialgrid_origin;    // Canto (x,z) mínimo da grade
+
+// Célula de cada personagem, por índice
+static std::vector<int> spatialgrid_unit_cell;
+
+static int SpatialGrid_Column(float x)
+{
+    int column = (int)floor((x - spatialgrid_origin.x) / spatialgrid_cell_size);
+    return std::min(std::max(column, 0), spatialgrid_columns - 1);
+}
+
+static int SpatialGrid_Row(float z)
+{
+    int row = (int)floor((z - spatialgrid_origin.z) / spatialgrid_cell_size);
+    return std::min(std::max(row, 0), spatialgrid_rows - 1);
+}
+
+static int SpatialGrid_Cell(glm::vec4 position)
+{
+    return SpatialGrid_Row(position.z) * spatialgrid_columns + SpatialGrid_Column(position.x);
+}
+
+static void SpatialGrid_RemoveFromCell(int cell, int unit)
+{
+    std::vector<int>& units = spatialgrid_cells[cell];
+    std::vector<int>::iterator it = std::find(units.begin(), units.end(), unit);
+    if (it != units.end())
+    {
+        *it = units.back();
+        units.pop_back();
+    }
+}
+
+void SpatialGrid_Init(glm::vec3 land_size, float cell_size)
+{
+    if (cell_size <= 0.0f)
+    {
+        fprintf(stderr, "ERROR: tamanho de celula da grade invalido (%f).\n", cell_size);
+        cell_size = SPATIALGRID_CELL_SIZE;
+    }
+    spatialgrid_cell_size = cell_size;
+    spatialgrid_origin = glm::vec3(-land_size.x / 2, 0.0f, -land_size.z / 2);
+    spatialgrid_columns = std::max(1, (int)ceil(land_size.x / cell_size));
+    spatialgrid_rows = std::max(1, (int)ceil(land_size.z / cell_size));
+
+    // Mantemos a memória das células de uma grade anterior (por exemplo, da
+    // batalha anterior em "tools/headless.cpp")
+    for (size_t i = 0; i < spatialgrid_cells.size(); ++i)
+        spatialgrid_cells[i].clear();
+    spatialgrid_cells.resize(spatialgrid_columns * spatialgrid_rows);
+    spatialgrid_unit_cell.clear();
+}
+
+void SpatialGrid_Insert(int unit, glm::vec4 position)
+{
+    if (unit >= (int)spatialgrid_unit_cell.size())
+        spatialgrid_unit_cell.resize(unit + 1, -1);
+
+    int cell = SpatialGrid_Cell(position);
+    spatialgrid_unit_cell[unit] = cell;
+    spatialgrid_cells[cell].push_back(unit);
+}
+
+void SpatialGrid_Move(int unit, glm::vec4 position)
+{
+    int cell = SpatialGrid_Cell(position);
+    int old_cell = spatialgrid_unit_cell[unit];
+    if (cell == old_cell)
+        return;
+
+    SpatialGrid_RemoveFromCell(old_cell, unit);
+    spatialgrid_cells[cell].push_back(unit);
+    spatialgrid_unit_cell[unit] = cell;
+}
+
+void SpatialGrid_Remove(int unit)
+{
+    SpatialGrid_RemoveFromCell(spatialgrid_unit_cell[unit], unit);
+    spatialgrid_unit_cell.erase(spatialgrid_unit_cell.begin() + unit);
+
+    // Os personagens seguintes passam a ter o índice anterior, como em
+    // "characters". Remoções (mortes) são raras, então percorremos todos.
+    for (size_t j = unit; j < spatialgrid_unit_cell.size(); ++j)
+    {
+        std::vector<int>& units = spatialgrid_cells[spatialgrid_unit_cell[j]];
+        std::replace(units.begin(), units.end(), (int)j + 1, (int)j);
+    }
+}
+
+int SpatialGrid_QueryRange(glm::vec4 center, float radius, std::vector<int>& result)
+{
+    return SpatialGrid_QueryCone(center, glm::vec4(0.0f), radius, -1.0f, result);
+}
+
+// "half_angle" negativo: sem o teste do cone
+int SpatialGrid_QueryCone(glm::vec4 apex, glm::vec4 direction, float radius, float half_angle, std::vector<int>& result)
+{
+    int column_min = SpatialGrid_Column(apex.x - radius);
+    int column_max = SpatialGrid_Column(apex.x + radius);
+    int row_min = SpatialGrid_Row(apex.z - radius);
+    int row_max = SpatialGrid_Row(apex.z + radius);
+
+    float radius_squared = radius * radius;
+    float cos_half_angle = cos(half_angle);
+
+    int found = 0;
+    for (int row = row_min; row <= row_max; ++row)
+    {
+        for (int column = column_min; column <= column_max; ++column)
+        {
+            const std::vector<int>& units = spatialgrid_cells[row * spatialgrid_columns + column];
+            for (size_t k = 0; k < units.size(); ++k)
+            {
+                glm::vec4 vec = characters[units[k]].position - apex;
+                if (vec.x*vec.x + vec.y*vec.y + vec.z*vec.z > radius_squared)
+                    continue;
+
+                if (half_angle >= 0.0f)
+                {
+                    float horizontal = sqrt(vec.x*vec.x + vec.z*vec.z);
+                    if (horizontal == 0.0f)
+                        continue;
+                    if ((direction.x*vec.x + direction.z*vec.z) / horizontal < cos_half_angle)
+                        continue;
+                }
+
+                result.push_back(units[k]);
+                ++found;
+            }
+        }
+    }
+    return found;
+}
@@ -1,6 +1,21 @@
 // Based on http://hamelot.io/visualization/opengl-text-without-any-external-libraries/
 //   and on https://github.com/rougier/freetype-gl
+//
+// Os glifos de todas as chamadas a TextRendering_PrintString() de um quadro
+// são acumulados em um único vetor no CPU, e desenhados de uma só vez por
+// TextRendering_Flush(), chamada no final do quadro: um envio do buffer e
+// uma chamada de desenho por quadro, ao invés de uma por caractere. Textos
+// que se repetem a cada quadro (o HUD) podem ainda reutilizar os vértices já
+// calculados; veja TextRendering_PrintText().
+//
+// A fonte padrão é o atlas SDF ("signed distance field") em
+// "data/dejavufont_sdf.bin", gerado pela ferramenta "tools/sdffont.cpp": o
+// mesmo atlas fica nítido em qualquer escala do texto, e permite contornos e
+// sombras sem texturas adicionais. A fonte bitmap de "dejavufont.h" é
+// utilizada se o arquivo não for encontrado.
+#include <cstdio>
 #include <string>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -10,8 +25,9 @@
 
 #include "utils.h"
 #include "dejavufont.h"
+#include "sdffont.h"
 
-GLuint CreateGpuProgram(GLuint vertex_shader_id, GLuint fragment_shader_id); // Função definida em main.cpp
+GLuint CreateGpuProgramFromSources(const std::string& vertex_source, const std::string& fragment_source, const char* vertex_name, const char* fragment_name); // Função definida em main.cpp
 
 const GLchar* const textvertexshader_source = ""
 "#version 330\n"
@@ -35,57 +51,286 @@ const GLchar* const textfragmentshader_source = ""
 "}\n"
 "\0";
 
-void TextRendering_LoadShader(const GLchar* const shader_string, GLuint shader_id)
-{
-    // Define o código do shader, contido na string "shader_string"
-    glShaderSource(shader_id, 1, &shader_string, NULL);
+// Fragment shader da fonte SDF (veja "sdffont.h"). A borda do glifo fica onde
+// a distância vale 0.5; a largura da transição é a variação da distância
+// entre pixels vizinhos da tela (fwidth), para que o texto fique nítido em
+// qualquer escala. O contorno é a mesma borda deslocada para fora, e a sombra
+// é uma segunda leitura do atlas, deslocada; os dois são opcionais (largura
+// e deslocamento zero), e não precisam de nenhuma textura adicional.
+const GLchar* const textsdffragmentshader_source = ""
+"#version 330\n"
+"uniform sampler2D tex;\n"
+"uniform float outline_width;\n" // Em unidades da distância (0.5 = spread do atlas)
+"uniform vec2 shadow_offset;\n"  // Em texels do atlas, no máximo o spread
+"in vec2 texCoords;\n"
+"out vec4 fragColor;\n"
+"vec4 over(vec4 src, vec4 dst)\n"
+"{\n"
+    "float a = src.a + dst.a * (1.0 - src.a);\n"
+    "vec3 rgb = src.rgb * src.a + dst.rgb * dst.a * (1.0 - src.a);\n"
+    "return vec4(a > 0.0 ? rgb / a : vec3(0.0), a);\n"
+"}\n"
+"void main()\n"
+"{\n"
+    "float d = texture(tex, texCoords).r;\n"
+    "float w = max(0.7 * fwidth(d), 1.0e-4);\n"
+    "float edge = 0.5 - outline_width;\n"
+    "vec4 color = vec4(0.0);\n"
+    "if (shadow_offset != vec2(0.0))\n"
+    "{\n"
+        "float ds = texture(tex, texCoords - shadow_offset / vec2(textureSize(tex, 0))).r;\n"
+        "color = vec4(0.0, 0.0, 0.0, 0.5 * smoothstep(edge - w, edge + w, ds));\n"
+    "}\n"
+    "if (outline_width > 0.0)\n"
+        "color = over(vec4(1.0, 1.0, 1.0, smoothstep(edge - w, edge + w, d)), color);\n"
+    "fragColor = over(vec4(0.0, 0.0, 0.0, smoothstep(0.5 - w, 0.5 + w, d)), color);\n"
+"}\n"
+"\0";
+
+// Unidade de textura da fonte. Veja "dynamicresolution.cpp" para as
+// unidades anteriores.
+#define TEXT_TEXTURE_UNIT 20
+
+GLuint textVAO;
+GLuint textVBO;
+GLuint textprogram_id;        // Programa da fonte em uso: um dos dois abaixo
+GLuint textbitmapprogram_id;
+GLuint textsdfprogram_id;
+GLint  textoutline_uniform;
+GLint  textshadow_uniform;
+GLuint texttexture_id;
 
-    // Compila o código do shader (em tempo de execução)
-    glCompileShader(shader_id);
+// Fonte SDF carregada por TextRendering_Init(). Se o arquivo não existir, o
+// texto é desenhado com a fonte bitmap de "dejavufont.h".
+#define TEXT_SDF_FONT_FILENAME "../../data/dejavufont_sdf.bin"
 
-    // Verificamos se ocorreu algum erro ou "warning" durante a compilação
-    GLint compiled_ok;
-    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compiled_ok);
+// Vértices dos glifos do quadro atual (6 por glifo), e número de vértices
+// que cabem em textVBO.
+struct TextVertex
+{
+    float x, y, s, t;
+};
+std::vector<TextVertex> textvertices;
+size_t textvbo_capacity = 0;
+
+// Glifo da fonte em uso, pré-processado quando a fonte é carregada: o
+// retângulo do glifo relativo à posição da caneta, as coordenadas de
+// textura, e o avanço da caneta. As medidas estão em pixels da fonte bitmap
+// (de tamanho dejavufont.size), qualquer que seja a fonte em uso, para que o
+// texto tenha o mesmo tamanho com as duas.
+struct TextGlyph
+{
+    float x0, y0, x1, y1;
+    float s0, t0, s1, t1;
+    float advance;
+};
+std::vector<TextGlyph> textglyphs;
+std::vector<uint32_t>  textglyph_codepoints;  // Codepoint de cada glifo de "textglyphs"
+float textfont_height = 0.0f;                 // Distância entre linhas
+
+// Índice dos glifos por codepoint: uma tabela direta para ASCII/Latin-1, e
+// uma tabela hash (endereçamento aberto, sondagem linear) para os demais.
+// Os valores são índices em "textglyphs", ou -1 se não há glifo.
+#define TEXT_DIRECT_GLYPHS 256
+int textglyph_direct[TEXT_DIRECT_GLYPHS];
+
+struct TextGlyphHashEntry
+{
+    uint32_t codepoint;
+    int      index;
+};
+std::vector<TextGlyphHashEntry> textglyph_hash;
+uint32_t textglyph_hash_mask = 0;
+
+static uint32_t TextRendering_HashCodepoint(uint32_t codepoint)
+{
+    return (codepoint * 2654435761u) & textglyph_hash_mask;
+}
 
-    GLint log_length = 0;
-    glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &log_length);
+// Constrói os índices acima para os glifos de "textglyph_codepoints"
+static void TextRendering_BuildGlyphIndex()
+{
+    for (int i = 0; i < TEXT_DIRECT_GLYPHS; ++i)
+        textglyph_direct[i] = -1;
 
-    // Alocamos memória para guardar o log de compilação.
-    // A chamada "new" em C++ é equivalente ao "malloc()" do C.
-    GLchar* log = new GLchar[log_length];
-    glGetShaderInfoLog(shader_id, log_length, &log_length, log);
+    size_t hash_size = 16;
+    while (hash_size < 2 * textglyph_codepoints.size())
+        hash_size *= 2;
+    TextGlyphHashEntry empty = { 0, -1 };
+    textglyph_hash.assign(hash_size, empty);
+    textglyph_hash_mask = (uint32_t)(hash_size - 1);
 
-    // Imprime no terminal qualquer erro ou "warning" de compilação
-    if ( log_length != 0 )
+    for (size_t j = 0; j < textglyph_codepoints.size(); ++j)
     {
-        std::string  output;
-
-        if ( !compiled_ok )
+        uint32_t codepoint = textglyph_codepoints[j];
+        if (codepoint < TEXT_DIRECT_GLYPHS)
         {
-            output += "ERROR: OpenGL compilation failed.\n";
-            output += "== Start of compilation log\n";
-            output += log;
-            output += "== End of compilation log\n";
+            textglyph_direct[codepoint] = (int)j;
         }
         else
         {
-            output += "ERROR: OpenGL compilation failed.\n";
-            output += "== Start of compilation log\n";
-            output += log;
-            output += "== End of compilation log\n";
+            uint32_t slot = TextRendering_HashCodepoint(codepoint);
+            while (textglyph_hash[slot].index >= 0)
+                slot = (slot + 1) & textglyph_hash_mask;
+            textglyph_hash[slot].codepoint = codepoint;
+            textglyph_hash[slot].index = (int)j;
         }
+    }
+}
+
+// Utiliza a fonte bitmap de "dejavufont.h"
+static void TextRendering_UseBitmapFont()
+{
+    textglyphs.resize(dejavufont.glyphs_count);
+    textglyph_codepoints.resize(dejavufont.glyphs_count);
+    for (size_t j = 0; j < dejavufont.glyphs_count; ++j)
+    {
+        const texture_glyph_t& glyph = dejavufont.glyphs[j];
+
+        float kerning = glyph.kerning_count > 0 ? glyph.kerning[0].kerning : 0.0f;
+
+        TextGlyph& g = textglyphs[j];
+        g.x0 = kerning + glyph.offset_x;
+        g.y0 = (float)glyph.offset_y;
+        g.x1 = g.x0 + glyph.width;
+        g.y1 = g.y0 - glyph.height;
+        g.s0 = glyph.s0 - 0.5f/dejavufont.tex_width;
+        g.t0 = glyph.t0 - 0.5f/dejavufont.tex_height;
+        g.s1 = glyph.s1 - 0.5f/dejavufont.tex_width;
+        g.t1 = glyph.t1 - 0.5f/dejavufont.tex_height;
+        g.advance = kerning + glyph.advance_x;
+
+        textglyph_codepoints[j] = glyph.codepoint;
+    }
+    textfont_height = dejavufont.height;
+    TextRendering_BuildGlyphIndex();
+
+    glActiveTexture(GL_TEXTURE0 + TEXT_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, texttexture_id);
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_R8, dejavufont.tex_width, dejavufont.tex_height, 0, GL_RED, GL_UNSIGNED_BYTE, dejavufont.tex_data);
+    glActiveTexture(GL_TEXTURE0);
+    glCheckError();
+
+    textprogram_id = textbitmapprogram_id;
+}
+
+// Carrega uma fonte SDF gerada por "tools/sdffont.cpp", e passa a utilizá-la.
+// Retorna falso, sem alterar a fonte em uso, se o arquivo não puder ser lido.
+bool TextRendering_LoadSdfFont(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+        return false;
+
+    SdfFontHeader header;
+    std::vector<SdfFontGlyph> glyphs;
+    std::vector<unsigned char> atlas;
+
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+           && header.magic == SDFFONT_MAGIC && header.version == SDFFONT_VERSION
+           && header.size > 0.0f && header.glyphs_count > 0;
+    if (ok)
+    {
+        glyphs.resize(header.glyphs_count);
+        atlas.resize((size_t)header.tex_width * header.tex_height);
+        ok = fread(glyphs.data(), sizeof(SdfFontGlyph), glyphs.size(), file) == glyphs.size()
+          && fread(atlas.data(), 1, atlas.size(), file) == atlas.size();
+    }
+    fclose(file);
+
+    if (!ok)
+    {
+        fprintf(stderr, "ERROR: arquivo de fonte SDF \"%s\" invalido.\n", filename);
+        return false;
+    }
 
-        fprintf(stderr, "%s", output.c_str());
+    // Convertemos as medidas para pixels da fonte bitmap
+    float unit = dejavufont.size / header.size;
+
+    textglyphs.resize(glyphs.size());
+    textglyph_codepoints.resize(glyphs.size());
+    for (size_t j = 0; j < glyphs.size(); ++j)
+    {
+        const SdfFontGlyph& glyph = glyphs[j];
+
+        TextGlyph& g = textglyphs[j];
+        g.x0 = glyph.offset_x * unit;
+        g.y0 = glyph.offset_y * unit;
+        g.x1 = g.x0 + glyph.width * unit;
+        g.y1 = g.y0 - glyph.height * unit;
+        g.s0 = glyph.s0;
+        g.t0 = glyph.t0;
+        g.s1 = glyph.s1;
+        g.t1 = glyph.t1;
+        g.advance = glyph.advance_x * unit;
+
+        textglyph_codepoints[j] = glyph.codepoint;
     }
+    textfont_height = header.height * unit;
+    TextRendering_BuildGlyphIndex();
+
+    glActiveTexture(GL_TEXTURE0 + TEXT_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, texttexture_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D( GL_TEXTURE_2D, 0, GL_R8, header.tex_width, header.tex_height, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glActiveTexture(GL_TEXTURE0);
+    glCheckError();
 
-    // A chamada "delete" em C++ é equivalente ao "free()" do C
-    delete [] log;
+    textprogram_id = textsdfprogram_id;
+    return true;
 }
 
-GLuint textVAO;
-GLuint textVBO;
-GLuint textprogram_id;
-GLuint texttexture_id;
+// Contorno (largura em unidades da distância, de 0 a 0.5) e deslocamento da
+// sombra (em texels do atlas) do texto desenhado com a fonte SDF. Ambos são
+// desligados com zero, o padrão. Não têm efeito com a fonte bitmap.
+void TextRendering_SetSdfStyle(float outline_width, float shadow_offset_x, float shadow_offset_y)
+{
+    glUseProgram(textsdfprogram_id);
+    glUniform1f(textoutline_uniform, outline_width);
+    glUniform2f(textshadow_uniform, shadow_offset_x, shadow_offset_y);
+    glUseProgram(0);
+}
+
+// Retorna o glifo de "codepoint", ou NULL se a fonte não o possui.
+static const TextGlyph* TextRendering_FindGlyph(uint32_t codepoint)
+{
+    int index = -1;
+    if (codepoint < TEXT_DIRECT_GLYPHS)
+    {
+        index = textglyph_direct[codepoint];
+    }
+    else
+    {
+        uint32_t slot = TextRendering_HashCodepoint(codepoint);
+        while (textglyph_hash[slot].index >= 0 && textglyph_hash[slot].codepoint != codepoint)
+            slot = (slot + 1) & textglyph_hash_mask;
+        index = textglyph_hash[slot].index;
+    }
+    return index >= 0 ? &textglyphs[index] : NULL;
+}
+
+// Lê o próximo caractere de "str" a partir de "i", decodificando UTF-8, e
+// avança "i". Bytes que não formam uma sequência UTF-8 válida são lidos
+// como Latin-1.
+static uint32_t TextRendering_NextCodepoint(const std::string& str, size_t& i)
+{
+    unsigned char c = (unsigned char)str[i++];
+    int length = (c & 0xE0) == 0xC0 ? 1 : (c & 0xF0) == 0xE0 ? 2 : (c & 0xF8) == 0xF0 ? 3 : 0;
+    if (length == 0 || i + length > str.size())
+        return c;
+
+    uint32_t codepoint = c & (0x3F >> length);
+    for (int k = 0; k < length; ++k)
+    {
+        unsigned char next = (unsigned char)str[i + k];
+        if ((next & 0xC0) != 0x80)
+            return c;
+        codepoint = (codepoint << 6) | (next & 0x3F);
+    }
+    i += length;
+    return codepoint;
+}
 
 void TextRendering_Init()
 {
@@ -101,41 +346,45 @@ void TextRendering_Init()
     glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glCheckError();
 
-    GLuint textvertexshader_id = glCreateShader(GL_VERTEX_SHADER);
-    TextRendering_LoadShader(textvertexshader_source, textvertexshader_id);
-    glCheckError();
-
-    GLuint textfragmentshader_id = glCreateShader(GL_FRAGMENT_SHADER);
-    TextRendering_LoadShader(textfragmentshader_source, textfragmentshader_id);
+    // Os shaders de texto passam pelo mesmo cache em disco dos demais
+    // programas de GPU. Veja "shadercache.cpp".
+    textbitmapprogram_id = CreateGpuProgramFromSources(textvertexshader_source, textfragmentshader_source, "text vertex shader", "text fragment shader");
+    textsdfprogram_id = CreateGpuProgramFromSources(textvertexshader_source, textsdffragmentshader_source, "text vertex shader", "text sdf fragment shader");
     glCheckError();
 
-    textprogram_id = CreateGpuProgram(textvertexshader_id, textfragmentshader_id);
-    glLinkProgram(textprogram_id);
-    glCheckError();
+    textoutline_uniform = glGetUniformLocation(textsdfprogram_id, "outline_width");
+    textshadow_uniform  = glGetUniformLocation(textsdfprogram_id, "shadow_offset");
 
-    GLuint texttex_uniform;
-    texttex_uniform = glGetUniformLocation(textprogram_id, "tex");
+    GLuint programs[2] = { textbitmapprogram_id, textsdfprogram_id };
+    for (int i = 0; i < 2; ++i)
+    {
+        glUseProgram(programs[i]);
+        glUniform1i(glGetUniformLocation(programs[i], "tex"), TEXT_TEXTURE_UNIT);
+    }
+    glUseProgram(0);
     glCheckError();
 
-    glActiveTexture(GL_TEXTURE0);
+    // A fonte fica em uma unidade de textura própria, associada uma única vez.
+    glActiveTexture(GL_TEXTURE0 + TEXT_TEXTURE_UNIT);
     glBindTexture(GL_TEXTURE_2D, texttexture_id);
-    glTexImage2D( GL_TEXTURE_2D, 0, GL_R8, dejavufont.tex_width, dejavufont.tex_height, 0, GL_RED, GL_UNSIGNED_BYTE, dejavufont.tex_data);
-    glBindSampler(0, sampler);
+    glBindSampler(TEXT_TEXTURE_UNIT, sampler);
+    glActiveTexture(GL_TEXTURE0);
     glCheckError();
 
+    if (!TextRendering_LoadSdfFont(TEXT_SDF_FONT_FILENAME))
+    {
+        fprintf(stderr, "Fonte SDF \"%s\" nao encontrada, utilizando a fonte bitmap.\n", TEXT_SDF_FONT_FILENAME);
+        TextRendering_UseBitmapFont();
+    }
+    TextRendering_SetSdfStyle(0.0f, 0.0f, 0.0f);
+
     glBindVertexArray(textVAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferData(GL_ARRAY_BUFFER, 24 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), 0);
     glEnableVertexAttribArray(0);
     glCheckError();
 
-    glUseProgram(textprogram_id);
-    glUniform1i(texttex_uniform, 0);
-    glUseProgram(0);
-    glCheckError();
-
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glCheckError();
@@ -143,41 +392,47 @@ void TextRendering_Init()
 
 float textscale = 1.5f;
 
-void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f)
+// Tamanho da janela utilizado pelo texto. É consultado com
+// glfwGetWindowSize() uma única vez por quadro, na primeira chamada que
+// precisa dele, e invalidado por TextRendering_Flush().
+int  textwindow_width = 1;
+int  textwindow_height = 1;
+bool textwindow_size_valid = false;
+
+static void TextRendering_UpdateWindowSize(GLFWwindow* window)
 {
-    scale *= textscale;
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    float sx = scale / width;
-    float sy = scale / height;
+    if (textwindow_size_valid)
+        return;
 
-    for (size_t i = 0; i < str.size(); i++)
+    glfwGetWindowSize(window, &textwindow_width, &textwindow_height);
+    textwindow_width = textwindow_width > 0 ? textwindow_width : 1;
+    textwindow_height = textwindow_height > 0 ? textwindow_height : 1;
+    textwindow_size_valid = true;
+}
+
+// Gera os vértices dos glifos de "str", com a caneta começando em (x,y), e
+// os adiciona ao final de "vertices".
+static void TextRendering_Layout(const std::string &str, float x, float y, float scale, std::vector<TextVertex>& vertices)
+{
+    float sx = scale / textwindow_width;
+    float sy = scale / textwindow_height;
+
+    for (size_t i = 0; i < str.size(); )
     {
-        // Find the glyph for the character we are looking for
-        texture_glyph_t *glyph = 0;
-        for (size_t j = 0; j < dejavufont.glyphs_count; ++j)
-        {
-            if (dejavufont.glyphs[j].codepoint == (uint32_t)str[i])
-            {
-                glyph = &dejavufont.glyphs[j];
-                break;
-            }
-        }
+        const TextGlyph* glyph = TextRendering_FindGlyph(TextRendering_NextCodepoint(str, i));
         if (!glyph) {
             continue;
         }
-        x += glyph->kerning[0].kerning;
-        float x0 = (float) (x + glyph->offset_x * sx);
-        float y0 = (float) (y + glyph->offset_y * sy);
-        float x1 = (float) (x0 + glyph->width * sx);
-        float y1 = (float) (y0 - glyph->height * sy);
-
-        float s0 = glyph->s0 - 0.5f/dejavufont.tex_width;
-        float t0 = glyph->t0 - 0.5f/dejavufont.tex_height;
-        float s1 = glyph->s1 - 0.5f/dejavufont.tex_width;
-        float t1 = glyph->t1 - 0.5f/dejavufont.tex_height;
-
-        struct {float x, y, s, t;} data[6] = {
+        float x0 = x + glyph->x0 * sx;
+        float y0 = y + glyph->y0 * sy;
+        float x1 = x + glyph->x1 * sx;
+        float y1 = y + glyph->y1 * sy;
+        float s0 = glyph->s0;
+        float t0 = glyph->t0;
+        float s1 = glyph->s1;
+        float t1 = glyph->t1;
+
+        TextVertex quad[6] = {
             { x0, y0, s0, t0 },
             { x0, y1, s0, t1 },
             { x1, y1, s1, t1 },
@@ -185,45 +440,137 @@ void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float
             { x1, y1, s1, t1 },
             { x1, y0, s1, t0 }
         };
+        vertices.insert(vertices.end(), quad, quad + 6);
+
+        x += glyph->advance * sx;
+    }
+}
+
+void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f)
+{
+    TextRendering_UpdateWindowSize(window);
+    TextRendering_Layout(str, x, y, scale * textscale, textvertices);
+}
+
+// Textos retidos: cada um guarda os vértices do último texto escrito com
+// ele, e os reutiliza enquanto o texto, a posição, a escala e o tamanho da
+// janela não mudarem. Utilizados pelas linhas do HUD, que quase sempre são
+// iguais às do quadro anterior.
+struct RetainedText
+{
+    std::string str;
+    float x, y, scale;
+    int   window_width, window_height;
+    std::vector<TextVertex> vertices;
+};
+std::vector<RetainedText> textretained;
+
+// Cria "count" textos retidos, e retorna o identificador do primeiro; os
+// demais têm os identificadores seguintes.
+int TextRendering_CreateText(int count = 1)
+{
+    int first = (int)textretained.size();
+    RetainedText text;
+    text.x = text.y = text.scale = 0.0f;
+    text.window_width = text.window_height = 0;
+    textretained.resize(textretained.size() + count, text);
+    return first;
+}
+
+// Como TextRendering_PrintString(), mas utilizando o texto retido "text"
+void TextRendering_PrintText(GLFWwindow* window, int text, const std::string &str, float x, float y, float scale = 1.0f)
+{
+    TextRendering_UpdateWindowSize(window);
+
+    RetainedText& retained = textretained[text];
+    scale *= textscale;
+    if (retained.window_width != textwindow_width || retained.window_height != textwindow_height ||
+        retained.x != x || retained.y != y || retained.scale != scale || retained.str != str)
+    {
+        retained.str = str;
+        retained.x = x;
+        retained.y = y;
+        retained.scale = scale;
+        retained.window_width = textwindow_width;
+        retained.window_height = textwindow_height;
+        retained.vertices.clear();
+        TextRendering_Layout(str, x, y, scale, retained.vertices);
+    }
+
+    textvertices.insert(textvertices.end(), retained.vertices.begin(), retained.vertices.end());
+}
+
+// Envia "vertices" para o VBO do texto e os desenha por cima do que já foi
+// desenhado. Com "premultiplied_target", o framebuffer ligado guarda cores
+// com alfa pré-multiplicado (o HUD retido, "hud.cpp"), e o blending mantém
+// esse formato.
+static void TextRendering_DrawVertices(const std::vector<TextVertex>& vertices, bool premultiplied_target)
+{
+    if (vertices.empty())
+        return;
+
+    // Enviamos os glifos com "orphaning" do buffer do desenho anterior
+    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
+    if (vertices.size() > textvbo_capacity)
+        textvbo_capacity = vertices.size() * 2;
+    glBufferData(GL_ARRAY_BUFFER, textvbo_capacity * sizeof(TextVertex), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(TextVertex), vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-        glEnable(GL_BLEND);
+    glEnable(GL_BLEND);
+    if (premultiplied_target)
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    else
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glDepthFunc(GL_ALWAYS);
+
+    glUseProgram(textprogram_id);
+    glBindVertexArray(textVAO);
+    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+    glBindVertexArray(0);
+    glUseProgram(0);
 
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glDepthFunc(GL_ALWAYS);
-        glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, 24 * sizeof(float), data);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDepthFunc(GL_LESS);
+    glDisable(GL_BLEND);
+}
 
-        glUseProgram(textprogram_id);
-        glBindVertexArray(textVAO);
-        glBindTexture(GL_TEXTURE_2D, texttexture_id);
+// Desenha todo o texto acumulado no quadro e esvazia o vetor de glifos.
+// Chamada uma vez por quadro, antes de glfwSwapBuffers().
+void TextRendering_Flush(bool premultiplied_target = false)
+{
+    textwindow_size_valid = false;
 
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+    TextRendering_DrawVertices(textvertices, premultiplied_target);
+    textvertices.clear();
+}
 
-        glBindVertexArray(0);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glUseProgram(0);
-        glDepthFunc(GL_LESS);
+// Vértices de TextRendering_DrawString(), reutilizados entre as chamadas
+std::vector<TextVertex> textimmediate;
 
-        glDisable(GL_BLEND);
+// Desenha "str" imediatamente no framebuffer ligado, sem passar pelo vetor
+// de glifos do quadro: o texto acumulado até aqui por
+// TextRendering_PrintString() continua pendente para TextRendering_Flush().
+// Utilizada pelo HUD retido, que desenha na sua própria textura.
+void TextRendering_DrawString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f, bool premultiplied_target = false)
+{
+    TextRendering_UpdateWindowSize(window);
 
-        x += (glyph->advance_x * sx);
-    }
+    textimmediate.clear();
+    TextRendering_Layout(str, x, y, scale * textscale, textimmediate);
+    TextRendering_DrawVertices(textimmediate, premultiplied_target);
 }
 
 float TextRendering_LineHeight(GLFWwindow* window)
 {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    return dejavufont.height / height * textscale;
+    TextRendering_UpdateWindowSize(window);
+    return textfont_height / textwindow_height * textscale;
 }
 
 float TextRendering_CharWidth(GLFWwindow* window)
 {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    return dejavufont.glyphs[32].advance_x / width * textscale;
+    TextRendering_UpdateWindowSize(window);
+    return TextRendering_FindGlyph(' ')->advance / textwindow_width * textscale;
 }
 
 void TextRendering_PrintMatrix(GLFWwindow* window, glm::mat4 M, float x, float y, float scale = 1.0f)
@@ -0,0 +1,118 @@
+// Executa batalhas sem janela, com a simulação de "simulation.cpp", para
+// treinar IAs e testar o balanceamento das classes. Não faz parte do jogo; é
+// compilada com "make headless" e não depende de OpenGL nem de GLFW.
+//
+// Uso: headless [batalhas] [semente]
+//
+// Os dois times são controlados por uma IA simples: o personagem ativo anda
+// pelo caminho de menor custo (veja "pathfinding.h") até ficar ao alcance do
+// inimigo mais próximo, se vira para ele e ataca.
+// Ao final, mostramos as vitórias de cada time e os turnos por segundo.
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+#include "simulation.h"
+#include "pathfinding.h"
+
+// Limite de turnos de uma batalha, para terrenos em que os times não se
+// alcançam
+#define HEADLESS_MAX_TURNS 2000
+
+// Índice do inimigo mais próximo do personagem "index", ou -1
+static int NearestEnemy(int index)
+{
+    const Character& self = characters[index];
+    int nearest = -1;
+    float nearest_distance = 0.0f;
+    for (int i = 0; i < (int)characters.size(); i++)
+    {
+        if (characters[i].team == self.team)
+            continue;
+        glm::vec4 vec = characters[i].position - self.position;
+        float distance = sqrt(vec.x*vec.x + vec.z*vec.z);
+        if (nearest < 0 || distance < nearest_distance)
+        {
+            nearest = i;
+            nearest_distance = distance;
+        }
+    }
+    return nearest;
+}
+
+// Turno do personagem ativo
+static void PlayTurn()
+{
+    Character& self = characters[active_character];
+    int enemy = NearestEnemy(active_character);
+    if (enemy < 0)
+        return;
+
+    // Anda enquanto o inimigo estiver fora do alcance, ou até o caminho
+    // terminar
+    static std::vector<glm::vec4> path;
+    glm::vec4 vec = characters[enemy].position - self.position;
+    float distance = sqrt(vec.x*vec.x + vec.z*vec.z);
+    if (distance > 0.9f * self.range)
+    {
+        Pathfinding_FindPath(self.position, characters[enemy].position, self.remaining_movement, path);
+        size_t next = 0;
+        while (distance > 0.9f * self.range && self.follow_path(path, next))
+        {
+            vec = characters[enemy].position - self.position;
+            distance = sqrt(vec.x*vec.x + vec.z*vec.z);
+        }
+    }
+
+    vec.y = 0.0f;
+    vec.w = 0.0f;
+    self.facing_vector = normalize(vec);
+
+    self.attack();
+    Simulation_AdvanceClock(1.0);
+}
+
+// Time que venceu (1 ou 2), ou 0 se nenhum venceu até HEADLESS_MAX_TURNS
+static int PlayBattle(long& turns)
+{
+    scenary.build();
+    Pathfinding_Build(scenary);
+    characters.clear();
+    CreateCharacters(scenary.land_size);
+    active_character = 0;
+
+    for (int turn = 0; turn < HEADLESS_MAX_TURNS; turn++)
+    {
+        int alive[3] = { 0, 0, 0 };
+        for (size_t i = 0; i < characters.size(); i++)
+            alive[characters[i].team]++;
+        if (alive[1] == 0 || alive[2] == 0)
+            return alive[1] ? 1 : 2;
+
+        PlayTurn();
+        PassTurn();
+        turns++;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int battles = argc > 1 ? atoi(argv[1]) : 1000;
+    unsigned int seed = argc > 2 ? (unsigned int)atoi(argv[2]) : 1;
+    srand(seed);
+
+    int wins[3] = { 0, 0, 0 };
+    long turns = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < battles; i++)
+        wins[PlayBattle(turns)]++;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%d batalhas (semente %u): time 1 venceu %d, time 2 venceu %d, %d empates\n",
+           battles, seed, wins[1], wins[2], wins[0]);
+    printf("%ld turnos em %.3f s (%.0f turnos/s)\n", turns, seconds, seconds > 0 ? turns / seconds : 0.0);
+    return 0;
+}
@@ -0,0 +1,253 @@
+// Ferramenta "offline" que gera o atlas de fonte SDF (signed distance field)
+// carregado por TextRendering_LoadSdfFont(). Não faz parte do jogo; é
+// compilada com "make sdffont" e precisa da biblioteca FreeType.
+//
+// Uso: sdffont <fonte.ttf> <saida.bin> [tamanho] [spread]
+//
+// Cada glifo é rasterizado pela FreeType em SDFFONT_OVERSAMPLE vezes o
+// tamanho final; calculamos a distância de cada pixel desta imagem até a
+// borda do glifo (transformada de distância "8SSEDT", em duas passadas), e
+// amostramos o resultado na resolução final. Os glifos são empacotados em
+// prateleiras ("shelf packing") em um atlas de SDFFONT_ATLAS_WIDTH pixels de
+// largura. O formato do arquivo é descrito em "sdffont.h".
+//
+// O atlas distribuído em "data/dejavufont_sdf.bin" foi gerado com:
+//     sdffont DejaVuSansMono.ttf ../../data/dejavufont_sdf.bin 28 4
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "sdffont.h"
+
+#define SDFFONT_OVERSAMPLE  8
+#define SDFFONT_ATLAS_WIDTH 512
+
+// Deslocamento até o pixel de borda mais próximo, usado pela transformada
+struct DistanceCell
+{
+    int dx, dy;
+    int DistanceSquared() const { return dx*dx + dy*dy; }
+};
+
+// Transformada de distância: para cada pixel de "grid" (w x h), o
+// deslocamento até o pixel mais próximo em que "grid" é falso.
+static std::vector<DistanceCell> DistanceTransform(const std::vector<bool>& grid, int w, int h)
+{
+    const DistanceCell inside = { 1 << 14, 1 << 14 };
+    const DistanceCell outside = { 0, 0 };
+
+    std::vector<DistanceCell> cells(w * h);
+    for (int i = 0; i < w * h; ++i)
+        cells[i] = grid[i] ? inside : outside;
+
+    // Compara a célula (x,y) com a vizinha (x+ox,y+oy)
+    auto compare = [&](int x, int y, int ox, int oy)
+    {
+        int nx = x + ox, ny = y + oy;
+        if (nx < 0 || ny < 0 || nx >= w || ny >= h)
+            return;
+        DistanceCell other = cells[ny * w + nx];
+        other.dx += ox;
+        other.dy += oy;
+        if (other.DistanceSquared() < cells[y * w + x].DistanceSquared())
+            cells[y * w + x] = other;
+    };
+
+    for (int y = 0; y < h; ++y)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            compare(x, y, -1,  0);
+            compare(x, y,  0, -1);
+            compare(x, y, -1, -1);
+            compare(x, y,  1, -1);
+        }
+        for (int x = w - 1; x >= 0; --x)
+            compare(x, y, 1, 0);
+    }
+    for (int y = h - 1; y >= 0; --y)
+    {
+        for (int x = w - 1; x >= 0; --x)
+        {
+            compare(x, y,  1,  0);
+            compare(x, y,  0,  1);
+            compare(x, y, -1,  1);
+            compare(x, y,  1,  1);
+        }
+        for (int x = 0; x < w; ++x)
+            compare(x, y, -1, 0);
+    }
+    return cells;
+}
+
+// Glifo gerado, antes do empacotamento no atlas
+struct GeneratedGlyph
+{
+    SdfFontGlyph metrics;
+    int width, height;
+    int x, y;  // Posição no atlas
+    std::vector<unsigned char> pixels;
+};
+
+static bool GenerateGlyph(FT_Face face, uint32_t codepoint, int spread, GeneratedGlyph& glyph)
+{
+    if (FT_Get_Char_Index(face, codepoint) == 0)
+        return false;
+    if (FT_Load_Char(face, codepoint, FT_LOAD_RENDER))
+        return false;
+
+    const FT_GlyphSlot slot = face->glyph;
+    const FT_Bitmap& bitmap = slot->bitmap;
+    const int os = SDFFONT_OVERSAMPLE;
+
+    // Tamanho final, com a margem de "spread" pixels em cada lado
+    glyph.width  = (int)((bitmap.width + os - 1) / os) + 2 * spread;
+    glyph.height = (int)((bitmap.rows  + os - 1) / os) + 2 * spread;
+
+    // Imagem de alta resolução com a margem, dentro/fora do glifo
+    int hw = glyph.width * os, hh = glyph.height * os;
+    int pad = spread * os;
+    std::vector<bool> inside(hw * hh, false);
+    for (unsigned int y = 0; y < bitmap.rows; ++y)
+        for (unsigned int x = 0; x < bitmap.width; ++x)
+            inside[(y + pad) * hw + (x + pad)] = bitmap.buffer[y * bitmap.pitch + x] >= 128;
+
+    std::vector<bool> outside(inside.size());
+    for (size_t i = 0; i < inside.size(); ++i)
+        outside[i] = !inside[i];
+
+    std::vector<DistanceCell> to_outside = DistanceTransform(inside, hw, hh);
+    std::vector<DistanceCell> to_inside = DistanceTransform(outside, hw, hh);
+
+    glyph.pixels.resize(glyph.width * glyph.height);
+    for (int y = 0; y < glyph.height; ++y)
+    {
+        for (int x = 0; x < glyph.width; ++x)
+        {
+            int i = (y * os + os/2) * hw + (x * os + os/2);
+            float distance = inside[i] ?  sqrtf((float)to_outside[i].DistanceSquared()) - 0.5f
+                                       : -sqrtf((float)to_inside[i].DistanceSquared()) + 0.5f;
+            float value = 0.5f + distance / os / (2.0f * spread);
+            value = std::min(std::max(value, 0.0f), 1.0f);
+            glyph.pixels[y * glyph.width + x] = (unsigned char)lrintf(value * 255.0f);
+        }
+    }
+
+    SdfFontGlyph& m = glyph.metrics;
+    m.codepoint = codepoint;
+    m.width     = (float)glyph.width;
+    m.height    = (float)glyph.height;
+    m.offset_x  = (float)slot->bitmap_left / os - spread;
+    m.offset_y  = (float)slot->bitmap_top / os + spread;
+    m.advance_x = slot->advance.x / 64.0f / os;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Uso: %s <fonte.ttf> <saida.bin> [tamanho] [spread]\n", argv[0]);
+        return 1;
+    }
+    int size = argc > 3 ? atoi(argv[3]) : 28;
+    int spread = argc > 4 ? atoi(argv[4]) : 4;
+    if (size <= 0 || spread <= 0)
+    {
+        fprintf(stderr, "ERROR: tamanho e spread devem ser positivos.\n");
+        return 1;
+    }
+
+    FT_Library library;
+    FT_Face face;
+    if (FT_Init_FreeType(&library) || FT_New_Face(library, argv[1], 0, &face))
+    {
+        fprintf(stderr, "ERROR: nao foi possivel abrir a fonte \"%s\".\n", argv[1]);
+        return 1;
+    }
+    FT_Set_Pixel_Sizes(face, 0, size * SDFFONT_OVERSAMPLE);
+
+    // ASCII e Latin-1 imprimíveis
+    std::vector<GeneratedGlyph> glyphs;
+    for (uint32_t codepoint = 32; codepoint < 256; ++codepoint)
+    {
+        if (codepoint >= 127 && codepoint < 160)
+            continue;
+        GeneratedGlyph glyph;
+        if (GenerateGlyph(face, codepoint, spread, glyph))
+            glyphs.push_back(glyph);
+    }
+
+    // Empacotamento em prateleiras, dos glifos mais altos para os mais baixos
+    std::vector<GeneratedGlyph*> order;
+    for (size_t i = 0; i < glyphs.size(); ++i)
+        order.push_back(&glyphs[i]);
+    std::sort(order.begin(), order.end(), [](const GeneratedGlyph* a, const GeneratedGlyph* b) { return a->height > b->height; });
+
+    int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+    for (GeneratedGlyph* glyph : order)
+    {
+        if (shelf_x + glyph->width > SDFFONT_ATLAS_WIDTH)
+        {
+            shelf_x = 0;
+            shelf_y += shelf_height;
+            shelf_height = 0;
+        }
+        glyph->x = shelf_x;
+        glyph->y = shelf_y;
+        shelf_x += glyph->width;
+        shelf_height = std::max(shelf_height, glyph->height);
+    }
+    int atlas_height = 1;
+    while (atlas_height < shelf_y + shelf_height)
+        atlas_height *= 2;
+
+    std::vector<unsigned char> atlas(SDFFONT_ATLAS_WIDTH * atlas_height, 0);
+    for (GeneratedGlyph& glyph : glyphs)
+    {
+        for (int y = 0; y < glyph.height; ++y)
+            std::copy(&glyph.pixels[y * glyph.width], &glyph.pixels[y * glyph.width] + glyph.width,
+                      &atlas[(glyph.y + y) * SDFFONT_ATLAS_WIDTH + glyph.x]);
+
+        SdfFontGlyph& m = glyph.metrics;
+        m.s0 = (float)glyph.x / SDFFONT_ATLAS_WIDTH;
+        m.t0 = (float)glyph.y / atlas_height;
+        m.s1 = (float)(glyph.x + glyph.width) / SDFFONT_ATLAS_WIDTH;
+        m.t1 = (float)(glyph.y + glyph.height) / atlas_height;
+    }
+
+    SdfFontHeader header;
+    header.magic        = SDFFONT_MAGIC;
+    header.version      = SDFFONT_VERSION;
+    header.tex_width    = SDFFONT_ATLAS_WIDTH;
+    header.tex_height   = atlas_height;
+    header.size         = (float)size;
+    header.height       = face->size->metrics.height / 64.0f / SDFFONT_OVERSAMPLE;
+    header.ascender     = face->size->metrics.ascender / 64.0f / SDFFONT_OVERSAMPLE;
+    header.descender    = face->size->metrics.descender / 64.0f / SDFFONT_OVERSAMPLE;
+    header.spread       = (float)spread;
+    header.glyphs_count = (uint32_t)glyphs.size();
+
+    FILE* file = fopen(argv[2], "wb");
+    if (!file)
+    {
+        fprintf(stderr, "ERROR: nao foi possivel criar \"%s\".\n", argv[2]);
+        return 1;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    for (const GeneratedGlyph& glyph : glyphs)
+        fwrite(&glyph.metrics, sizeof(SdfFontGlyph), 1, file);
+    fwrite(atlas.data(), 1, atlas.size(), file);
+    fclose(file);
+
+    printf("%s: %u glifos, atlas %ux%u\n", argv[2], header.glyphs_count, header.tex_width, header.tex_height);
+
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+    return 0;
+}